@@ -0,0 +1,73 @@
+#pragma once
+
+// Minimal micro-benchmark harness used by dfhack-bench. Benchmarks must not
+// depend on a running DF instance, so they can be run on a plain build box.
+//
+// Usage:
+//
+//   DFHACK_BENCH(MiscUtils, to_search_normalized) {
+//       std::string str = "...";
+//       while (state.next())
+//           Bench::do_not_optimize(to_search_normalized(str));
+//       state.set_bytes_per_op(str.size());
+//   }
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace DFHack {
+namespace Bench {
+    class State {
+    public:
+        explicit State(uint64_t iterations) : remaining(iterations) {}
+
+        // returns true while the harness wants another iteration
+        bool next() {
+            if (remaining == 0)
+                return false;
+            --remaining;
+            return true;
+        }
+
+        void set_bytes_per_op(uint64_t bytes) { bytes_per_op = bytes; }
+        uint64_t get_bytes_per_op() const { return bytes_per_op; }
+
+    private:
+        uint64_t remaining;
+        uint64_t bytes_per_op = 0;
+    };
+
+    typedef std::function<void(State &)> bench_fn;
+
+    struct Benchmark {
+        std::string name;
+        bench_fn fn;
+    };
+
+    std::vector<Benchmark> &registry();
+
+    struct Registrar {
+        Registrar(const char *group, const char *name, bench_fn fn) {
+            registry().push_back({std::string(group) + "." + name, fn});
+        }
+    };
+
+    // keeps the compiler from eliding a computation whose result is unused
+    template<class T>
+    inline void do_not_optimize(const T &value) {
+#if defined(__GNUC__) || defined(__clang__)
+        asm volatile("" : : "r,m"(value) : "memory");
+#else
+        static volatile const void *sink;
+        sink = &value;
+#endif
+    }
+}
+}
+
+#define DFHACK_BENCH(group, name) \
+    static void bench_##group##_##name(DFHack::Bench::State &state); \
+    static DFHack::Bench::Registrar bench_reg_##group##_##name(#group, #name, bench_##group##_##name); \
+    static void bench_##group##_##name(DFHack::Bench::State &state)
@@ -0,0 +1,73 @@
+#include "Bench.h"
+#include "BitArray.h"
+#include "TileTypes.h"
+
+#include "df/map_block.h"
+
+#include <memory>
+
+using namespace DFHack;
+
+DFHACK_BENCH(BitArray, set_and_test) {
+    BitArray<int> bits;
+    bits.resize(1024 / 8);
+    while (state.next()) {
+        int count = 0;
+        for (int i = 0; i < 1024; i += 3)
+            bits.set(i);
+        for (int i = 0; i < 1024; i++)
+            count += bits.is_set(i);
+        bits.clear_all();
+        Bench::do_not_optimize(count);
+    }
+    state.set_bytes_per_op(1024 / 8);
+}
+
+// A synthetic block, so that tile accessors can be measured without a map.
+static std::unique_ptr<df::map_block> make_block() {
+    auto block = std::make_unique<df::map_block>();
+    int tt = 0;
+    for (int x = 0; x < 16; x++) {
+        for (int y = 0; y < 16; y++) {
+            do {
+                tt = (tt + 7) % ENUM_LAST_ITEM(tiletype);
+            } while (!ENUM_ATTR(tiletype, caption, (df::tiletype)tt));
+            block->tiletype[x][y] = (df::tiletype)tt;
+            block->designation[x][y].bits.hidden = (x + y) % 3 == 0;
+            block->designation[x][y].bits.flow_size = (x * y) % 8;
+        }
+    }
+    return block;
+}
+
+DFHACK_BENCH(MapBlock, tiletype_scan) {
+    auto block = make_block();
+    while (state.next()) {
+        int walls = 0, floors = 0;
+        for (int x = 0; x < 16; x++) {
+            for (int y = 0; y < 16; y++) {
+                auto tt = block->tiletype[x][y];
+                walls += isWallTerrain(tt);
+                floors += isFloorTerrain(tt);
+            }
+        }
+        Bench::do_not_optimize(walls + floors);
+    }
+    state.set_bytes_per_op(sizeof(block->tiletype));
+}
+
+DFHACK_BENCH(MapBlock, designation_scan) {
+    auto block = make_block();
+    while (state.next()) {
+        int hidden = 0, liquid = 0;
+        for (int x = 0; x < 16; x++) {
+            for (int y = 0; y < 16; y++) {
+                auto &des = block->designation[x][y].bits;
+                hidden += des.hidden;
+                liquid += des.flow_size;
+            }
+        }
+        Bench::do_not_optimize(hidden + liquid);
+    }
+    state.set_bytes_per_op(sizeof(block->designation));
+}
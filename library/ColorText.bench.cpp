@@ -0,0 +1,20 @@
+#include "Bench.h"
+#include "ColorText.h"
+
+using namespace DFHack;
+
+// A prospector-style table: lots of short lines with alternating colors
+DFHACK_BENCH(ColorText, buffered_table) {
+    buffered_color_ostream out;
+    size_t bytes = 0;
+    while (state.next()) {
+        for (int i = 0; i < 256; i++) {
+            out.color(color_value(i % 16));
+            out.print("  %-32s %6d\n", "granite", i);
+        }
+        bytes = out.text().size();
+        Bench::do_not_optimize(out.spans().size());
+        out.clear();
+    }
+    state.set_bytes_per_op(bytes);
+}
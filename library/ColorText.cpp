@@ -60,10 +60,10 @@ bool color_ostream::log_errors_to_stderr = false;
 void color_ostream::flush_buffer(bool flush)
 {
     auto buffer = buf();
-    auto str = buffer->str();
+    auto str = buffer->view();
 
     if (!str.empty()) {
-        add_text(cur_color, buffer->str());
+        add_text(cur_color, str);
         buffer->str(std::string());
     }
 
@@ -153,7 +153,7 @@ void color_ostream::reset_color(void)
     color(COLOR_RESET);
 }
 
-void color_ostream_wrapper::add_text(color_value, const std::string &text)
+void color_ostream_wrapper::add_text(color_value, std::string_view text)
 {
     out << text;
 }
@@ -163,42 +163,69 @@ void color_ostream_wrapper::flush_proxy()
     out << std::flush;
 }
 
-void buffered_color_ostream::add_text(color_value color, const std::string &text)
+// Don't hold on to the memory of one huge burst of output forever
+static const size_t MAX_RETAINED_CAPACITY = 64 * 1024;
+
+void buffered_color_ostream::add_text(color_value color, std::string_view text)
 {
     if (text.empty())
         return;
 
-    if (buffer.empty())
+    if (!spans_buffer.empty() && spans_buffer.back().color == color)
+        spans_buffer.back().length += text.size();
+    else
+        spans_buffer.push_back(span_type{color, text_buffer.size(), text.size()});
+
+    text_buffer.append(text);
+}
+
+std::vector<buffered_color_ostream::fragment_type> buffered_color_ostream::fragments() const
+{
+    std::vector<fragment_type> result;
+    result.reserve(spans_buffer.size());
+    for (auto &span : spans_buffer)
+        result.push_back(fragment_type(span.color, text(span)));
+    return result;
+}
+
+void buffered_color_ostream::clear()
+{
+    if (text_buffer.capacity() > MAX_RETAINED_CAPACITY)
     {
-        buffer.push_back(fragment_type(color, text));
+        std::string().swap(text_buffer);
+        std::vector<span_type>().swap(spans_buffer);
     }
     else
     {
-        auto &back = buffer.back();
-
-        if (back.first != color || std::max(back.second.size(), text.size()) > 128)
-            buffer.push_back(fragment_type(color, text));
-        else
-            buffer.back().second += text;
+        text_buffer.clear();
+        spans_buffer.clear();
     }
 }
 
+void buffered_color_ostream::take(std::string &text, std::vector<span_type> &spans)
+{
+    text.clear();
+    spans.clear();
+    text.swap(text_buffer);
+    spans.swap(spans_buffer);
+}
+
 void color_ostream_proxy::flush_proxy()
 {
-    if (buffer.empty())
+    if (empty())
         return;
 
     if (target)
     {
         target->begin_batch();
 
-        for (auto it = buffer.begin(); it != buffer.end(); ++it)
-            target->add_text(it->first, it->second);
+        for (auto &span : spans_buffer)
+            target->add_text(span.color, text(span));
 
         target->end_batch();
     }
 
-    buffer.clear();
+    clear();
 }
 
 color_ostream_proxy::~color_ostream_proxy()
@@ -0,0 +1,97 @@
+#include "ColorText.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+using namespace DFHack;
+
+namespace {
+    // records everything it is given, like the console would print it
+    class recording_ostream : public color_ostream {
+    protected:
+        virtual void add_text(color_value color, std::string_view text) {
+            added.emplace_back(color, std::string(text));
+        }
+        virtual void begin_batch() { batches++; color_ostream::begin_batch(); }
+
+    public:
+        std::vector<std::pair<color_value, std::string>> added;
+        int batches = 0;
+    };
+}
+
+TEST(ColorText, buffered_spans) {
+    buffered_color_ostream out;
+    EXPECT_TRUE(out.empty());
+
+    out << "hello ";
+    out.print("%s", "world\n");
+    out.color(COLOR_LIGHTRED);
+    out << "error";
+    out.reset_color();
+    out << "\n";
+    out.flush();
+
+    EXPECT_EQ(out.text(), "hello world\nerror\n");
+    auto &spans = out.spans();
+    ASSERT_EQ(spans.size(), 3);
+    EXPECT_EQ(spans[0].color, COLOR_RESET);
+    EXPECT_EQ(out.text(spans[0]), "hello world\n");
+    EXPECT_EQ(spans[1].color, COLOR_LIGHTRED);
+    EXPECT_EQ(out.text(spans[1]), "error");
+    EXPECT_EQ(out.text(spans[2]), "\n");
+
+    auto fragments = out.fragments();
+    ASSERT_EQ(fragments.size(), 3);
+    EXPECT_EQ(fragments[1].first, COLOR_LIGHTRED);
+    EXPECT_EQ(fragments[1].second, "error");
+
+    out.clear();
+    EXPECT_TRUE(out.empty());
+    EXPECT_EQ(out.text(), "");
+}
+
+TEST(ColorText, buffered_take) {
+    buffered_color_ostream out;
+    out.print("one\n");
+    out.color(COLOR_GREEN);
+    out.print("two\n");
+
+    std::string text = "stale";
+    std::vector<buffered_color_ostream::span_type> spans(4);
+    out.take(text, spans);
+
+    EXPECT_TRUE(out.empty());
+    EXPECT_EQ(out.text(), "");
+    EXPECT_EQ(text, "one\ntwo\n");
+    ASSERT_EQ(spans.size(), 2);
+    EXPECT_EQ(spans[1].color, COLOR_GREEN);
+    EXPECT_EQ(spans[1].offset, 4);
+    EXPECT_EQ(spans[1].length, 4);
+
+    out.print("three\n");
+    EXPECT_EQ(out.text(), "three\n");
+    EXPECT_EQ(out.spans().size(), 1);
+}
+
+TEST(ColorText, proxy_flush) {
+    recording_ostream target;
+    {
+        color_ostream_proxy proxy(target);
+        proxy << "a";
+        proxy.color(COLOR_CYAN);
+        proxy << "b";
+        proxy.color(COLOR_CYAN);
+        proxy << "c" << std::endl;
+        proxy.reset_color();
+        proxy.print("d\n");
+    }
+
+    ASSERT_EQ(target.added.size(), 3);
+    EXPECT_EQ(target.added[0], std::make_pair(COLOR_RESET, std::string("a")));
+    EXPECT_EQ(target.added[1], std::make_pair(COLOR_CYAN, std::string("bc\n")));
+    EXPECT_EQ(target.added[2], std::make_pair(COLOR_RESET, std::string("d\n")));
+    EXPECT_EQ(target.batches, 2);
+}
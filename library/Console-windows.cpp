@@ -88,14 +88,19 @@ namespace DFHack
             fputs(data, dfout_C);
         }
 
-        void print_text(color_ostream::color_value clr, const std::string &chunk)
+        void print(std::string_view data)
+        {
+            fwrite(data.data(), 1, data.size(), dfout_C);
+        }
+
+        void print_text(color_ostream::color_value clr, std::string_view chunk)
         {
             if(!in_batch && state == con_lineedit)
             {
                 clearline();
 
                 color(clr);
-                print(chunk.c_str());
+                print(chunk);
 
                 reset_color();
                 prompt_refresh();
@@ -103,7 +108,7 @@ namespace DFHack
             else
             {
                 color(clr);
-                print(chunk.c_str());
+                print(chunk);
             }
         }
 
@@ -542,7 +547,7 @@ void Console::flush_proxy()
         d->flush();
 }
 
-void Console::add_text(color_value color, const std::string &text)
+void Console::add_text(color_value color, std::string_view text)
 {
     std::lock_guard<std::recursive_mutex> lock{*wlock};
     if (inited)
@@ -48,6 +48,7 @@ distribution.
 #include "modules/Filesystem.h"
 #include "modules/Gui.h"
 #include "modules/Textures.h"
+#include "modules/Units.h"
 #include "modules/World.h"
 #include "modules/Persistence.h"
 
@@ -215,61 +216,7 @@ thread_local int CommandDepthCounter::depth = 0;
 
 void Core::cheap_tokenise(std::string const& input, std::vector<std::string>& output)
 {
-    std::string *cur = NULL;
-    size_t i = 0;
-
-    // Check the first non-space character
-    while (i < input.size() && isspace(input[i])) i++;
-
-    // Special verbatim argument mode?
-    if (i < input.size() && input[i] == ':')
-    {
-        // Read the command
-        std::string cmd;
-        i++;
-        while (i < input.size() && !isspace(input[i]))
-            cmd.push_back(input[i++]);
-        if (!cmd.empty())
-            output.push_back(cmd);
-
-        // Find the argument
-        while (i < input.size() && isspace(input[i])) i++;
-
-        if (i < input.size())
-            output.push_back(input.substr(i));
-
-        return;
-    }
-
-    // Otherwise, parse in the regular quoted mode
-    for (; i < input.size(); i++)
-    {
-        unsigned char c = input[i];
-        if (isspace(c)) {
-            cur = NULL;
-        } else {
-            if (!cur) {
-                output.push_back("");
-                cur = &output.back();
-            }
-
-            if (c == '"') {
-                for (i++; i < input.size(); i++) {
-                    c = input[i];
-                    if (c == '"')
-                        break;
-                    else if (c == '\\') {
-                        if (++i < input.size())
-                            cur->push_back(input[i]);
-                    }
-                    else
-                        cur->push_back(c);
-                }
-            } else {
-                cur->push_back(c);
-            }
-        }
-    }
+    tokenize_command_line(input, output);
 }
 
 struct IODATA
@@ -2085,12 +2032,16 @@ int Core::Update()
 extern bool buildings_do_onupdate;
 void buildings_onStateChange(color_ostream &out, state_change_event event);
 void buildings_onUpdate(color_ostream &out);
+void materials_onStateChange(color_ostream &out, state_change_event event);
+void items_onStateChange(color_ostream &out, state_change_event event);
+void world_onStateChange(color_ostream &out, state_change_event event);
 
 static int buildings_timer = 0;
 
 void Core::onUpdate(color_ostream &out)
 {
     Gui::clearFocusStringCache();
+    Units::clearUnitClasses();
 
     uint32_t step_start_ms = p->getTickCount();
     EventManager::manageEvents(out);
@@ -2254,6 +2205,11 @@ void Core::onStateChange(color_ostream &out, state_change_event event)
         }
     }
 
+    // drop cached raws and map lookups before anything below gets a chance to use them
+    materials_onStateChange(out, event);
+    items_onStateChange(out, event);
+    world_onStateChange(out, event);
+
     switch (event)
     {
     case SC_CORE_INITIALIZED:
@@ -28,7 +28,13 @@ redistribute it freely, subject to the following restrictions:
 
 #include <algorithm>
 #include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
 #include <iomanip>
+#include <memory>
 #include <thread>
 
 #ifdef _MSC_VER
@@ -106,66 +112,387 @@ static color_value selectColor(const DebugCategory::level msgLevel)
 namespace {
 static std::atomic<uint32_t> nextId{0};
 static EXEC_ATTR thread_local uint32_t thread_id{nextId.fetch_add(1)+1};
-}
 
-DebugCategory::ostream_proxy_prefix::ostream_proxy_prefix(
-        const DebugCategory& cat,
-        color_ostream& target,
-        const DebugCategory::level msgLevel) :
-    color_ostream_proxy(target)
+//! Formats HH:MM:SS. localtime_r is relatively expensive, so the result is
+//! cached per thread and only recomputed when the second changes.
+static const std::string& formatTime(std::time_t now_c)
 {
-    DebugManager &dm = DebugManager::getInstance();
-    const DebugManager::HeaderConfig &config = dm.getHeaderConfig();
+    static thread_local std::time_t cached_time = -1;
+    static thread_local std::string cached;
+    if (now_c != cached_time) {
+        tm local{};
+        char buffer[32];
+        size_t sz = strftime(buffer, sizeof(buffer)/sizeof(buffer[0]),
+                             "%T", localtime_r(&now_c, &local));
+        cached.assign(sz > 0 ? buffer : "HH:MM:SS");
+        cached_time = now_c;
+    }
+    return cached;
+}
 
-    color(selectColor(msgLevel));
+static void appendNames(std::string& out, const DebugCategory& cat,
+        const DebugManager::HeaderConfig& config)
+{
+    if (config.plugin) {
+        out += cat.plugin();
+        out += ':';
+    }
+    if (config.category) {
+        out += cat.category();
+        out += ':';
+    }
+}
 
-    bool has_header = false;
+//! Builds the message header. names must come from appendNames.
+static std::string makeHeader(const DebugManager::HeaderConfig& config,
+        std::chrono::system_clock::time_point now,
+        uint32_t tid,
+        const std::string& names)
+{
+    std::string header;
     if (config.timestamp) {
-        has_header = true;
-        auto now = std::chrono::system_clock::now();
-        tm local{};
         //! \todo c++ 2020 will have std::chrono::to_stream(fmt, system_clock::now())
         //! but none implements it yet.
-        std::time_t now_c = std::chrono::system_clock::to_time_t(now);
-        // Output time in format %02H:%02M:%02S.%03ms
-#if __GNUC__ < 5
-        // Fallback for gcc 4
-        char buffer[32];
-        size_t sz = strftime(buffer, sizeof(buffer)/sizeof(buffer[0]),
-                             "%T", localtime_r(&now_c, &local));
-        *this << (sz > 0 ? buffer : "HH:MM:SS");
-#else
-        *this << std::put_time(localtime_r(&now_c, &local),"%T");
-#endif
+        header += formatTime(std::chrono::system_clock::to_time_t(now));
         if (config.timestamp_ms) {
             auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
                     now.time_since_epoch()) % 1000;
-            *this << '.' << std::setfill('0') << std::setw(3) << ms.count();
+            char buffer[8];
+            snprintf(buffer, sizeof(buffer), ".%03d", int(ms.count()));
+            header += buffer;
         }
-        *this << ':';
+        header += ':';
     }
     if (config.thread_id) {
-        has_header = true;
         // Thread id is allocated in the thread creation order to a thread_local
         // variable
-        *this << 't' << thread_id << ':';
-    }
-    if (config.plugin) {
-        has_header = true;
-        *this << cat.plugin() << ':';
-    }
-    if (config.category) {
-        has_header = true;
-        *this << cat.category() << ':';
+        header += 't';
+        header += std::to_string(tid);
+        header += ':';
     }
+    header += names;
     // It would be easy to pass __FILE__ and __LINE__ from the logging macros
     // and include that information as well, if we want to.
 
-    if (has_header) {
-        *this << ' ';
+    if (!header.empty())
+        header += ' ';
+    return header;
+}
+
+//! A message waiting in the async queue. The category names are copied
+//! because the plugin owning the category may be unloaded before the message
+//! is written.
+struct LogRecord {
+    std::chrono::system_clock::time_point time;
+    uint32_t thread;
+    DebugCategory::level level;
+    //! set for the second and later flushes of the same message stream, which
+    //! don't get a header of their own
+    bool continued;
+    std::string names;
+    std::string text;
+    std::vector<buffered_color_ostream::span_type> spans;
+};
+
+/*!
+ * Bounded lock-free multi-producer single-consumer queue. Each cell carries a
+ * sequence number which tells producers and the consumer whose turn it is to
+ * use the cell. Producers never wait: push fails when the queue is full.
+ */
+class LogQueue {
+    static constexpr size_t SIZE = 4096; // must be a power of two
+
+    struct Cell {
+        std::atomic<size_t> seq;
+        LogRecord record;
+    };
+
+    std::unique_ptr<Cell[]> cells_;
+    alignas(64) std::atomic<size_t> head_{0}; // next position to write
+    alignas(64) size_t tail_ = 0;            // next position to read
+public:
+    LogQueue() : cells_(new Cell[SIZE]) {
+        for (size_t i = 0; i < SIZE; ++i)
+            cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    bool push(LogRecord&& record) {
+        size_t pos = head_.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells_[pos & (SIZE - 1)];
+            size_t seq = cell.seq.load(std::memory_order_acquire);
+            intptr_t diff = intptr_t(seq) - intptr_t(pos);
+            if (diff == 0) {
+                if (head_.compare_exchange_weak(pos, pos + 1,
+                        std::memory_order_relaxed)) {
+                    cell.record = std::move(record);
+                    cell.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    //! Must only be called from the single consumer thread
+    bool pop(LogRecord& record) {
+        Cell& cell = cells_[tail_ & (SIZE - 1)];
+        size_t seq = cell.seq.load(std::memory_order_acquire);
+        if (seq != tail_ + 1)
+            return false;
+        record = std::move(cell.record);
+        cell.seq.store(tail_ + SIZE, std::memory_order_release);
+        ++tail_;
+        return true;
+    }
+};
+
+/*!
+ * Background writer for the async log backend. Log calls only format the
+ * message body and push it to the queue; the header formatting, console
+ * locking and file output all happen on the writer thread.
+ */
+class AsyncLogger {
+    LogQueue queue_;
+    std::atomic<bool> active_{false};
+    std::atomic<uint64_t> dropped_{0};
+    uint64_t reported_ = 0;
+
+    //! serializes configuration changes
+    mutable std::mutex config_mutex_;
+    DebugManager::AsyncConfig config_;
+
+    std::mutex wake_mutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+    std::thread writer_;
+
+    std::ofstream file_;
+    size_t file_size_ = 0;
+
+    void writeRecords() {
+        const DebugManager::HeaderConfig& header_config =
+            DebugManager::getInstance().getHeaderConfig();
+        std::unique_ptr<color_ostream_proxy> console;
+        LogRecord record;
+        while (queue_.pop(record)) {
+            std::string header;
+            if (!record.continued)
+                header = makeHeader(header_config, record.time, record.thread,
+                        record.names);
+            if (config_.console) {
+                if (!console)
+                    console.reset(new color_ostream_proxy(Core::getInstance().getConsole()));
+                if (!header.empty()) {
+                    console->color(selectColor(record.level));
+                    *console << header;
+                }
+                for (auto& span : record.spans) {
+                    console->color(span.color);
+                    console->write(record.text.data() + span.offset, span.length);
+                }
+            }
+            if (file_.is_open()) {
+                file_ << header;
+                file_size_ += header.size();
+                file_ << record.text;
+                file_size_ += record.text.size();
+            }
+        }
+        uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+        if (dropped != reported_) {
+            std::string msg = "debug: dropped " + std::to_string(dropped - reported_)
+                + " log messages because the async queue was full\n";
+            reported_ = dropped;
+            if (config_.console) {
+                if (!console)
+                    console.reset(new color_ostream_proxy(Core::getInstance().getConsole()));
+                console->color(COLOR_LIGHTRED);
+                *console << msg;
+            }
+            if (file_.is_open()) {
+                file_ << msg;
+                file_size_ += msg.size();
+            }
+        }
+        if (file_.is_open()) {
+            file_.flush();
+            if (config_.max_file_size && file_size_ >= config_.max_file_size)
+                rotateFile();
+        }
+        // console proxy flushes everything in one batch when it is destroyed
+    }
+
+    bool openFile(std::ios::openmode mode) {
+        file_.open(config_.file, std::ios::out | mode);
+        file_size_ = 0;
+        if (!file_.is_open())
+            return false;
+        file_.seekp(0, std::ios::end);
+        file_size_ = size_t(file_.tellp());
+        return true;
+    }
+
+    void rotateFile() {
+        file_.close();
+        std::string old = config_.file + ".1";
+        std::remove(old.c_str());
+        std::rename(config_.file.c_str(), old.c_str());
+        openFile(std::ios::trunc);
     }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(wake_mutex_);
+        while (!stopping_) {
+            // producers never signal; polling keeps the log call wait free
+            wake_.wait_for(lock, std::chrono::milliseconds(5));
+            lock.unlock();
+            writeRecords();
+            lock.lock();
+        }
+    }
+
+    //! Caller must hold config_mutex_
+    void stop() {
+        if (!writer_.joinable())
+            return;
+        active_.store(false, std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_one();
+        writer_.join();
+        // pick up anything pushed by threads which saw the backend active
+        writeRecords();
+        file_.close();
+    }
+
+public:
+    ~AsyncLogger() {
+        std::lock_guard<std::mutex> lock(config_mutex_);
+        config_.console = false;
+        stop();
+    }
+
+    bool active() const {
+        return active_.load(std::memory_order_relaxed);
+    }
+
+    void submit(LogRecord&& record) {
+        if (!queue_.push(std::move(record)))
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint64_t dropped() const {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+    DebugManager::AsyncConfig config() const {
+        std::lock_guard<std::mutex> lock(config_mutex_);
+        return config_;
+    }
+
+    bool configure(const DebugManager::AsyncConfig& config) {
+        std::lock_guard<std::mutex> lock(config_mutex_);
+        stop();
+        config_ = config;
+        if (!config_.enabled)
+            return true;
+        bool ok = true;
+        if (!config_.file.empty() && !openFile(std::ios::app)) {
+            ok = false;
+            config_.file.clear();
+        }
+        stopping_ = false;
+        writer_ = std::thread(&AsyncLogger::run, this);
+        active_.store(true, std::memory_order_relaxed);
+        return ok;
+    }
+
+    static AsyncLogger& getInstance() {
+        static AsyncLogger instance;
+        return instance;
+    }
+};
+}
+
+//! Core::Update and most other callers wrap the console in proxies, so look
+//! through them to find out where the output ends up
+static bool targetsConsole(color_ostream& target)
+{
+    color_ostream* stream = &target;
+    while (color_ostream* next = stream->proxy_target())
+        stream = next;
+    return stream->is_console();
 }
 
+DebugCategory::ostream_proxy_prefix::ostream_proxy_prefix(
+        const DebugCategory& cat,
+        color_ostream& target,
+        const DebugCategory::level msgLevel) :
+    color_ostream_proxy(target),
+    level_(msgLevel),
+    // Only console output is deferred. Other targets are usually command
+    // output buffers which must see the message before the command returns.
+    async_(targetsConsole(target) && AsyncLogger::getInstance().active())
+{
+    DebugManager &dm = DebugManager::getInstance();
+    const DebugManager::HeaderConfig &config = dm.getHeaderConfig();
+
+    color(selectColor(msgLevel));
+
+    if (async_) {
+        // The writer thread formats the header
+        time_ = std::chrono::system_clock::now();
+        appendNames(names_, cat, config);
+        return;
+    }
+
+    std::string names;
+    appendNames(names, cat, config);
+    auto now = config.timestamp ? std::chrono::system_clock::now()
+        : std::chrono::system_clock::time_point{};
+    *this << makeHeader(config, now, thread_id, names);
+}
+
+void DebugCategory::ostream_proxy_prefix::flush_proxy()
+{
+    if (!async_) {
+        color_ostream_proxy::flush_proxy();
+        return;
+    }
+    if (empty())
+        return;
+
+    LogRecord record;
+    record.time = time_;
+    record.thread = thread_id;
+    record.level = level_;
+    record.continued = continued_;
+    record.names = std::move(names_);
+    take(record.text, record.spans);
+    continued_ = true;
+    AsyncLogger::getInstance().submit(std::move(record));
+}
+
+DebugManager::AsyncConfig DebugManager::getAsyncConfig() const
+{
+    return AsyncLogger::getInstance().config();
+}
+
+bool DebugManager::setAsyncConfig(const AsyncConfig& config)
+{
+    return AsyncLogger::getInstance().configure(config);
+}
+
+uint64_t DebugManager::getAsyncDropped() const
+{
+    return AsyncLogger::getInstance().dropped();
+}
 
 DebugCategory::level DebugCategory::allowed() const noexcept
 {
@@ -0,0 +1,71 @@
+#include "Debug.h"
+#include "DebugManager.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace DFHack;
+
+namespace {
+    // stands in for the console, which the async backend writes for
+    class fake_console : public color_ostream {
+    protected:
+        virtual void add_text(color_value, std::string_view text) {
+            added.emplace_back(text);
+        }
+
+    public:
+        std::vector<std::string> added;
+        virtual bool is_console() { return true; }
+    };
+
+    std::string read_file(const std::string &fname) {
+        std::ifstream file(fname);
+        std::stringstream ss;
+        ss << file.rdbuf();
+        return ss.str();
+    }
+}
+
+TEST(Debug, async_through_proxy) {
+    const std::string log_file = "debug_test_async.log";
+    remove(log_file.c_str());
+
+    DebugCategory cat("test", "async", DebugCategory::LTRACE);
+    auto &dm = DebugManager::getInstance();
+    DebugManager::AsyncConfig config;
+    config.enabled = true;
+    config.console = false;
+    config.file = log_file;
+    ASSERT_TRUE(dm.setAsyncConfig(config));
+
+    fake_console console;
+    {
+        // the way Core::Update hands the console to onupdate code
+        color_ostream_proxy out(console);
+        cat.getStream(DebugCategory::LDEBUG, out) << "queued message\n";
+    }
+    // queued, so nothing has reached the console directly
+    EXPECT_TRUE(console.added.empty());
+
+    // stopping the backend writes out whatever is still queued
+    ASSERT_TRUE(dm.setAsyncConfig(DebugManager::AsyncConfig()));
+    EXPECT_NE(read_file(log_file).find("queued message"), std::string::npos);
+
+    // with the backend off, the message goes straight through the proxy
+    {
+        color_ostream_proxy out(console);
+        cat.getStream(DebugCategory::LDEBUG, out) << "direct message\n";
+    }
+    std::string direct;
+    for (auto &text : console.added)
+        direct += text;
+    EXPECT_NE(direct.find("direct message"), std::string::npos);
+
+    remove(log_file.c_str());
+}
@@ -0,0 +1,287 @@
+/*
+https://github.com/peterix/dfhack
+Copyright (c) 2009-2012 Petr Mrázek (peterix@gmail.com)
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use, copy, modify, merge, publish,
+distribute, sell, and to alter it and redistribute it freely, subject to
+the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must
+not claim that you wrote the original software. If you use this
+software in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+#include "HelpIndex.h"
+#include "MiscUtils.h"
+
+#include "modules/Filesystem.h"
+
+#include <json/json.h>
+
+#include <algorithm>
+#include <fstream>
+
+using namespace DFHack;
+
+/*
+ * Parse cache
+ */
+
+bool HelpIndex::getStamp(const std::string &path, Stamp &stamp)
+{
+    STAT_STRUCT info;
+    if (!Filesystem::stat(path, info))
+        return false;
+    stamp.mtime = info.st_mtime;
+    stamp.size = info.st_size;
+    return true;
+}
+
+const HelpIndex::TextEntry *HelpIndex::getCached(const std::string &path)
+{
+    Stamp stamp;
+    if (!getStamp(path, stamp))
+    {
+        pending.erase(path);
+        return NULL;
+    }
+
+    auto it = cache.find(path);
+    if (it != cache.end() && it->second.stamp == stamp)
+        return &it->second.entry;
+
+    pending[path] = stamp;
+    return NULL;
+}
+
+void HelpIndex::setCached(const std::string &path, TextEntry entry)
+{
+    // the stamp has to come from before the file was parsed, or a change made
+    // while it was being read would never be picked up
+    auto it = pending.find(path);
+    if (it == pending.end())
+        return;
+    auto &record = cache[path];
+    record.stamp = it->second;
+    record.entry = std::move(entry);
+    pending.erase(it);
+    dirty = true;
+}
+
+bool HelpIndex::loadCache(const std::string &fname, const std::string &version)
+{
+    cache.clear();
+    pending.clear();
+    dirty = false;
+
+    Json::Value json;
+    try
+    {
+        std::ifstream file(fname);
+        if (!file)
+            return false;
+        file >> json;
+    }
+    catch (std::exception &)
+    {
+        // truncated or otherwise garbled; it will be rewritten
+        return false;
+    }
+
+    if (!json.isObject() || json["version"].asString() != version)
+        return false;
+
+    const Json::Value &files = json["files"];
+    if (!files.isObject())
+        return false;
+    for (auto it = files.begin(); it != files.end(); ++it)
+    {
+        const Json::Value &value = *it;
+        CacheRecord record;
+        record.stamp.mtime = value["mtime"].asInt64();
+        record.stamp.size = value["size"].asInt64();
+        record.entry.short_help = UTF2DF(value["short_help"].asString());
+        record.entry.long_help = UTF2DF(value["long_help"].asString());
+        for (auto &tag : value["tags"])
+            record.entry.tags.push_back(UTF2DF(tag.asString()));
+        cache.emplace(it.name(), std::move(record));
+    }
+    return true;
+}
+
+bool HelpIndex::saveCache(const std::string &fname, const std::string &version)
+{
+    if (!dirty)
+        return true;
+
+    Json::Value files(Json::objectValue);
+    for (auto it = cache.begin(); it != cache.end(); )
+    {
+        Stamp stamp;
+        if (!getStamp(it->first, stamp) || !(stamp == it->second.stamp))
+        {
+            it = cache.erase(it);
+            continue;
+        }
+
+        auto &entry = it->second.entry;
+        Json::Value value(Json::objectValue);
+        value["mtime"] = Json::Int64(stamp.mtime);
+        value["size"] = Json::Int64(stamp.size);
+        // the text is in the DF encoding, and jsoncpp would take the high
+        // bytes for broken UTF-8
+        value["short_help"] = DF2UTF(entry.short_help);
+        value["long_help"] = DF2UTF(entry.long_help);
+        Json::Value tags(Json::arrayValue);
+        for (auto &tag : entry.tags)
+            tags.append(DF2UTF(tag));
+        value["tags"] = tags;
+        files[it->first] = value;
+        ++it;
+    }
+
+    Json::Value json(Json::objectValue);
+    json["version"] = version;
+    json["files"] = files;
+
+    std::ofstream file(fname);
+    if (!file)
+        return false;
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    file << Json::writeString(builder, json);
+    if (!file)
+        return false;
+
+    dirty = false;
+    return true;
+}
+
+/*
+ * Search index
+ */
+
+void HelpIndex::clearEntries()
+{
+    entries.clear();
+    labels.clear();
+}
+
+std::vector<uint16_t> HelpIndex::internLabels(const std::vector<std::string> &names)
+{
+    std::vector<uint16_t> ids;
+    ids.reserve(names.size());
+    for (auto &name : names)
+        ids.push_back(labels.emplace(name, uint16_t(labels.size())).first->second);
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    return ids;
+}
+
+void HelpIndex::addEntry(const std::string &name, const std::vector<std::string> &entry_types,
+    const std::vector<std::string> &tags)
+{
+    Entry entry;
+    entry.name = name;
+    entry.entry_types = internLabels(entry_types);
+    entry.tags = internLabels(tags);
+    entries.push_back(std::move(entry));
+}
+
+void HelpIndex::finalizeEntries()
+{
+    std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+        return basenameLess(a.name, b.name);
+    });
+}
+
+bool HelpIndex::basenameLess(const std::string &a, const std::string &b)
+{
+    // walk the path components from the end
+    size_t a_end = a.size(), b_end = b.size();
+    while (true)
+    {
+        size_t a_start = a.rfind('/', a_end - 1);
+        size_t b_start = b.rfind('/', b_end - 1);
+        a_start = (a_start == std::string::npos || a_end == 0) ? 0 : a_start + 1;
+        b_start = (b_start == std::string::npos || b_end == 0) ? 0 : b_start + 1;
+
+        int cmp = a.compare(a_start, a_end - a_start, b, b_start, b_end - b_start);
+        if (cmp != 0)
+            return cmp < 0;
+
+        bool a_more = a_start > 0, b_more = b_start > 0;
+        if (!a_more)
+            return false;
+        if (!b_more)
+            return true;
+        a_end = a_start - 1;
+        b_end = b_start - 1;
+    }
+}
+
+bool HelpIndex::matches(const Entry &entry, const Filter &filter) const
+{
+    auto has_any = [&](const std::vector<uint16_t> &ids, const std::vector<std::string> &names) {
+        for (auto &name : names)
+        {
+            auto it = labels.find(name);
+            if (it != labels.end() && std::binary_search(ids.begin(), ids.end(), it->second))
+                return true;
+        }
+        return false;
+    };
+
+    if (!filter.tag.empty() && !has_any(entry.tags, filter.tag))
+        return false;
+    if (!filter.entry_type.empty() && !has_any(entry.entry_types, filter.entry_type))
+        return false;
+    if (!filter.str.empty())
+    {
+        bool matched = false;
+        for (auto &str : filter.str)
+        {
+            if (entry.name.find(str) != std::string::npos)
+            {
+                matched = true;
+                break;
+            }
+        }
+        if (!matched)
+            return false;
+    }
+    return true;
+}
+
+bool HelpIndex::matchesAll(const Entry &entry, const std::vector<Filter> &filters) const
+{
+    for (auto &filter : filters)
+    {
+        if (!matches(entry, filter))
+            return false;
+    }
+    return true;
+}
+
+std::vector<const std::string *> HelpIndex::search(const std::vector<Filter> &include,
+    const std::vector<Filter> &exclude) const
+{
+    std::vector<const std::string *> names;
+    for (auto &entry : entries)
+    {
+        if (matchesAll(entry, include) && (exclude.empty() || !matchesAll(entry, exclude)))
+            names.push_back(&entry.name);
+    }
+    return names;
+}
@@ -0,0 +1,127 @@
+#include "HelpIndex.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace DFHack;
+
+namespace {
+    std::vector<std::string> names(const std::vector<const std::string *> &found) {
+        std::vector<std::string> ret;
+        for (auto name : found)
+            ret.push_back(*name);
+        return ret;
+    }
+
+    void write_file(const std::string &fname, const std::string &contents) {
+        std::ofstream file(fname);
+        file << contents;
+    }
+}
+
+TEST(HelpIndex, basename_order) {
+    EXPECT_TRUE(HelpIndex::basenameLess("gui/autofarm", "autofarm"));
+    EXPECT_FALSE(HelpIndex::basenameLess("autofarm", "gui/autofarm"));
+    EXPECT_TRUE(HelpIndex::basenameLess("zzz/abc", "abd"));
+    EXPECT_TRUE(HelpIndex::basenameLess("a/x", "b/x"));
+    EXPECT_FALSE(HelpIndex::basenameLess("x", "x"));
+    EXPECT_TRUE(HelpIndex::basenameLess("devel/dump-rpc", "enable"));
+    EXPECT_TRUE(HelpIndex::basenameLess("disable", "devel/dump-rpc"));
+}
+
+TEST(HelpIndex, search) {
+    HelpIndex index;
+    index.addEntry("autofarm", {"plugin", "command"}, {"fort", "auto"});
+    index.addEntry("gui/autofarm", {"command"}, {"fort", "interface"});
+    index.addEntry("ls", {"builtin", "command"}, {"dev"});
+    index.addEntry("devel/dump-rpc", {"builtin", "command"}, {"dev"});
+    index.addEntry("nocommand", {"plugin"}, {});
+    index.finalizeEntries();
+    ASSERT_EQ(index.numEntries(), 5);
+
+    std::vector<std::string> all = {"gui/autofarm", "autofarm", "devel/dump-rpc", "ls", "nocommand"};
+    EXPECT_EQ(names(index.search({}, {})), all);
+
+    HelpIndex::Filter farm;
+    farm.str = {"farm"};
+    EXPECT_EQ(names(index.search({farm}, {})), std::vector<std::string>({"gui/autofarm", "autofarm"}));
+
+    // lists within a filter are ANDed, values within a list are ORed
+    HelpIndex::Filter fort_plugin;
+    fort_plugin.tag = {"fort", "nosuchtag"};
+    fort_plugin.entry_type = {"plugin"};
+    EXPECT_EQ(names(index.search({fort_plugin}, {})), std::vector<std::string>({"autofarm"}));
+
+    // filters in a list are ANDed too
+    HelpIndex::Filter builtin, dev;
+    builtin.entry_type = {"builtin"};
+    dev.str = {"dev"};
+    EXPECT_EQ(names(index.search({builtin, dev}, {})),
+        std::vector<std::string>({"devel/dump-rpc"}));
+    EXPECT_EQ(names(index.search({}, {builtin, dev})),
+        std::vector<std::string>({"gui/autofarm", "autofarm", "ls", "nocommand"}));
+
+    HelpIndex::Filter unknown;
+    unknown.tag = {"nosuchtag"};
+    EXPECT_TRUE(index.search({unknown}, {}).empty());
+
+    index.clearEntries();
+    EXPECT_TRUE(index.search({}, {}).empty());
+}
+
+TEST(HelpIndex, parse_cache) {
+    const std::string doc = "help_index_test_doc.txt";
+    const std::string cache_file = "help_index_test_cache.json";
+    write_file(doc, "some help\n");
+
+    HelpIndex index;
+    EXPECT_EQ(index.getCached(doc), nullptr);
+    HelpIndex::TextEntry entry;
+    entry.short_help = "Short.";
+    entry.long_help = "some help";
+    entry.tags = {"fort"};
+    index.setCached(doc, entry);
+    // nothing is cached unless getCached() missed first
+    index.setCached("help_index_test_missing.txt", entry);
+    EXPECT_EQ(index.cacheSize(), 1);
+
+    auto cached = index.getCached(doc);
+    ASSERT_NE(cached, nullptr);
+    EXPECT_EQ(cached->short_help, "Short.");
+    EXPECT_EQ(cached->tags, std::vector<std::string>({"fort"}));
+    EXPECT_TRUE(index.saveCache(cache_file, "v1"));
+
+    HelpIndex loaded;
+    EXPECT_FALSE(loaded.loadCache(cache_file, "v2"));
+    EXPECT_EQ(loaded.cacheSize(), 0);
+    EXPECT_TRUE(loaded.loadCache(cache_file, "v1"));
+    cached = loaded.getCached(doc);
+    ASSERT_NE(cached, nullptr);
+    EXPECT_EQ(cached->long_help, "some help");
+
+    // help text is stored in the DF encoding, whose high bytes aren't UTF-8
+    const std::string high_bytes = "caf\x82 \x9c\x15 \xe1\xfe";
+    entry.long_help = high_bytes;
+    entry.tags = {"\x8e"};
+    write_file(doc, "some other help\n");
+    EXPECT_EQ(loaded.getCached(doc), nullptr);
+    loaded.setCached(doc, entry);
+    EXPECT_TRUE(loaded.saveCache(cache_file, "v1"));
+    HelpIndex reloaded;
+    EXPECT_TRUE(reloaded.loadCache(cache_file, "v1"));
+    cached = reloaded.getCached(doc);
+    ASSERT_NE(cached, nullptr);
+    EXPECT_EQ(cached->long_help, high_bytes);
+    EXPECT_EQ(cached->tags, std::vector<std::string>({"\x8e"}));
+
+    // a change in size invalidates the record even if the mtime is the same
+    write_file(doc, "some longer help, longer still\n");
+    EXPECT_EQ(reloaded.getCached(doc), nullptr);
+
+    remove(doc.c_str());
+    remove(cache_file.c_str());
+}
@@ -33,6 +33,7 @@ distribution.
 #include "DataIdentity.h"
 #include "Debug.h"
 #include "DFHackVersion.h"
+#include "HelpIndex.h"
 #include "LuaTools.h"
 #include "LuaWrapper.h"
 #include "md5wrapper.h"
@@ -579,8 +580,38 @@ static int dfhack_matinfo_matches(lua_State *state)
     return 1;
 }
 
+static int dfhack_matinfo_findRawIndex(lua_State *state)
+{
+    const char *kind = luaL_checkstring(state, 1);
+    std::string token = luaL_checkstring(state, 2);
+    int32_t idx;
+
+    if (strcmp(kind, "inorganic") == 0)
+        idx = RawTokens::findInorganic(token);
+    else if (strcmp(kind, "plant") == 0)
+        idx = RawTokens::findPlant(token);
+    else if (strcmp(kind, "creature") == 0)
+        idx = RawTokens::findCreature(token);
+    else if (strcmp(kind, "material_template") == 0)
+        idx = RawTokens::findMaterialTemplate(token);
+    else
+    {
+        df::item_type itype;
+        if (!find_enum_item(&itype, kind))
+            luaL_argerror(state, 1, "unknown raws vector");
+        idx = RawTokens::findItemdef(itype, token);
+    }
+
+    if (idx < 0)
+        lua_pushnil(state);
+    else
+        lua_pushinteger(state, idx);
+    return 1;
+}
+
 static const luaL_Reg dfhack_matinfo_funcs[] = {
     { "find", dfhack_matinfo_find },
+    { "findRawIndex", dfhack_matinfo_findRawIndex },
     { "decode", dfhack_matinfo_decode },
     { "getToken", dfhack_matinfo_getToken },
     { "toString", dfhack_matinfo_toString },
@@ -1252,6 +1283,162 @@ static void OpenRandom(lua_State *state)
 }
 
 
+/*********************
+ * Map tile snapshot *
+ *********************/
+
+static int DFHACK_MAPSNAPSHOT_TOKEN = 0;
+using Maps::TileSnapshot;
+
+static const char *const mapsnapshot_fields[] = {
+    "tiletype", "designation", "occupancy", "walkable", "liquid", NULL
+};
+
+static TileSnapshot *check_mapsnapshot_native(lua_State *L, int index)
+{
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &DFHACK_MAPSNAPSHOT_TOKEN);
+
+    if (!lua_getmetatable(L, index) || !lua_rawequal(L, -1, -2))
+        luaL_argerror(L, index, "not a map snapshot object");
+
+    lua_pop(L, 2);
+
+    return (TileSnapshot*)lua_touserdata(L, index);
+}
+
+static int dfhack_mapsnapshot_new(lua_State *L)
+{
+    df::coord pos1, pos2;
+    Lua::CheckDFAssign(L, &pos1, 1);
+    Lua::CheckDFAssign(L, &pos2, 2);
+    cuboid bounds(pos1, pos2);
+    if (!bounds.clampMap().isValid())
+        luaL_error(L, "snapshot bounds are outside the map");
+
+    uint32_t fields = TileSnapshot::FIELD_ALL;
+    if (!lua_isnoneornil(L, 3))
+    {
+        luaL_checktype(L, 3, LUA_TTABLE);
+        fields = 0;
+        int cnt = lua_rawlen(L, 3);
+        for (int i = 1; i <= cnt; i++)
+        {
+            lua_rawgeti(L, 3, i);
+            const char *name = lua_tostring(L, -1);
+            int field = 0;
+            while (mapsnapshot_fields[field] && (!name || strcmp(name, mapsnapshot_fields[field])))
+                field++;
+            if (!mapsnapshot_fields[field])
+                luaL_argerror(L, 3, "unknown map snapshot field");
+            fields |= 1 << field;
+            lua_pop(L, 1);
+        }
+    }
+
+    // the metatable goes on first, so the object is collected even if the
+    // buffers can't be allocated
+    auto snapshot = new (L) TileSnapshot();
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &DFHACK_MAPSNAPSHOT_TOKEN);
+    lua_setmetatable(L, -2);
+
+    snapshot->reset(bounds, fields);
+    snapshot->refresh();
+    return 1;
+}
+
+static int dfhack_mapsnapshot_gc(lua_State *L)
+{
+    check_mapsnapshot_native(L, 1)->~TileSnapshot();
+    return 0;
+}
+
+static int dfhack_mapsnapshot_refresh(lua_State *L)
+{
+    TileSnapshot *snapshot = check_mapsnapshot_native(L, 1);
+    size_t count;
+    if (lua_isnoneornil(L, 2))
+        count = snapshot->refresh();
+    else
+    {
+        df::coord pos1, pos2;
+        Lua::CheckDFAssign(L, &pos1, 2);
+        Lua::CheckDFAssign(L, &pos2, 3);
+        count = snapshot->refresh(cuboid(pos1, pos2));
+    }
+    lua_pushinteger(L, count);
+    return 1;
+}
+
+static int dfhack_mapsnapshot_get_bounds(lua_State *L)
+{
+    auto &bounds = check_mapsnapshot_native(L, 1)->getBounds();
+    Lua::Push(L, df::coord(bounds.x_min, bounds.y_min, bounds.z_min));
+    Lua::Push(L, df::coord(bounds.x_max, bounds.y_max, bounds.z_max));
+    return 2;
+}
+
+// index of the tile at the position given after the snapshot argument, or -1
+// if the snapshot has no data for it
+static ptrdiff_t mapsnapshot_tile(lua_State *L, TileSnapshot *snapshot, uint32_t field)
+{
+    if (field && !(snapshot->getFields() & field))
+        luaL_error(L, "field not included in this map snapshot");
+    auto pos = CheckCoordXYZ(L, 2, true);
+    if (!snapshot->contains(pos))
+        return -1;
+    size_t idx = snapshot->index(pos);
+    return snapshot->hasData(idx) ? ptrdiff_t(idx) : -1;
+}
+
+static int dfhack_mapsnapshot_has_data(lua_State *L)
+{
+    lua_pushboolean(L, mapsnapshot_tile(L, check_mapsnapshot_native(L, 1), 0) >= 0);
+    return 1;
+}
+
+#define MAPSNAPSHOT_GETTER(name, field, getter) \
+    static int dfhack_mapsnapshot_##name(lua_State *L) \
+    { \
+        TileSnapshot *snapshot = check_mapsnapshot_native(L, 1); \
+        ptrdiff_t idx = mapsnapshot_tile(L, snapshot, TileSnapshot::field); \
+        if (idx < 0) \
+            lua_pushnil(L); \
+        else \
+            lua_pushinteger(L, snapshot->getter(idx)); \
+        return 1; \
+    }
+MAPSNAPSHOT_GETTER(get_tiletype, FIELD_TILETYPE, getTileType)
+MAPSNAPSHOT_GETTER(get_designation, FIELD_DESIGNATION, getDesignation)
+MAPSNAPSHOT_GETTER(get_occupancy, FIELD_OCCUPANCY, getOccupancy)
+MAPSNAPSHOT_GETTER(get_walkable_group, FIELD_WALKABLE, getWalkableGroup)
+MAPSNAPSHOT_GETTER(get_liquid_level, FIELD_LIQUID, getLiquidLevel)
+#undef MAPSNAPSHOT_GETTER
+
+static const luaL_Reg dfhack_mapsnapshot_funcs[] = {
+    { "__gc", dfhack_mapsnapshot_gc },
+    { "refresh", dfhack_mapsnapshot_refresh },
+    { "getBounds", dfhack_mapsnapshot_get_bounds },
+    { "hasData", dfhack_mapsnapshot_has_data },
+    { "getTileType", dfhack_mapsnapshot_get_tiletype },
+    { "getDesignation", dfhack_mapsnapshot_get_designation },
+    { "getOccupancy", dfhack_mapsnapshot_get_occupancy },
+    { "getWalkableGroup", dfhack_mapsnapshot_get_walkable_group },
+    { "getLiquidLevel", dfhack_mapsnapshot_get_liquid_level },
+    { NULL, NULL }
+};
+
+static void OpenMapSnapshot(lua_State *state)
+{
+    luaL_getsubtable(state, lua_gettop(state), "mapsnapshot");
+
+    lua_dup(state);
+    lua_rawsetp(state, LUA_REGISTRYINDEX, &DFHACK_MAPSNAPSHOT_TOKEN);
+
+    luaL_setfuncs(state, dfhack_mapsnapshot_funcs, 0);
+
+    lua_pop(state, 1);
+}
+
 /*********************************
 * Commandline history repository *
 **********************************/
@@ -1989,6 +2176,7 @@ static const luaL_Reg dfhack_textures_funcs[] = {
 /***** Units module *****/
 
 static const LuaWrapper::FunctionReg dfhack_units_module[] = {
+    WRAPM(Units, findUnitByID),
     WRAPM(Units, isActive),
     WRAPM(Units, isVisible),
     WRAPM(Units, isCitizen),
@@ -2321,6 +2509,7 @@ static int32_t items_findSubtype(string token) {
 static const LuaWrapper::FunctionReg dfhack_items_module[] = {
     WRAPN(findType, items_findType),
     WRAPN(findSubtype, items_findSubtype),
+    WRAPM(Items, findItemByID),
     WRAPM(Items, isCasteMaterial),
     WRAPM(Items, getSubtypeCount),
     WRAPM(Items, getSubtypeDef),
@@ -2422,7 +2611,25 @@ static int items_createItem(lua_State *state)
     return 1;
 }
 
+static int items_getValues(lua_State *state)
+{
+    luaL_checktype(state, 1, LUA_TTABLE);
+    auto caravan = Lua::GetDFObject<df::caravan_state>(state, 2);
+    int cnt = lua_rawlen(state, 1);
+    vector<df::item *> items;
+    items.reserve(cnt);
+    for (int i = 1; i <= cnt; i++)
+    {
+        lua_rawgeti(state, 1, i);
+        items.push_back(Lua::CheckDFObject<df::item>(state, lua_gettop(state)));
+        lua_pop(state, 1);
+    }
+    Lua::PushVector(state, Items::getValues(items, caravan));
+    return 1;
+}
+
 static const luaL_Reg dfhack_items_funcs[] = {
+    { "getValues", items_getValues },
     { "getOuterContainerRef", items_getOuterContainerRef },
     { "getContainedItems", items_getContainedItems },
     { "getPosition", items_getPosition },
@@ -2602,6 +2809,7 @@ static const luaL_Reg dfhack_maps_funcs[] = {
     { "isTileHeavyAquifer", maps_isTileHeavyAquifer },
     { "setTileAquifer", maps_setTileAquifer },
     { "removeTileAquifer", maps_removeTileAquifer },
+    { "snapshot", dfhack_mapsnapshot_new },
     { NULL, NULL }
 };
 
@@ -2690,6 +2898,7 @@ static bool buildings_containsTile(df::building *bld, int x, int y) {
 }
 
 static const LuaWrapper::FunctionReg dfhack_buildings_module[] = {
+    WRAPM(Buildings, findBuildingByID),
     WRAPM(Buildings, getGeneralRef),
     WRAPM(Buildings, getSpecificRef),
     WRAPM(Buildings, setOwner),
@@ -3856,11 +4065,10 @@ static int internal_runCommand(lua_State *L)
         for (auto iter = fragments.begin(); iter != fragments.end(); iter++, i++)
         {
             int color = iter->first;
-            string output = iter->second;
             lua_createtable(L, 2, 0);
             lua_pushinteger(L, color);
             lua_rawseti(L, -2, 1);
-            lua_pushstring(L, output.c_str());
+            lua_pushlstring(L, iter->second.data(), iter->second.size());
             lua_rawseti(L, -2, 2);
             lua_rawseti(L, -2, i);
         }
@@ -4020,6 +4228,165 @@ static int internal_getCommandDescription(lua_State *L)
     return 1;
 }
 
+// backs the help database in helpdb.lua
+static HelpIndex help_index;
+
+// appends the strings in the list at idx; a plain string counts as a list of one
+static void read_help_string_list(lua_State *L, int idx, std::vector<std::string> &out)
+{
+    if (lua_isstring(L, idx))
+    {
+        out.push_back(lua_tostring(L, idx));
+        return;
+    }
+    if (!lua_istable(L, idx))
+        return;
+    int cnt = lua_rawlen(L, idx);
+    for (int i = 1; i <= cnt; i++)
+    {
+        lua_rawgeti(L, idx, i);
+        if (lua_isstring(L, -1))
+            out.push_back(lua_tostring(L, -1));
+        lua_pop(L, 1);
+    }
+}
+
+// appends the string keys of the set at idx
+static void read_help_string_set(lua_State *L, int idx, std::vector<std::string> &out)
+{
+    if (!lua_istable(L, idx))
+        return;
+    idx = lua_absindex(L, idx);
+    lua_pushnil(L);
+    while (lua_next(L, idx))
+    {
+        if (lua_toboolean(L, -1) && lua_type(L, -2) == LUA_TSTRING)
+            out.push_back(lua_tostring(L, -2));
+        lua_pop(L, 1);
+    }
+}
+
+static int internal_getHelpCache(lua_State *L)
+{
+    auto entry = help_index.getCached(luaL_checkstring(L, 1));
+    if (!entry)
+    {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    lua_createtable(L, 0, 3);
+    lua_pushstring(L, entry->short_help.c_str());
+    lua_setfield(L, -2, "short_help");
+    lua_pushstring(L, entry->long_help.c_str());
+    lua_setfield(L, -2, "long_help");
+    lua_createtable(L, entry->tags.size(), 0);
+    for (size_t i = 0; i < entry->tags.size(); i++)
+    {
+        lua_pushstring(L, entry->tags[i].c_str());
+        lua_rawseti(L, -2, i + 1);
+    }
+    lua_setfield(L, -2, "tags");
+    return 1;
+}
+
+static int internal_setHelpCache(lua_State *L)
+{
+    std::string path = luaL_checkstring(L, 1);
+    HelpIndex::TextEntry entry;
+    entry.short_help = luaL_checkstring(L, 2);
+    entry.long_help = luaL_checkstring(L, 3);
+    read_help_string_list(L, 4, entry.tags);
+    help_index.setCached(path, std::move(entry));
+    return 0;
+}
+
+static int internal_loadHelpCache(lua_State *L)
+{
+    lua_pushboolean(L, help_index.loadCache(luaL_checkstring(L, 1), luaL_checkstring(L, 2)));
+    return 1;
+}
+
+static int internal_saveHelpCache(lua_State *L)
+{
+    lua_pushboolean(L, help_index.saveCache(luaL_checkstring(L, 1), luaL_checkstring(L, 2)));
+    return 1;
+}
+
+// takes the entry and text databases from helpdb.lua
+static int internal_setHelpIndex(lua_State *L)
+{
+    luaL_checktype(L, 1, LUA_TTABLE);
+    luaL_checktype(L, 2, LUA_TTABLE);
+
+    help_index.clearEntries();
+    std::vector<std::string> entry_types, tags;
+    lua_pushnil(L);
+    while (lua_next(L, 1))
+    {
+        if (lua_type(L, -2) == LUA_TSTRING && lua_istable(L, -1))
+        {
+            entry_types.clear();
+            tags.clear();
+            int entry = lua_gettop(L);
+            lua_getfield(L, entry, "entry_types");
+            read_help_string_set(L, -1, entry_types);
+            lua_getfield(L, entry, "text_entry");
+            lua_rawget(L, 2);
+            if (lua_istable(L, -1))
+            {
+                lua_getfield(L, -1, "tags");
+                read_help_string_set(L, -1, tags);
+            }
+            help_index.addEntry(lua_tostring(L, entry - 1), entry_types, tags);
+            lua_settop(L, entry);
+        }
+        lua_pop(L, 1);
+    }
+    help_index.finalizeEntries();
+    return 0;
+}
+
+static void read_help_filters(lua_State *L, int idx, std::vector<HelpIndex::Filter> &filters)
+{
+    if (!lua_istable(L, idx))
+        return;
+    int cnt = lua_rawlen(L, idx);
+    for (int i = 1; i <= cnt; i++)
+    {
+        lua_rawgeti(L, idx, i);
+        if (lua_istable(L, -1))
+        {
+            HelpIndex::Filter filter;
+            lua_getfield(L, -1, "str");
+            read_help_string_list(L, -1, filter.str);
+            lua_getfield(L, -2, "tag");
+            read_help_string_list(L, -1, filter.tag);
+            lua_getfield(L, -3, "entry_type");
+            read_help_string_list(L, -1, filter.entry_type);
+            lua_pop(L, 3);
+            filters.push_back(std::move(filter));
+        }
+        lua_pop(L, 1);
+    }
+}
+
+static int internal_searchHelpIndex(lua_State *L)
+{
+    std::vector<HelpIndex::Filter> include, exclude;
+    read_help_filters(L, 1, include);
+    read_help_filters(L, 2, exclude);
+
+    auto names = help_index.search(include, exclude);
+    lua_createtable(L, names.size(), 0);
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        lua_pushstring(L, names[i]->c_str());
+        lua_rawseti(L, -2, i + 1);
+    }
+    return 1;
+}
+
 static int internal_threadid(lua_State *L)
 {
     std::stringstream ss;
@@ -4195,6 +4562,12 @@ static const luaL_Reg dfhack_internal_funcs[] = {
     { "listCommands", internal_listCommands },
     { "getCommandHelp", internal_getCommandHelp },
     { "getCommandDescription", internal_getCommandDescription },
+    { "getHelpCache", internal_getHelpCache },
+    { "setHelpCache", internal_setHelpCache },
+    { "loadHelpCache", internal_loadHelpCache },
+    { "saveHelpCache", internal_saveHelpCache },
+    { "setHelpIndex", internal_setHelpIndex },
+    { "searchHelpIndex", internal_searchHelpIndex },
     { "threadid", internal_threadid },
     { "md5File", internal_md5file },
     { "getSuppressDuplicateKeyboardEvents", internal_getSuppressDuplicateKeyboardEvents },
@@ -4219,6 +4592,7 @@ void OpenDFHackApi(lua_State *state)
     OpenPen(state);
     OpenPenArray(state);
     OpenRandom(state);
+    OpenMapSnapshot(state);
 
     LuaWrapper::SetFunctionWrappers(state, dfhack_module);
     luaL_setfuncs(state, dfhack_funcs, 0);
@@ -0,0 +1,20 @@
+#include "Bench.h"
+
+#include "modules/Maps.h"
+
+using namespace DFHack;
+
+// A 192x192 tile cavern over four levels, with scattered pillars, connected
+// to the level below along one edge.
+DFHACK_BENCH(Maps, flood_fill_cavern) {
+    Maps::BlockGrid grid(12, 12, 4);
+    auto open = [](const df::coord &pos) {
+        return (pos.x * 7 + pos.y * 13 + pos.z) % 29 != 0;
+    };
+    Maps::FloodOptions opts;
+    opts.down = [](const df::coord &from, const df::coord &) { return from.x == 0; };
+
+    Maps::TileBitmap flooded;
+    while (state.next())
+        Bench::do_not_optimize(Maps::floodFill(flooded, grid, df::coord(1, 1, 3), open, opts));
+}
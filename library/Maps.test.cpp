@@ -0,0 +1,123 @@
+#include "modules/Maps.h"
+
+#include <gtest/gtest.h>
+
+#include <set>
+#include <vector>
+
+using namespace DFHack;
+
+namespace {
+    // a 32x32 tile map with three levels and a wall along x == 8 on each
+    const Maps::BlockGrid grid(2, 2, 3);
+
+    bool open_tile(const df::coord &pos) {
+        return pos.x != 8;
+    }
+}
+
+TEST(Maps, tile_bitmap_rows) {
+    Maps::TileBitmap bitmap;
+    bitmap.reset(grid);
+    EXPECT_FALSE(bitmap.get(df::coord(3, 4, 0)));
+    EXPECT_TRUE(bitmap.set(df::coord(3, 4, 0)));
+    EXPECT_FALSE(bitmap.set(df::coord(3, 4, 0)));
+    EXPECT_FALSE(bitmap.set(df::coord(-1, 4, 0)));
+    EXPECT_TRUE(bitmap.get(df::coord(3, 4, 0)));
+
+    // crosses from the first block into the second
+    bitmap.setRow(df::coord(12, 5, 1), 20);
+    EXPECT_EQ(bitmap.count(), 10);
+    EXPECT_EQ(bitmap.numBlocks(), 3);
+    EXPECT_TRUE(bitmap.get(df::coord(15, 5, 1)));
+    EXPECT_TRUE(bitmap.get(df::coord(16, 5, 1)));
+    EXPECT_FALSE(bitmap.get(df::coord(21, 5, 1)));
+
+    std::vector<std::pair<df::coord, int16_t>> spans;
+    bitmap.forSpan([&](const df::coord &start, int16_t length) {
+        spans.emplace_back(start, length);
+    });
+    ASSERT_EQ(spans.size(), 3);
+    EXPECT_EQ(spans[0], std::make_pair(df::coord(3, 4, 0), int16_t(1)));
+    EXPECT_EQ(spans[1], std::make_pair(df::coord(12, 5, 1), int16_t(4)));
+    EXPECT_EQ(spans[2], std::make_pair(df::coord(16, 5, 1), int16_t(5)));
+}
+
+TEST(Maps, flood_fill_level) {
+    Maps::TileBitmap flooded;
+    EXPECT_EQ(Maps::floodFill(flooded, grid, df::coord(0, 0, 1), open_tile), 8 * 32);
+    EXPECT_TRUE(flooded.get(df::coord(7, 31, 1)));
+    EXPECT_FALSE(flooded.get(df::coord(9, 0, 1)));
+    EXPECT_FALSE(flooded.get(df::coord(0, 0, 0)));
+
+    EXPECT_EQ(Maps::floodFill(flooded, grid, df::coord(8, 0, 1), open_tile), 0);
+    EXPECT_EQ(flooded.count(), 0);
+    EXPECT_EQ(Maps::floodFill(flooded, grid, df::coord(40, 0, 1), open_tile), 0);
+}
+
+TEST(Maps, flood_fill_diagonal) {
+    // a diagonal line of tiles
+    auto diagonal = [](const df::coord &pos) { return pos.x == pos.y; };
+    Maps::TileBitmap flooded;
+    EXPECT_EQ(Maps::floodFill(flooded, grid, df::coord(0, 0, 0), diagonal), 1);
+
+    Maps::FloodOptions opts;
+    opts.diagonal = true;
+    EXPECT_EQ(Maps::floodFill(flooded, grid, df::coord(0, 0, 0), diagonal, opts), 32);
+    EXPECT_TRUE(flooded.get(df::coord(31, 31, 0)));
+}
+
+TEST(Maps, flood_fill_levels) {
+    Maps::FloodOptions opts;
+    // only move up from column 0 and down from column 20
+    opts.up = [](const df::coord &from, const df::coord &to) {
+        EXPECT_EQ(from.z + 1, to.z);
+        return from.x == 0 && from.y == 0;
+    };
+    opts.down = [](const df::coord &from, const df::coord &to) {
+        EXPECT_EQ(from.z - 1, to.z);
+        return from.x == 20;
+    };
+
+    Maps::TileBitmap flooded;
+    EXPECT_EQ(Maps::floodFill(flooded, grid, df::coord(0, 0, 1), open_tile, opts), 2 * 8 * 32);
+    EXPECT_TRUE(flooded.get(df::coord(0, 0, 2)));
+    EXPECT_FALSE(flooded.get(df::coord(0, 0, 0)));
+
+    EXPECT_EQ(Maps::floodFill(flooded, grid, df::coord(20, 0, 2), open_tile, opts), 3 * 23 * 32);
+    EXPECT_TRUE(flooded.get(df::coord(31, 31, 0)));
+
+    // every tile shows up exactly once in the spans
+    std::set<df::coord> seen;
+    flooded.forSpan([&](const df::coord &start, int16_t length) {
+        EXPECT_EQ(start.x >> 4, (start.x + length - 1) >> 4);
+        for (int16_t i = 0; i < length; ++i)
+            EXPECT_TRUE(seen.insert(df::coord(start.x + i, start.y, start.z)).second);
+    });
+    EXPECT_EQ(seen.size(), flooded.count());
+}
+
+TEST(Maps, tile_snapshot_layout) {
+    Maps::TileSnapshot snapshot;
+    EXPECT_FALSE(snapshot.contains(df::coord(-1, -1, -1)));
+
+    snapshot.reset(cuboid(10, 20, 2, 13, 22, 3), Maps::TileSnapshot::FIELD_TILETYPE);
+    EXPECT_TRUE(snapshot.contains(df::coord(10, 20, 2)));
+    EXPECT_TRUE(snapshot.contains(df::coord(13, 22, 3)));
+    EXPECT_FALSE(snapshot.contains(df::coord(14, 22, 3)));
+    EXPECT_FALSE(snapshot.contains(df::coord(10, 20, 1)));
+
+    // x varies fastest, then y, then z
+    EXPECT_EQ(snapshot.index(df::coord(10, 20, 2)), 0);
+    EXPECT_EQ(snapshot.index(df::coord(11, 20, 2)), 1);
+    EXPECT_EQ(snapshot.index(df::coord(10, 21, 2)), 4);
+    EXPECT_EQ(snapshot.index(df::coord(13, 22, 3)), 23);
+    EXPECT_FALSE(snapshot.hasData(23));
+
+    // doesn't touch the map if the area is outside the snapshot
+    EXPECT_EQ(snapshot.refresh(cuboid(0, 0, 0, 5, 5, 5)), 0);
+
+    snapshot.reset(cuboid(), Maps::TileSnapshot::FIELD_ALL);
+    EXPECT_FALSE(snapshot.contains(df::coord(-1, -1, -1)));
+    EXPECT_EQ(snapshot.refresh(), 0);
+}
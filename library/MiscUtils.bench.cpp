@@ -0,0 +1,62 @@
+#include "Bench.h"
+#include "MiscUtils.h"
+
+#include <string>
+#include <vector>
+
+using namespace DFHack;
+
+static std::string make_text(size_t words) {
+    static const char *samples[] = {
+        "Urist", "McMiner", "\x82lite", "granite", "blocks", "r\x82" "cup\x82r\x82",
+        "the", "Stinky", "Cheese", "Man", "na\x8bve", "obsidian", "short", "sword",
+    };
+    std::string out;
+    for (size_t i = 0; i < words; i++) {
+        if (i)
+            out += ' ';
+        out += samples[i % (sizeof(samples) / sizeof(samples[0]))];
+    }
+    return out;
+}
+
+DFHACK_BENCH(MiscUtils, to_search_normalized) {
+    std::string str = make_text(16);
+    while (state.next())
+        Bench::do_not_optimize(to_search_normalized(str));
+    state.set_bytes_per_op(str.size());
+}
+
+DFHACK_BENCH(MiscUtils, prefix_matches) {
+    std::string tail;
+    std::string key = "tiletypes-command";
+    while (state.next()) {
+        Bench::do_not_optimize(prefix_matches("tiletypes", key, &tail));
+        Bench::do_not_optimize(prefix_matches("liquids", key, &tail));
+    }
+}
+
+DFHACK_BENCH(MiscUtils, DF2UTF) {
+    std::string str = make_text(64);
+    while (state.next())
+        Bench::do_not_optimize(DF2UTF(str));
+    state.set_bytes_per_op(str.size());
+}
+
+DFHACK_BENCH(MiscUtils, UTF2DF) {
+    std::string str = DF2UTF(make_text(64));
+    while (state.next())
+        Bench::do_not_optimize(UTF2DF(str));
+    state.set_bytes_per_op(str.size());
+}
+
+DFHACK_BENCH(MiscUtils, word_wrap) {
+    std::string str = make_text(200);
+    std::vector<std::string> lines;
+    while (state.next()) {
+        lines.clear();
+        word_wrap(&lines, str, 60);
+        Bench::do_not_optimize(lines.size());
+    }
+    state.set_bytes_per_op(str.size());
+}
@@ -17,3 +17,56 @@ TEST(MiscUtils, wordwrap) {
     word_wrap(&result, "1234567", 3);
     ASSERT_EQ(result.size(), 3);
 }
+
+TEST(MiscUtils, tokenize_command_line) {
+    std::vector<std::string> result;
+
+    tokenize_command_line("  cmd a  \"b c\" \"d\\\"e\"", result);
+    ASSERT_EQ(result.size(), 4);
+    EXPECT_EQ(result[0], "cmd");
+    EXPECT_EQ(result[1], "a");
+    EXPECT_EQ(result[2], "b c");
+    EXPECT_EQ(result[3], "d\"e");
+
+    result.clear();
+    tokenize_command_line(":lua print(\"x y\")", result);
+    ASSERT_EQ(result.size(), 2);
+    EXPECT_EQ(result[0], "lua");
+    EXPECT_EQ(result[1], "print(\"x y\")");
+}
+
+struct id_obj {
+    int32_t id;
+};
+
+TEST(MiscUtils, id_index) {
+    std::vector<id_obj*> vec;
+    for (int32_t id : {2, 3, 5, 8, 13})
+        vec.push_back(new id_obj{id});
+
+    id_index<id_obj> index;
+    EXPECT_EQ(index.find(vec, 5, 14), vec[2]);
+    EXPECT_EQ(index.find(vec, 13, 14), vec[4]);
+    EXPECT_EQ(index.find(vec, 4, 14), nullptr);
+    EXPECT_EQ(index.find(vec, -1, 14), nullptr);
+    EXPECT_EQ(index.find(vec, 100, 14), nullptr);
+
+    // appended objects are picked up
+    vec.push_back(new id_obj{21});
+    EXPECT_EQ(index.find(vec, 21, 22), vec[5]);
+    EXPECT_EQ(index.find(vec, 2, 22), vec[0]);
+
+    // and removed ones are dropped
+    delete vec[1];
+    vec.erase(vec.begin() + 1);
+    EXPECT_EQ(index.find(vec, 3, 22), nullptr);
+    EXPECT_EQ(index.find(vec, 8, 22), vec[2]);
+
+    // sparse ids still work through the binary search fallback
+    vec.push_back(new id_obj{1000000});
+    EXPECT_EQ(index.find(vec, 1000000, 1000001), vec.back());
+    EXPECT_EQ(index.find(vec, 13, 1000001), vec[3]);
+
+    for (auto obj : vec)
+        delete obj;
+}
@@ -0,0 +1,54 @@
+#include "Bench.h"
+#include "RemoteClient.h"
+
+#include "CoreProtocol.pb.h"
+
+#include <vector>
+
+using namespace DFHack;
+using namespace dfproto;
+
+static void make_notification(CoreTextNotification &msg, int fragments) {
+    msg.Clear();
+    for (int i = 0; i < fragments; i++) {
+        auto frag = msg.add_fragments();
+        frag->set_text("  granite                              1234\n");
+        frag->set_color(CoreTextFragment::Color(i % 16));
+    }
+}
+
+// Encodes a message into a header + payload frame the way sendRemoteMessage does.
+static size_t encode_frame(std::vector<uint8_t> &buf, int16_t id, const CoreTextNotification &msg) {
+    int size = msg.ByteSize();
+    buf.resize(size + sizeof(RPCMessageHeader));
+    auto hdr = (RPCMessageHeader*)buf.data();
+    hdr->id = id;
+    hdr->size = size;
+    msg.SerializeWithCachedSizesToArray(buf.data() + sizeof(RPCMessageHeader));
+    return buf.size();
+}
+
+DFHACK_BENCH(RPC, encode_text_notification) {
+    CoreTextNotification msg;
+    make_notification(msg, 256);
+    std::vector<uint8_t> buf;
+    size_t bytes = 0;
+    while (state.next())
+        bytes = encode_frame(buf, RPC_REPLY_TEXT, msg);
+    state.set_bytes_per_op(bytes);
+}
+
+DFHACK_BENCH(RPC, decode_text_notification) {
+    CoreTextNotification msg;
+    make_notification(msg, 256);
+    std::vector<uint8_t> buf;
+    encode_frame(buf, RPC_REPLY_TEXT, msg);
+
+    CoreTextNotification out;
+    while (state.next()) {
+        auto hdr = (const RPCMessageHeader*)buf.data();
+        out.ParseFromArray(buf.data() + sizeof(RPCMessageHeader), hdr->size);
+        Bench::do_not_optimize(out.fragments_size());
+    }
+    state.set_bytes_per_op(buf.size());
+}
@@ -55,6 +55,8 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include <memory>
 
+#include <zlib.h>
+
 #include "json/json.h"
 
 using namespace DFHack;
@@ -90,6 +92,7 @@ RemoteClient::RemoteClient(color_ostream *default_output)
     : p_default_output(default_output)
 {
     active = false;
+    version = 0;
     socket = new CActiveSocket();
     suspend_ready = false;
 
@@ -188,7 +191,7 @@ bool RemoteClient::connect(int port)
 
     RPCHandshakeHeader header;
     memcpy(header.magic, RPCHandshakeHeader::REQUEST_MAGIC, sizeof(header.magic));
-    header.version = 1;
+    header.version = RPCHandshakeHeader::MAX_VERSION;
 
     if (socket->Send((uint8*)&header, sizeof(header)) != sizeof(header))
     {
@@ -205,13 +208,15 @@ bool RemoteClient::connect(int port)
     }
 
     if (memcmp(header.magic, RPCHandshakeHeader::RESPONSE_MAGIC, sizeof(header.magic)) ||
-        header.version != 1)
+        header.version < 1 || header.version > RPCHandshakeHeader::MAX_VERSION)
     {
         default_output().printerr("Invalid handshake response.\n");
         socket->Close();
         return active = false;
     }
 
+    version = header.version;
+
     bind_call.name = "BindMethod";
     bind_call.p_client = this;
     bind_call.id = 0;
@@ -281,6 +286,29 @@ command_result RemoteClient::run_command(color_ostream &out, const std::string &
     return runcmd_call(out);
 }
 
+command_result RemoteClient::send_command(color_ostream &out, const std::string &cmd,
+                                          const std::vector<std::string> &args)
+{
+    if (!active || !socket->IsSocketValid())
+    {
+        out.printerr("In RunCommand: client connection not valid.\n");
+        return CR_FAILURE;
+    }
+
+    runcmd_call.reset();
+
+    runcmd_call.in()->set_command(cmd);
+    for (size_t i = 0; i < args.size(); i++)
+        runcmd_call.in()->add_arguments(args[i]);
+
+    return runcmd_call.send(out, runcmd_call.in());
+}
+
+command_result RemoteClient::receive_command(color_ostream &out)
+{
+    return runcmd_call.receive(out, runcmd_call.out());
+}
+
 int RemoteClient::suspend_game()
 {
     if (!active)
@@ -369,6 +397,14 @@ bool sendRemoteMessage(CSimpleSocket *socket, int16_t id, const MessageLite *msg
 
 command_result RemoteFunctionBase::execute(color_ostream &out,
                                            const message_type *input, message_type *output)
+{
+    command_result rv = send(out, input);
+    if (rv != CR_OK)
+        return rv;
+    return receive(out, output);
+}
+
+command_result RemoteFunctionBase::send(color_ostream &out, const message_type *input)
 {
     if (!isValid())
     {
@@ -400,6 +436,11 @@ command_result RemoteFunctionBase::execute(color_ostream &out,
         return CR_LINK_FAILURE;
     }
 
+    return CR_OK;
+}
+
+command_result RemoteFunctionBase::receive(color_ostream &out, message_type *output)
+{
     color_ostream_proxy text_decoder(out);
     CoreTextNotification text_data;
 
@@ -449,6 +490,33 @@ command_result RemoteFunctionBase::execute(color_ostream &out,
             delete[] buf;
             return CR_OK;
 
+        case RPC_REPLY_RESULT_COMPRESSED:
+        {
+            int32_t raw_size = -1;
+            if (header.size >= (int)sizeof(raw_size))
+                memcpy(&raw_size, buf, sizeof(raw_size));
+
+            std::unique_ptr<uint8_t[]> raw;
+            uLongf got = uLongf(raw_size);
+            bool ok = raw_size >= 0 && raw_size <= RPCMessageHeader::MAX_MESSAGE_SIZE;
+            if (ok)
+            {
+                raw.reset(new uint8_t[raw_size]);
+                ok = uncompress(raw.get(), &got, buf + sizeof(raw_size),
+                                uLong(header.size - sizeof(raw_size))) == Z_OK &&
+                     got == uLongf(raw_size);
+            }
+            delete[] buf;
+
+            if (!ok || !output->ParseFromArray(raw.get(), raw_size))
+            {
+                out.printerr("In call to %s::%s: error parsing received compressed result.\n",
+                             this->plugin.c_str(), this->name.c_str());
+                return CR_LINK_FAILURE;
+            }
+            return CR_OK;
+        }
+
         case RPC_REPLY_TEXT:
             text_data.Clear();
             if (text_data.ParseFromArray(buf, header.size))
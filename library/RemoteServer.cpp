@@ -60,19 +60,56 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <memory>
 #include <thread>
 
+#include <zlib.h>
+
+#include <google/protobuf/io/coded_stream.h>
+
 #include "json/json.h"
 
 using namespace std;
 using namespace DFHack;
 
-using dfproto::CoreTextNotification;
-using dfproto::CoreTextFragment;
 using google::protobuf::MessageLite;
+using google::protobuf::io::CodedOutputStream;
 
 bool readFullBuffer(CSimpleSocket *socket, void *buf, int size);
 bool sendRemoteMessage(CSimpleSocket *socket, int16_t id,
                         const ::google::protobuf::MessageLite *msg, bool size_ready);
 
+/*
+ * Sends msg as RPC_REPLY_RESULT_COMPRESSED. Returns false without sending
+ * anything if compression doesn't make the message smaller. *io_error is
+ * set if sending the compressed message failed.
+ */
+static bool sendCompressedResult(CSimpleSocket *socket, const MessageLite *msg,
+                                 int size, bool *io_error)
+{
+    *io_error = false;
+
+    std::string raw;
+    if (!msg->SerializeToString(&raw) || int(raw.size()) != size)
+        return false;
+
+    uLongf packed_size = compressBound(uLong(raw.size()));
+    const int prefix = sizeof(RPCMessageHeader) + sizeof(int32_t);
+    std::unique_ptr<uint8_t[]> data(new uint8_t[prefix + packed_size]);
+
+    if (compress2(data.get() + prefix, &packed_size, (const Bytef*)raw.data(),
+                  uLong(raw.size()), Z_BEST_SPEED) != Z_OK ||
+        packed_size + sizeof(int32_t) >= raw.size())
+        return false;
+
+    RPCMessageHeader *hdr = (RPCMessageHeader*)data.get();
+    hdr->id = RPC_REPLY_RESULT_COMPRESSED;
+    hdr->size = int32_t(sizeof(int32_t) + packed_size);
+    int32_t raw_size = size;
+    memcpy(data.get() + sizeof(RPCMessageHeader), &raw_size, sizeof(raw_size));
+
+    int fullsz = prefix + int(packed_size);
+    *io_error = socket->Send(data.get(), fullsz) != fullsz;
+    return true;
+}
+
 std::mutex ServerMain::access_{};
 bool ServerMain::blocked_{};
 
@@ -157,6 +194,7 @@ ServerConnection::ServerConnection(CActiveSocket *socket)
     : socket(socket), stream(this)
 {
     in_error = false;
+    version = 1;
 
     core_service = new CoreService();
     core_service->finalize(this, &functions);
@@ -208,30 +246,75 @@ ServerFunctionBase *ServerConnection::findFunction(color_ostream &out, const std
     return svc->getFunction(name);
 }
 
-void ServerConnection::connection_ostream::flush_proxy()
+/*
+ * Encodes the buffered text as a CoreTextNotification straight from the
+ * stream's span buffer, instead of copying every fragment into a message
+ * object first. Must produce exactly what CoreProtocol.proto describes:
+ *
+ *   fragments (1, length-delimited) {
+ *       text (1, length-delimited)
+ *       color (2, varint; omitted for COLOR_RESET)
+ *   }
+ */
+static void encodeTextNotification(std::vector<uint8_t> &frame, const buffered_color_ostream &stream)
 {
-    if (owner->in_error)
+    const uint32_t FRAGMENTS_TAG = (1 << 3) | 2;
+    const uint32_t TEXT_TAG = (1 << 3) | 2;
+    const uint32_t COLOR_TAG = (2 << 3) | 0;
+
+    auto fragment_size = [](const buffered_color_ostream::span_type &span) {
+        size_t size = 1 + CodedOutputStream::VarintSize32(uint32_t(span.length)) + span.length;
+        if (span.color >= 0)
+            size += 1 + CodedOutputStream::VarintSize32(uint32_t(span.color));
+        return size;
+    };
+
+    size_t size = 0;
+    for (auto &span : stream.spans())
     {
-        buffer.clear();
-        return;
+        size_t frag_size = fragment_size(span);
+        size += 1 + CodedOutputStream::VarintSize32(uint32_t(frag_size)) + frag_size;
     }
 
-    if (buffer.empty())
-        return;
+    frame.resize(sizeof(RPCMessageHeader) + size);
+    RPCMessageHeader *hdr = (RPCMessageHeader*)frame.data();
+    hdr->id = RPC_REPLY_TEXT;
+    hdr->size = int32_t(size);
 
-    CoreTextNotification msg;
+    uint8_t *pos = frame.data() + sizeof(RPCMessageHeader);
+    const char *text = stream.text().data();
+    for (auto &span : stream.spans())
+    {
+        pos = CodedOutputStream::WriteTagToArray(FRAGMENTS_TAG, pos);
+        pos = CodedOutputStream::WriteVarint32ToArray(uint32_t(fragment_size(span)), pos);
+        pos = CodedOutputStream::WriteTagToArray(TEXT_TAG, pos);
+        pos = CodedOutputStream::WriteVarint32ToArray(uint32_t(span.length), pos);
+        pos = CodedOutputStream::WriteRawToArray(text + span.offset, int(span.length), pos);
+        if (span.color >= 0)
+        {
+            pos = CodedOutputStream::WriteTagToArray(COLOR_TAG, pos);
+            pos = CodedOutputStream::WriteVarint32ToArray(uint32_t(span.color), pos);
+        }
+    }
+    assert(pos == frame.data() + frame.size()); (void)pos;
+}
 
-    for (auto it = buffer.begin(); it != buffer.end(); ++it)
+void ServerConnection::connection_ostream::flush_proxy()
+{
+    if (owner->in_error)
     {
-        auto frag = msg.add_fragments();
-        frag->set_text(it->second);
-        if (it->first >= 0)
-            frag->set_color(CoreTextFragment::Color(it->first));
+        clear();
+        return;
     }
 
-    buffer.clear();
+    if (empty())
+        return;
+
+    encodeTextNotification(frame, *this);
+    clear();
 
-    if (!sendRemoteMessage(owner->socket, RPC_REPLY_TEXT, &msg, false))
+    int fullsz = int(frame.size());
+    if (owner->socket->Send(frame.data(), fullsz) != fullsz)
     {
         owner->in_error = true;
         Core::printerr("Error writing text into client socket.\n");
@@ -271,7 +354,9 @@ void ServerConnection::threadFn()
         }
 
         memcpy(header.magic, RPCHandshakeHeader::RESPONSE_MAGIC, sizeof(header.magic));
-        header.version = 1;
+        version = header.version < RPCHandshakeHeader::MAX_VERSION ?
+            header.version : RPCHandshakeHeader::MAX_VERSION;
+        header.version = version;
 
         if (socket->Send((uint8*)&header, sizeof(header)) != sizeof(header))
         {
@@ -373,7 +458,12 @@ void ServerConnection::threadFn()
 
         if (res == CR_OK && reply)
         {
-            if (!sendRemoteMessage(socket, RPC_REPLY_RESULT, reply, true))
+            bool io_error = false;
+            bool compressed = version >= 2 &&
+                out_size >= RPCMessageHeader::COMPRESS_THRESHOLD &&
+                sendCompressedResult(socket, reply, out_size, &io_error);
+
+            if (io_error || (!compressed && !sendRemoteMessage(socket, RPC_REPLY_RESULT, reply, true)))
             {
                 out.printerr("In RPC server: I/O error in send result.\n");
                 break;
@@ -85,7 +85,9 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <cstdlib>
 #include <sstream>
 
+#include <deque>
 #include <memory>
+#include <unordered_map>
 
 using namespace DFHack;
 using namespace df::enums;
@@ -567,10 +569,84 @@ static command_result ListMaterials(color_ostream &stream,
     return out->value_size() ? CR_OK : CR_NOT_FOUND;
 }
 
+/*
+ * Change tracking for ListUnits delta mode. Each delta reply stores a hash of
+ * every unit description it covered under a new token, and a request quoting
+ * that token only gets the units whose hash differs. Only the most recent
+ * snapshots are kept; an expired token gets a full reply. RPC calls run with
+ * the core suspended, so no extra locking is needed.
+ */
+struct UnitSnapshot {
+    int32_t token;
+    std::string filter; // the request without since_token
+    std::unordered_map<int32_t, size_t> hashes;
+};
+
+static std::deque<UnitSnapshot> unit_snapshots;
+static int32_t next_unit_token = 1;
+static const size_t MAX_UNIT_SNAPSHOTS = 16;
+
+static command_result ListUnitChanges(const ListUnitsIn *in, ListUnitsOut *out,
+                                      const std::vector<df::unit*> &units,
+                                      const BasicUnitInfoMask *mask)
+{
+    ListUnitsIn filter_msg(*in);
+    filter_msg.clear_since_token();
+
+    UnitSnapshot next;
+    next.token = next_unit_token;
+    next_unit_token = next_unit_token < INT32_MAX ? next_unit_token + 1 : 1;
+    filter_msg.SerializeToString(&next.filter);
+
+    const UnitSnapshot *prev = NULL;
+    for (auto &snap : unit_snapshots)
+        if (snap.token == in->since_token() && snap.filter == next.filter)
+            prev = &snap;
+
+    std::hash<std::string> hasher;
+    BasicUnitInfo info;
+    std::string bytes;
+
+    for (auto unit : units)
+    {
+        info.Clear();
+        describeUnit(&info, unit, mask);
+        bytes.clear();
+        info.SerializeToString(&bytes);
+        size_t hash = hasher(bytes);
+        next.hashes[unit->id] = hash;
+
+        if (prev)
+        {
+            auto it = prev->hashes.find(unit->id);
+            if (it != prev->hashes.end() && it->second == hash)
+                continue;
+        }
+        out->add_value()->Swap(&info);
+    }
+
+    if (prev)
+    {
+        for (auto &entry : prev->hashes)
+            if (!next.hashes.count(entry.first))
+                out->add_removed_id(entry.first);
+    }
+    else
+        out->set_full_update(true);
+
+    out->set_change_token(next.token);
+    unit_snapshots.push_back(std::move(next));
+    if (unit_snapshots.size() > MAX_UNIT_SNAPSHOTS)
+        unit_snapshots.pop_front();
+
+    return CR_OK;
+}
+
 static command_result ListUnits(color_ostream &stream,
                                 const ListUnitsIn *in, ListUnitsOut *out)
 {
     auto mask = in->has_mask() ? &in->mask() : NULL;
+    std::vector<df::unit*> units;
 
     if (in->id_list_size() > 0)
     {
@@ -578,7 +654,7 @@ static command_result ListUnits(color_ostream &stream,
         {
             auto unit = df::unit::find(in->id_list(i));
             if (unit)
-                describeUnit(out->add_value(), unit, mask);
+                units.push_back(unit);
         }
     }
 
@@ -603,10 +679,16 @@ static command_result ListUnits(color_ostream &stream,
             if (in->has_sane() && Units::isSane(unit) != in->sane())
                 continue;
 
-            describeUnit(out->add_value(), unit, mask);
+            units.push_back(unit);
         }
     }
 
+    if (in->has_since_token())
+        return ListUnitChanges(in, out, units, mask);
+
+    for (auto unit : units)
+        describeUnit(out->add_value(), unit, mask);
+
     return out->value_size() ? CR_OK : CR_NOT_FOUND;
 }
 
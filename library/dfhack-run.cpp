@@ -46,24 +46,107 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <stdint.h>
 
 #include "Console.h"
+#include "MiscUtils.h"
 #include "RemoteClient.h"
 
 #include <cstdio>
 #include <cstdlib>
 #include <sstream>
 
+#include <deque>
 #include <memory>
 
 using namespace DFHack;
 using namespace dfproto;
 
+// Number of commands sent ahead of the one whose output is being read.
+// Requests are small, so this many always fit into the socket buffers.
+static const size_t BATCH_PIPELINE_DEPTH = 8;
+
+struct batch_command {
+    int line;
+    std::string text;
+};
+
+// Reads commands one per line, skipping blank lines and # comments, and runs
+// them over the open connection. Returns the process exit code.
+static int run_batch(RemoteClient &client, Console &out, std::istream &in, bool keep_suspended)
+{
+    if (keep_suspended && client.suspend_game() <= 0)
+    {
+        out.printerr("dfhack-run: could not suspend the core.\n");
+        return 3;
+    }
+
+    std::deque<batch_command> in_flight;
+    std::string text;
+    int line = 0;
+    bool eof = false;
+    bool link_ok = true;
+    int failures = 0;
+
+    while (link_ok && (!eof || !in_flight.empty()))
+    {
+        // Keep the pipeline full
+        while (!eof && in_flight.size() < BATCH_PIPELINE_DEPTH)
+        {
+            if (!std::getline(in, text))
+            {
+                eof = true;
+                break;
+            }
+            ++line;
+
+            std::vector<std::string> parts;
+            tokenize_command_line(text, parts);
+            if (parts.empty() || parts[0][0] == '#')
+                continue;
+
+            std::string cmd = parts[0];
+            parts.erase(parts.begin());
+            if (client.send_command(out, cmd, parts) != CR_OK)
+            {
+                link_ok = false;
+                break;
+            }
+            in_flight.push_back({line, text});
+        }
+
+        if (in_flight.empty())
+            continue;
+
+        command_result rv = client.receive_command(out);
+        batch_command done = in_flight.front();
+        in_flight.pop_front();
+        out.flush();
+
+        if (rv == CR_LINK_FAILURE)
+            link_ok = false;
+        if (rv != CR_OK)
+        {
+            failures++;
+            out.printerr("dfhack-run: line %d: command failed with code %d: %s\n",
+                         done.line, int(rv), done.text.c_str());
+        }
+    }
+
+    if (keep_suspended && link_ok)
+        client.resume_game();
+
+    if (!link_ok)
+        return 2;
+    return failures ? 1 : 0;
+}
+
 int main (int argc, char *argv[])
 {
     Console out;
 
     if (argc <= 1)
     {
-        fprintf(stderr, "Usage: dfhack-run <command> [args...]\n\n");
+        fprintf(stderr, "Usage: dfhack-run <command> [args...]\n"
+                        "       dfhack-run --lua <module> <function> [args...]\n"
+                        "       dfhack-run --batch [--keep-suspended] [<file>]\n\n");
         fprintf(stderr, "Note: this command does not start DFHack; it is intended to connect\n"
                         "to a running DFHack instance. If you were trying to start DFHack, run\n"
 #ifdef _WIN32
@@ -89,7 +172,44 @@ int main (int argc, char *argv[])
 
     command_result rv;
 
-    if (strcmp(argv[1], "--lua") == 0)
+    if (strcmp(argv[1], "--batch") == 0)
+    {
+        bool keep_suspended = false;
+        const char *path = NULL;
+        for (int i = 2; i < argc; i++)
+        {
+            if (strcmp(argv[i], "--keep-suspended") == 0)
+                keep_suspended = true;
+            else if (!path)
+                path = argv[i];
+            else
+            {
+                out.shutdown();
+                fprintf(stderr, "Usage: dfhack-run --batch [--keep-suspended] [<file>]\n");
+                return 2;
+            }
+        }
+
+        int result;
+        if (path && strcmp(path, "-") != 0)
+        {
+            std::ifstream file(path);
+            if (!file)
+            {
+                out.shutdown();
+                fprintf(stderr, "Cannot open batch file: %s\n", path);
+                return 2;
+            }
+            result = run_batch(client, out, file, keep_suspended);
+        }
+        else
+            result = run_batch(client, out, std::cin, keep_suspended);
+
+        out.flush();
+        out.shutdown();
+        return result;
+    }
+    else if (strcmp(argv[1], "--lua") == 0)
     {
         if (argc <= 3)
         {
@@ -30,6 +30,8 @@ distribution.
 #include <assert.h>
 #include <iostream>
 #include <string>
+#include <string_view>
+#include <vector>
 #include <stdarg.h>
 #include <sstream>
 
@@ -95,7 +97,7 @@ namespace  DFHack
         virtual void begin_batch();
         virtual void end_batch();
 
-        virtual void add_text(color_value color, const std::string &text) = 0;
+        virtual void add_text(color_value color, std::string_view text) = 0;
 
         virtual void flush_proxy() {};
 
@@ -136,28 +138,54 @@ namespace  DFHack
         std::ostream &out;
 
     protected:
-        virtual void add_text(color_value color, const std::string &text);
+        virtual void add_text(color_value color, std::string_view text);
         virtual void flush_proxy();
 
     public:
         color_ostream_wrapper(std::ostream &os) : out(os) {}
     };
 
+    /*
+     * Collects output in memory. All text goes into one growing string, and
+     * each run of same-colored text is recorded as a span pointing into it, so
+     * buffering a line costs no allocations once the buffers have grown.
+     */
     class DFHACK_EXPORT buffered_color_ostream : public color_ostream
     {
     protected:
-        virtual void add_text(color_value color, const std::string &text);
+        virtual void add_text(color_value color, std::string_view text);
 
     public:
-        typedef std::pair<color_value,std::string> fragment_type;
+        struct span_type {
+            color_value color;
+            size_t offset;
+            size_t length;
+        };
+        typedef std::pair<color_value,std::string_view> fragment_type;
 
         buffered_color_ostream() {}
         ~buffered_color_ostream() {}
 
-        const std::list<fragment_type> &fragments() { return buffer; }
+        bool empty() const { return spans_buffer.empty(); }
+
+        /// All buffered text; the spans index into this string
+        const std::string &text() const { return text_buffer; }
+        const std::vector<span_type> &spans() const { return spans_buffer; }
+        std::string_view text(const span_type &span) const {
+            return std::string_view(text_buffer).substr(span.offset, span.length);
+        }
+
+        /// Colored fragments as views into text(); valid until the next write
+        std::vector<fragment_type> fragments() const;
+
+        /// Discards the buffered text, keeping the memory for reuse
+        void clear();
+        /// Moves the buffered text out without copying it
+        void take(std::string &text, std::vector<span_type> &spans);
 
     protected:
-        std::list<fragment_type> buffer;
+        std::string text_buffer;
+        std::vector<span_type> spans_buffer;
     };
 
     class DFHACK_EXPORT color_ostream_proxy : public buffered_color_ostream
@@ -125,7 +125,7 @@ namespace  DFHack
     {
     protected:
         virtual void begin_batch();
-        virtual void add_text(color_value color, const std::string &text);
+        virtual void add_text(color_value color, std::string_view text);
         virtual void end_batch();
 
         virtual void flush_proxy();
@@ -26,6 +26,8 @@ redistribute it freely, subject to the following restrictions:
 #include "ColorText.h"
 
 #include <atomic>
+#include <chrono>
+#include <string>
 #include "Core.h"
 
 namespace DFHack {
@@ -180,6 +182,16 @@ public:
         ~ostream_proxy_prefix() {
             flush();
         }
+    protected:
+        //! Hands the message to the async backend when it is active
+        virtual void flush_proxy();
+    private:
+        std::chrono::system_clock::time_point time_;
+        //! plugin and category header parts; only used in async mode
+        std::string names_;
+        DebugCategory::level level_;
+        bool async_;
+        bool continued_ = false;
     };
 
     /*!
@@ -26,7 +26,9 @@
 #include "Export.h"
 #include "Signal.hpp"
 
+#include <cstdint>
 #include <mutex>
+#include <string>
 #include <vector>
 
 namespace DFHack {
@@ -81,6 +83,18 @@ public:
         bool category = false;
     };
 
+    /*!
+     * Asynchronous log backend configuration, controlled via the debug plugin.
+     * When enabled, messages printed to the console by the debug macros are
+     * queued in a lock-free buffer and written by a background thread.
+     */
+    struct AsyncConfig {
+        bool enabled = false;
+        bool console = true;                    // write messages to the console
+        std::string file;                       // also append to this file if set
+        size_t max_file_size = 16 * 1024 * 1024; // rotate to <file>.1 when reached
+    };
+
     //! type to help access signal features like Connection and BlockGuard
     using categorySignal_t = Signal<void (signalType, DebugCategory&)>;
 
@@ -110,6 +124,17 @@ public:
         headerConfig = config;
     }
 
+    //! Current async backend configuration
+    AsyncConfig getAsyncConfig() const;
+    /*!
+     * Start, stop, or reconfigure the async backend. Messages already queued
+     * are written out before the new configuration takes effect.
+     * \return false if the log file could not be opened
+     */
+    bool setAsyncConfig(const AsyncConfig &config);
+    //! Number of messages dropped since startup because the queue was full
+    uint64_t getAsyncDropped() const;
+
     //! Prevent copies
     DebugManager(const DebugManager&) = delete;
     //! Prevent copies
@@ -0,0 +1,138 @@
+/*
+https://github.com/peterix/dfhack
+Copyright (c) 2009-2012 Petr Mrázek (peterix@gmail.com)
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use, copy, modify, merge, publish,
+distribute, sell, and to alter it and redistribute it freely, subject to
+the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must
+not claim that you wrote the original software. If you use this
+software in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+#pragma once
+
+#include "Export.h"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace DFHack
+{
+    /*
+     * Native support for the help database in helpdb.lua.
+     *
+     * The parse cache remembers the help text parsed out of each doc or script
+     * file, keyed by the file's path, mtime, and size, and is saved to disk so
+     * that only changed files have to be parsed again after a restart.
+     *
+     * The search index holds every entry name with its entry types and tags,
+     * presorted into the order search results are returned in, so that
+     * searches don't need to go through the Lua tables at all.
+     */
+    class DFHACK_EXPORT HelpIndex
+    {
+    public:
+        // the text is in the DF encoding, as helpdb.lua keeps it; the cache
+        // file holds it as UTF-8
+        struct TextEntry
+        {
+            std::string short_help;
+            std::string long_help;
+            std::vector<std::string> tags;
+        };
+
+        // returns the cached entry for the file at path, or NULL if it has
+        // changed (or gone away) since it was cached. on a miss, the file's
+        // current stamp is remembered for the next setCached() call.
+        const TextEntry *getCached(const std::string &path);
+        // caches the entry parsed from the file at path, as of when
+        // getCached() last missed for it
+        void setCached(const std::string &path, TextEntry entry);
+
+        // replaces the cache with the contents of the given file. if the file
+        // was saved with a different version string, it is ignored.
+        bool loadCache(const std::string &fname, const std::string &version);
+        // writes the cache out if it has changed since it was loaded. records
+        // for files that have changed or gone away are dropped first.
+        bool saveCache(const std::string &fname, const std::string &version);
+        size_t cacheSize() const { return cache.size(); }
+
+        // every element of a non-empty list must be matched by one of its
+        // values (i.e. the lists are ANDed and the values in them are ORed)
+        struct Filter
+        {
+            std::vector<std::string> str;
+            std::vector<std::string> tag;
+            std::vector<std::string> entry_type;
+        };
+
+        void clearEntries();
+        void addEntry(const std::string &name, const std::vector<std::string> &entry_types,
+            const std::vector<std::string> &tags);
+        // sorts the entries; call after the last addEntry()
+        void finalizeEntries();
+        size_t numEntries() const { return entries.size(); }
+
+        // returns the names of the entries that match all of the include
+        // filters and not all of the exclude filters (an empty exclude list
+        // excludes nothing), sorted by basename
+        std::vector<const std::string *> search(const std::vector<Filter> &include,
+            const std::vector<Filter> &exclude) const;
+
+        // the search result order: by last path component, then by parent
+        // path components, with something sorting before nothing (e.g.
+        // gui/autofarm comes immediately before autofarm)
+        static bool basenameLess(const std::string &a, const std::string &b);
+
+    private:
+        struct Stamp
+        {
+            int64_t mtime = -1;
+            int64_t size = -1;
+            bool operator==(const Stamp &other) const {
+                return mtime == other.mtime && size == other.size;
+            }
+        };
+        static bool getStamp(const std::string &path, Stamp &stamp);
+
+        struct CacheRecord
+        {
+            Stamp stamp;
+            TextEntry entry;
+        };
+        std::unordered_map<std::string, CacheRecord> cache;
+        // stamps taken by getCached() misses, waiting for setCached()
+        std::unordered_map<std::string, Stamp> pending;
+        bool dirty = false;
+
+        struct Entry
+        {
+            std::string name;
+            // sorted ids into labels
+            std::vector<uint16_t> entry_types;
+            std::vector<uint16_t> tags;
+        };
+        std::vector<Entry> entries;
+        // entry type and tag names; the same id space is used for both
+        std::unordered_map<std::string, uint16_t> labels;
+
+        std::vector<uint16_t> internLabels(const std::vector<std::string> &names);
+        bool matches(const Entry &entry, const Filter &filter) const;
+        bool matchesAll(const Entry &entry, const std::vector<Filter> &filters) const;
+    };
+}
@@ -283,6 +283,110 @@ CT *binsearch_in_vector(const std::vector<CT*> &vec, FT CT::*field, FT value)
     return idx < 0 ? NULL : vec[idx];
 }
 
+/*
+ * Dense id -> element table over a vector of objects sorted by id, such as
+ * world->units.all. Lookups are O(1) without touching the objects in the
+ * vector, except for one read to verify the hit.
+ *
+ * The table is rebuilt lazily when the vector is resized or reallocated or
+ * next_id changes; if only new objects were appended, just the tail is
+ * indexed. Misses, stale entries, and id ranges too sparse for a dense
+ * table fall back to binary search, so results always match
+ * binsearch_in_vector.
+ */
+template <typename CT>
+class id_index
+{
+    const std::vector<CT*> *vec = NULL;
+    const void *data = NULL;
+    size_t size = 0;
+    CT *back = NULL;
+    int32_t next_id = -1;
+
+    bool dense = false;
+    int32_t base_id = 0;
+    std::vector<int32_t> table;
+
+    static const size_t MAX_SPARSITY = 4;
+
+    void rebuild(const std::vector<CT*> &v)
+    {
+        table.clear();
+        dense = false;
+        if (v.empty())
+            return;
+
+        base_id = v.front()->id;
+        int64_t range = int64_t(v.back()->id) - base_id + 1;
+        if (range <= 0 || size_t(range) > v.size() * MAX_SPARSITY + 1024)
+            return;
+
+        table.assign(size_t(range), -1);
+        for (size_t i = 0; i < v.size(); i++)
+            set_entry(v[i]->id, i);
+        dense = true;
+    }
+
+    bool append(const std::vector<CT*> &v)
+    {
+        // appended objects have ids above everything already in the table
+        if (!dense || v.size() <= size || v[size-1] != back)
+            return false;
+
+        int64_t range = int64_t(v.back()->id) - base_id + 1;
+        if (size_t(range) > v.size() * MAX_SPARSITY + 1024)
+            return false;
+
+        table.resize(size_t(range), -1);
+        for (size_t i = size; i < v.size(); i++)
+            set_entry(v[i]->id, i);
+        return true;
+    }
+
+    void set_entry(int32_t id, size_t idx)
+    {
+        size_t slot = size_t(int64_t(id) - base_id);
+        if (slot < table.size())
+            table[slot] = int32_t(idx);
+    }
+
+public:
+    // next_id may be -1 if the corresponding global is unavailable
+    CT *find(const std::vector<CT*> &v, int32_t id, int32_t cur_next_id = -1)
+    {
+        if (&v != vec || v.data() != data || v.size() != size ||
+            (!v.empty() && v.back() != back) || cur_next_id != next_id)
+        {
+            if (&v != vec || size == 0 || !append(v))
+                rebuild(v);
+
+            vec = &v;
+            data = v.data();
+            size = v.size();
+            back = v.empty() ? NULL : v.back();
+            next_id = cur_next_id;
+        }
+
+        if (dense)
+        {
+            size_t slot = size_t(int64_t(id) - base_id);
+            if (slot < table.size())
+            {
+                int32_t idx = table[slot];
+                if (idx >= 0 && size_t(idx) < v.size() && v[idx]->id == id)
+                    return v[idx];
+            }
+        }
+
+        return binsearch_in_vector(v, &CT::id, id);
+    }
+
+    void clear()
+    {
+        *this = id_index();
+    }
+};
+
 /*
  * List
  */
@@ -401,6 +505,11 @@ DFHACK_EXPORT bool split_string(std::vector<std::string> *out,
                                 bool squash_empty = false);
 DFHACK_EXPORT std::string join_strings(const std::string &separator, const std::vector<std::string> &items);
 
+// Splits a console command line into words. Double quotes group words and
+// backslash escapes inside quotes; a leading ':' passes everything after the
+// command as a single argument.
+DFHACK_EXPORT void tokenize_command_line(const std::string &input, std::vector<std::string> &output);
+
 template<typename T>
 inline std::string join_strings(const std::string &separator, T &items) {
     std::stringstream ss;
@@ -43,7 +43,8 @@ namespace  DFHack
         RPC_REPLY_RESULT = -1,
         RPC_REPLY_FAIL = -2,
         RPC_REPLY_TEXT = -3,
-        RPC_REQUEST_QUIT = -4
+        RPC_REQUEST_QUIT = -4,
+        RPC_REPLY_RESULT_COMPRESSED = -5
     };
 
     struct RPCHandshakeHeader {
@@ -52,10 +53,15 @@ namespace  DFHack
 
         static const char REQUEST_MAGIC[9];
         static const char RESPONSE_MAGIC[9];
+
+        // Version 2 adds RPC_REPLY_RESULT_COMPRESSED
+        static const int MAX_VERSION = 2;
     };
 
     struct RPCMessageHeader {
         static const int MAX_MESSAGE_SIZE = 64*1048576;
+        // Results at least this large are compressed for version 2 clients
+        static const int COMPRESS_THRESHOLD = 16*1024;
 
         int16_t id;
         int32_t size;
@@ -67,7 +73,8 @@ namespace  DFHack
      *
      *   Client initiates connection by sending the handshake
      *   request header. The server responds with the response
-     *   magic. Currently both versions must be 1.
+     *   magic and the lower of the requested version and the highest
+     *   version it supports.
      *
      * 2. Interaction
      *
@@ -89,7 +96,10 @@ namespace  DFHack
      *   responds with zero or more RPC_REPLY_TEXT:CoreTextNotification
      *   messages, followed by RPC_REPLY_RESULT containing the output
      *   of the function if it succeeded, or RPC_REPLY_FAIL with the
-     *   error code if it did not.
+     *   error code if it did not. With protocol version 2, large
+     *   results may instead be sent as RPC_REPLY_RESULT_COMPRESSED,
+     *   whose payload is the uncompressed size as an int32 followed
+     *   by the zlib-compressed protobuf message.
      *
      * 3. Disconnect
      *
@@ -156,6 +166,12 @@ namespace  DFHack
         inline color_ostream &default_ostream();
         command_result execute(color_ostream &out, const message_type *input, message_type *output);
 
+        // execute() split in two, for pipelining calls: the server answers
+        // calls in the order they were sent, so several calls may be sent
+        // before their results are received.
+        command_result send(color_ostream &out, const message_type *input);
+        command_result receive(color_ostream &out, message_type *output);
+
         std::string name, plugin;
         RemoteClient *p_client;
         int16_t id;
@@ -236,13 +252,25 @@ namespace  DFHack
         command_result run_command(color_ostream &out, const std::string &cmd,
                                    const std::vector<std::string> &args);
 
+        // Pipelined version of run_command: each successful send_command
+        // must be matched by a receive_command, which returns the results
+        // in the order the commands were sent. Keep the number of commands
+        // in flight small so that neither side blocks on a full socket.
+        command_result send_command(color_ostream &out, const std::string &cmd,
+                                    const std::vector<std::string> &args);
+        command_result receive_command(color_ostream &out);
+
         // For executing multiple calls in rapid succession.
         // Best used via RemoteSuspender.
         int suspend_game();
         int resume_game();
 
+        // Protocol version agreed on in the handshake
+        int protocol_version() const { return version; }
+
     private:
         bool active, delete_output;
+        int version;
         CActiveSocket *socket;
         color_ostream *p_default_output;
 
@@ -217,6 +217,7 @@ namespace  DFHack
     class ServerConnection {
         class connection_ostream : public buffered_color_ostream {
             ServerConnection *owner;
+            std::vector<uint8_t> frame; // reused between flushes
 
         protected:
             virtual void flush_proxy();
@@ -226,6 +227,7 @@ namespace  DFHack
         };
 
         bool in_error;
+        int version; // protocol version agreed on in the handshake
         CActiveSocket *socket;
         connection_ostream stream;
 
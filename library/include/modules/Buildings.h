@@ -117,6 +117,12 @@ DFHACK_EXPORT bool setOwner(df::building_civzonest *building, df::unit *owner);
  */
 DFHACK_EXPORT std::string getName(df::building* building);
 
+/**
+ * Look up a building by id through a dense id table over world->buildings.all.
+ * Equivalent to df::building::find, but O(1) in the common case.
+ */
+DFHACK_EXPORT df::building *findBuildingByID(int32_t id);
+
 /**
  * Find the building located at the specified tile.
  * Does not work on civzones.
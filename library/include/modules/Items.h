@@ -111,7 +111,7 @@ DFHACK_EXPORT int getSubtypeCount(df::item_type itype);
 // Returns the raw definition for given item type and subtype or NULL.
 DFHACK_EXPORT df::itemdef *getSubtypeDef(df::item_type itype, int subtype);
 
-// Look for a particular item by ID.
+// Look for a particular item by ID. Uses a dense id table over world->items.all.
 DFHACK_EXPORT df::item *findItemByID(int32_t id);
 
 // Retrieve refs
@@ -166,11 +166,13 @@ DFHACK_EXPORT bool remove(df::item *item, bool no_uncat = false);
 // Detaches the item from its current location and turns it into a projectile.
 DFHACK_EXPORT df::proj_itemst *makeProjectile(df::item *item);
 
-// Gets value of base-quality item with specified type and material.
+// Gets value of base-quality item with specified type and material. Results are cached until the world changes.
 DFHACK_EXPORT int getItemBaseValue(int16_t item_type, int16_t item_subtype, int16_t mat_type, int32_t mat_subtype);
 
 // Gets the value of a specific item, taking into account civ values and trade agreements if a caravan is given.
 DFHACK_EXPORT int getValue(df::item *item, df::caravan_state *caravan = NULL);
+// Gets the values of a list of items, sharing the caravan lookups across the whole batch.
+DFHACK_EXPORT std::vector<int> getValues(const std::vector<df::item *> &items, df::caravan_state *caravan = NULL);
 
 DFHACK_EXPORT bool createItem(std::vector<df::item *> &out_items, df::unit *creator, df::item_type type,
     int16_t item_subtype, int16_t mat_type, int32_t mat_index, bool no_floor = false);
@@ -43,6 +43,10 @@ distribution.
 #include "df/tile_dig_designation.h"
 #include "df/tiletype.h"
 
+#include <array>
+#include <functional>
+#include <vector>
+
 namespace df {
     struct block_square_event;
     struct block_square_event_designation_priorityst;
@@ -399,6 +403,151 @@ DFHACK_EXPORT bool removeTileAquifer(int32_t x, int32_t y, int32_t z);
 inline bool removeTileAquifer(df::coord pos) { return removeTileAquifer(pos.x, pos.y, pos.z); }
 DFHACK_EXPORT int removeAreaAquifer(df::coord pos1, df::coord pos2,
     std::function<bool(df::coord, df::map_block *)> filter = [](df::coord pos, df::map_block *block) { return true; });
+
+/*
+ * FLOOD FILL
+ */
+
+// Flat index over all map blocks, so per-block data can live in plain vectors.
+struct BlockGrid {
+    int32_t x_blocks = 0, y_blocks = 0, z_levels = 0;
+
+    BlockGrid() {}
+    BlockGrid(int32_t x_blocks, int32_t y_blocks, int32_t z_levels)
+        : x_blocks(x_blocks), y_blocks(y_blocks), z_levels(z_levels) {}
+
+    // size the grid to the current map
+    void reset() { getSize(x_blocks, y_blocks, z_levels); }
+
+    size_t size() const { return size_t(x_blocks) * y_blocks * z_levels; }
+    bool contains(const df::coord &pos) const {
+        return pos.x >= 0 && pos.y >= 0 && pos.z >= 0 &&
+            pos.x < x_blocks * 16 && pos.y < y_blocks * 16 && pos.z < z_levels;
+    }
+    // pos must be contained in the grid
+    size_t index(const df::coord &pos) const {
+        return (size_t(pos.z) * y_blocks + (pos.y >> 4)) * x_blocks + (pos.x >> 4);
+    }
+    df::map_block *block(size_t idx) const {
+        return getBlock(idx % x_blocks, (idx / x_blocks) % y_blocks, idx / (size_t(x_blocks) * y_blocks));
+    }
+    bool operator==(const BlockGrid &other) const {
+        return x_blocks == other.x_blocks && y_blocks == other.y_blocks && z_levels == other.z_levels;
+    }
+};
+
+// One bit per map tile, kept as a 16x16 mask per block. Storage is only
+// allocated for blocks that have a bit set.
+class DFHACK_EXPORT TileBitmap {
+public:
+    typedef std::array<uint16_t, 16> rows_type; // bit x of rows[y]
+
+    void reset(const BlockGrid &new_grid);
+    const BlockGrid &getGrid() const { return grid; }
+
+    bool get(const df::coord &pos) const {
+        if (!grid.contains(pos))
+            return false;
+        int32_t slot = slots[grid.index(pos)];
+        return slot >= 0 && (bits[slot][pos.y & 15] >> (pos.x & 15)) & 1;
+    }
+    // returns false if the bit was already set or pos is off the map
+    bool set(const df::coord &pos);
+    // sets the bits from pos to x2 (inclusive) on the row of pos
+    void setRow(const df::coord &pos, int16_t x2);
+
+    // number of blocks with bits, and of bits set
+    size_t numBlocks() const { return bits.size(); }
+    size_t count() const;
+
+    // calls fn(origin, rows) for every block with bits, where origin is the
+    // tile position of the block's corner
+    void forBlock(std::function<void(const df::coord &, const rows_type &)> fn) const;
+    // calls fn(start, length) for every run of set bits along x, grouped by
+    // block; a run never crosses a block edge
+    void forSpan(std::function<void(const df::coord &, int16_t)> fn) const;
+
+private:
+    BlockGrid grid;
+    std::vector<int32_t> slots; // block index -> index into bits, or -1
+    std::vector<rows_type> bits;
+    std::vector<df::coord> origins;
+
+    rows_type &rowsAt(const df::coord &pos);
+};
+
+struct FloodOptions {
+    // also spread to diagonal neighbours on the same z-level
+    bool diagonal = false;
+    // if set, the flood may move from a flooded tile to the passable tile
+    // directly above (below) it whenever this returns true for (from, to)
+    std::function<bool(const df::coord &, const df::coord &)> up, down;
+};
+
+/// Scanline flood fill from start across the tiles for which passable returns
+/// true, within grid. The flooded tiles are returned in flooded, which is
+/// reset first. passable is called at most a few times per tile and is never
+/// called for tiles outside the grid. Returns the number of tiles flooded.
+DFHACK_EXPORT size_t floodFill(TileBitmap &flooded, const BlockGrid &grid, const df::coord &start,
+    std::function<bool(const df::coord &)> passable, const FloodOptions &opts = FloodOptions());
+
+// A copy of some per-tile fields for a cuboid of the map, kept as one dense
+// array per field. Reading tiles from it is much cheaper than going through
+// the map blocks each time; call refresh() to bring it up to date.
+class DFHACK_EXPORT TileSnapshot {
+public:
+    enum Field : uint32_t {
+        FIELD_TILETYPE = 1 << 0,
+        FIELD_DESIGNATION = 1 << 1,
+        FIELD_OCCUPANCY = 1 << 2,
+        FIELD_WALKABLE = 1 << 3,
+        FIELD_LIQUID = 1 << 4,
+        FIELD_ALL = (1 << 5) - 1
+    };
+
+    // sizes the snapshot to bounds and marks every tile as having no data.
+    // fields is a mask of Field values
+    void reset(const cuboid &bounds, uint32_t fields);
+    const cuboid &getBounds() const { return bounds; }
+    uint32_t getFields() const { return fields; }
+
+    // copies the current values of the tiles in every map block that overlaps
+    // area, or the whole snapshot. returns the number of blocks copied
+    size_t refresh();
+    size_t refresh(const cuboid &area);
+
+    bool contains(const df::coord &pos) const {
+        return !present.empty() && pos.x >= bounds.x_min && pos.x <= bounds.x_max &&
+            pos.y >= bounds.y_min && pos.y <= bounds.y_max &&
+            pos.z >= bounds.z_min && pos.z <= bounds.z_max;
+    }
+    // pos must be contained in the snapshot
+    size_t index(const df::coord &pos) const {
+        return (size_t(pos.z - bounds.z_min) * dim_y + (pos.y - bounds.y_min)) * dim_x + (pos.x - bounds.x_min);
+    }
+
+    // false if the tile's block wasn't allocated when it was last copied
+    bool hasData(size_t idx) const { return present[idx]; }
+    // only valid for the fields that were requested
+    df::tiletype getTileType(size_t idx) const { return df::tiletype(tiletypes[idx]); }
+    uint32_t getDesignation(size_t idx) const { return designations[idx]; }
+    uint32_t getOccupancy(size_t idx) const { return occupancies[idx]; }
+    uint16_t getWalkableGroup(size_t idx) const { return walkable[idx]; }
+    uint8_t getLiquidLevel(size_t idx) const { return liquid[idx]; }
+
+private:
+    cuboid bounds;
+    uint32_t fields = 0;
+    int32_t dim_x = 0, dim_y = 0;
+    std::vector<uint8_t> present;
+    std::vector<int16_t> tiletypes;
+    std::vector<uint32_t> designations;
+    std::vector<uint32_t> occupancies;
+    std::vector<uint16_t> walkable;
+    std::vector<uint8_t> liquid;
+
+    void copyBlock(const df::map_block *block, const cuboid &area);
+};
 }
 }
 #endif
@@ -172,6 +172,25 @@ namespace DFHack
     DFHACK_EXPORT bool isSoilInorganic(int material);
     DFHACK_EXPORT bool isStoneInorganic(int material);
 
+    /**
+     * Cached token -> index lookups over the raws vectors.
+     *
+     * Each table is a sorted flat map built lazily on first use. Tables are
+     * discarded when a world is loaded or unloaded, and rebuilt if the indexed
+     * vector changes underneath them. All lookups return -1 if not found.
+     */
+    namespace RawTokens
+    {
+        DFHACK_EXPORT int32_t findInorganic(const std::string &token);
+        DFHACK_EXPORT int32_t findPlant(const std::string &token);
+        DFHACK_EXPORT int32_t findCreature(const std::string &token);
+        DFHACK_EXPORT int32_t findMaterialTemplate(const std::string &token);
+        DFHACK_EXPORT int32_t findItemdef(df::item_type type, const std::string &token);
+
+        // Drop all cached tables; they are rebuilt on next use.
+        DFHACK_EXPORT void invalidate();
+    }
+
     typedef int32_t t_materialIndex;
     typedef int16_t t_materialType, t_itemType, t_itemSubtype;
 
@@ -44,7 +44,9 @@ distribution.
 #include "df/unit_action_type_group.h"
 #include "df/unit_path_goal.h"
 
+#include <memory>
 #include <ranges>
+#include <unordered_map>
 
 namespace df {
     struct activity_entry;
@@ -187,6 +189,10 @@ DFHACK_EXPORT inline bool getUnitsInBox(std::vector<df::unit *> &units, int16_t
     int16_t x2, int16_t y2, int16_t z2, std::function<bool(df::unit *)> filter = [](df::unit *u) { return true; })
     { return getUnitsInBox(units, cuboid(x1, y1, z1, x2, y2, z2), filter); }
 
+// Look up a unit by id through a dense id table over world->units.all.
+// Equivalent to df::unit::find, but O(1) in the common case.
+DFHACK_EXPORT df::unit *findUnitByID(int32_t id);
+
 // Noble string must be in form "CAPTAIN_OF_THE_GUARD", etc.
 DFHACK_EXPORT bool getUnitsByNobleRole(std::vector<df::unit *> &units, std::string noble);
 DFHACK_EXPORT df::unit *getUnitByNobleRole(std::string noble);
@@ -203,6 +209,82 @@ inline auto citizensRange(std::vector<df::unit *> &vec, bool exclude_residents =
 DFHACK_EXPORT void forCitizens(std::function<void(df::unit *)> fn, bool exclude_residents = false, bool include_insane = false);
 DFHACK_EXPORT bool getCitizens(std::vector<df::unit *> &citizens, bool exclude_residents = false, bool include_insane = false);
 
+// Bits of UnitClasses::flags. Each records the result of the predicate of the
+// same name; the _INSANE variants are the include_insane = true versions.
+namespace UnitClass {
+    enum flag : uint64_t {
+        ACTIVE                   = 1ull << 0,
+        DEAD                     = 1ull << 1,
+        UNDEAD                   = 1ull << 2,
+        CITIZEN                  = 1ull << 3,
+        CITIZEN_INSANE           = 1ull << 4,
+        RESIDENT                 = 1ull << 5,
+        RESIDENT_INSANE          = 1ull << 6,
+        OWN_CIV                  = 1ull << 7,
+        OWN_RACE                 = 1ull << 8,
+        ANIMAL                   = 1ull << 9,
+        TAME                     = 1ull << 10,
+        DOMESTICATED             = 1ull << 11,
+        PET                      = 1ull << 12,
+        AVAILABLE_FOR_ADOPTION   = 1ull << 13,
+        WAR                      = 1ull << 14,
+        HUNTER                   = 1ull << 15,
+        MARKED_FOR_SLAUGHTER     = 1ull << 16,
+        MARKED_FOR_TRAINING      = 1ull << 17,
+        MARKED_FOR_TAMING        = 1ull << 18,
+        MARKED_FOR_WAR_TRAINING  = 1ull << 19,
+        MARKED_FOR_HUNT_TRAINING = 1ull << 20,
+        MARKED_FOR_GELDING       = 1ull << 21,
+        GELDED                   = 1ull << 22,
+        EGG_LAYER                = 1ull << 23,
+        GRAZER                   = 1ull << 24,
+        MILKABLE                 = 1ull << 25,
+        MERCHANT                 = 1ull << 26,
+        FOREST                   = 1ull << 27,
+        VISITOR                  = 1ull << 28,
+        INVADER                  = 1ull << 29,
+        BABY                     = 1ull << 30,
+        CHILD                    = 1ull << 31,
+        ADULT                    = 1ull << 32,
+        MALE                     = 1ull << 33,
+        FEMALE                   = 1ull << 34,
+        GAY                      = 1ull << 35,
+    };
+}
+
+/*
+ * The common predicates of every unit in world->units.active, evaluated once
+ * per frame and shared by all callers. Entries in the index lists are
+ * positions in units (and flags). Caste is read directly off the unit.
+ */
+struct UnitClasses {
+    std::vector<df::unit *> units;
+    std::vector<uint64_t> flags;
+    // not dead, active, and a citizen or resident, sane or not
+    std::vector<uint32_t> citizens;
+    // not dead, active, and tame
+    std::vector<uint32_t> tame;
+    std::unordered_map<int32_t, std::vector<uint32_t>> races;
+
+    // true if the unit has all of the flags in all and none of those in none
+    bool is(size_t idx, uint64_t all, uint64_t none = 0) const {
+        return (flags[idx] & all) == all && !(flags[idx] & none);
+    }
+    const std::vector<uint32_t> &ofRace(int32_t race) const {
+        static const std::vector<uint32_t> empty;
+        auto it = races.find(race);
+        return it == races.end() ? empty : it->second;
+    }
+};
+
+// The classification for the current frame, built on first use. The returned
+// object stays valid while held, even if it is rebuilt in the meantime.
+DFHACK_EXPORT std::shared_ptr<const UnitClasses> getUnitClasses();
+// Drop the cached classification. Call after changing a unit in a way the
+// flags record, e.g. marking it for slaughter. Also done at the start of
+// every frame.
+DFHACK_EXPORT void clearUnitClasses();
+
 // Returns the true position of the unit (non-trivial in case of caged).
 DFHACK_EXPORT df::coord getPosition(df::unit *unit);
 
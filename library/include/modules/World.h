@@ -122,6 +122,10 @@ namespace DFHack
         // Create or delete block data associated with the given persistent data item
         DFHACK_EXPORT df::tile_bitmask *getPersistentTilemask(PersistentDataItem &item, df::map_block *block, bool create = false);
         DFHACK_EXPORT bool deletePersistentTilemask(PersistentDataItem &item, df::map_block *block);
+        // Appends the map blocks that have a tilemask for the given item to vec,
+        // in no particular order. This only visits blocks that carry the mask, so
+        // it is much cheaper than checking every block in the map.
+        DFHACK_EXPORT void getPersistentTilemaskBlocks(std::vector<df::map_block *> *vec, PersistentDataItem &item);
     }
 }
 #endif
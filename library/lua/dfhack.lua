@@ -726,6 +726,14 @@ function dfhack.penarray.__tostring()
     return "<penarray>"
 end
 
+dfhack.mapsnapshot.__index = dfhack.mapsnapshot
+
+---@nodiscard
+---@return string
+function dfhack.mapsnapshot.__tostring()
+    return "<map snapshot>"
+end
+
 ---@nodiscard
 ---@return number x
 ---@return number y
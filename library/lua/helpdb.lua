@@ -8,6 +8,11 @@ local argparse = require('argparse')
 local RENDERED_PATH = 'hack/docs/docs/tools/'
 local TAG_DEFINITIONS = 'hack/docs/docs/Tags.txt'
 
+-- help text parsed from files is cached here so that only files that have
+-- changed need to be parsed again. bump the version if the parsing changes.
+local CACHE_FILE = 'dfhack-config/helpdb-cache.json'
+local CACHE_VERSION = 2
+
 -- used when reading help text embedded in script sources
 local SCRIPT_DOC_BEGIN = '[====['
 local SCRIPT_DOC_END = ']====]'
@@ -208,6 +213,30 @@ local function update_entry(entry, iterator, opts)
     end
 end
 
+-- fills in the help text of the entry from the native cache. returns false if
+-- the source file has changed since it was last parsed.
+local function read_cached_text(entry)
+    local cached = dfhack.internal.getHelpCache(entry.source_path)
+    if not cached then return false end
+    entry.short_help, entry.long_help = cached.short_help, cached.long_help
+    entry.tags = {}
+    for _,tag in ipairs(cached.tags) do
+        if tag_index[tag] then
+            entry.tags[tag] = true
+        end
+    end
+    return true
+end
+
+local function write_cached_text(entry)
+    local tags = {}
+    for tag in pairs(entry.tags) do
+        table.insert(tags, tag)
+    end
+    dfhack.internal.setHelpCache(entry.source_path, entry.short_help,
+                                 entry.long_help, tags)
+end
+
 -- create db entry based on parsing sphinx-rendered help text
 local function make_rendered_entry(old_entry, entry_name, kwargs)
     local source_path = get_rendered_path(entry_name)
@@ -219,11 +248,15 @@ local function make_rendered_entry(old_entry, entry_name, kwargs)
     end
     kwargs.source_path, kwargs.source_timestamp = source_path, source_timestamp
     local entry = make_default_entry(entry_name, HELP_SOURCES.RENDERED, kwargs)
+    if read_cached_text(entry) then
+        return entry
+    end
     local ok, lines = pcall(io.lines, source_path)
     if not ok then
         return entry
     end
     update_entry(entry, lines)
+    write_cached_text(entry)
     return entry
 end
 
@@ -257,6 +290,9 @@ local function make_script_entry(old_entry, entry_name, kwargs)
     end
     kwargs.source_timestamp, kwargs.entry_type = source_timestamp
     local entry = make_default_entry(entry_name, HELP_SOURCES.SCRIPT, kwargs)
+    if read_cached_text(entry) then
+        return entry
+    end
     local ok, lines = pcall(io.lines, source_path)
     if not ok then
         return entry
@@ -265,6 +301,7 @@ local function make_script_entry(old_entry, entry_name, kwargs)
             {begin_marker=SCRIPT_DOC_BEGIN,
              end_marker=SCRIPT_DOC_END,
              first_line_is_short_help='%-%-'})
+    write_cached_text(entry)
     return entry
 end
 
@@ -405,12 +442,25 @@ local function index_tags()
 end
 
 local needs_refresh = true
+local loaded_cache_version = nil
+
+-- the parsed text depends on the parser and on which tags are defined
+local function get_cache_version()
+    return ('%d:%s:%d'):format(CACHE_VERSION, dfhack.getGitCommit(),
+                               dfhack.filesystem.mtime(TAG_DEFINITIONS))
+end
 
 -- ensures the db is loaded
 local function ensure_db()
     if not needs_refresh then return end
     needs_refresh = false
 
+    local cache_version = get_cache_version()
+    if cache_version ~= loaded_cache_version then
+        dfhack.internal.loadHelpCache(CACHE_FILE, cache_version)
+        loaded_cache_version = cache_version
+    end
+
     local old_db = textdb
     textdb, entrydb, tag_index = {}, {}, {}
 
@@ -419,6 +469,8 @@ local function ensure_db()
     scan_plugins(old_db)
     scan_scripts(old_db)
     index_tags()
+    dfhack.internal.setHelpIndex(entrydb, textdb)
+    dfhack.internal.saveHelpCache(CACHE_FILE, cache_version)
     if is_tag('armok') then
         dfhack.internal.setArmokTools(get_tag_data('armok'))
     end
@@ -596,59 +648,6 @@ function sort_by_basename(a, b)
     return false
 end
 
--- returns true if all filter elements are matched (i.e. any of the tags AND
--- any of the strings AND any of the entry_types)
-local function matches(entry_name, filter)
-    if filter.tag then
-        local matched = false
-        local tags = get_db_property(entry_name, 'tags')
-        for _,tag in ipairs(filter.tag) do
-            if tags[tag] then
-                matched = true
-                break
-            end
-        end
-        if not matched then
-            return false
-        end
-    end
-    if filter.entry_type then
-        local matched = false
-        local etypes = get_db_property(entry_name, 'entry_types')
-        for _,etype in ipairs(filter.entry_type) do
-            if etypes[etype] then
-                matched = true
-                break
-            end
-        end
-        if not matched then
-            return false
-        end
-    end
-    if filter.str then
-        local matched = false
-        for _,str in ipairs(filter.str) do
-            if entry_name:find(str, 1, true) then
-                matched = true
-                break
-            end
-        end
-        if not matched then
-            return false
-        end
-    end
-    return true
-end
-
-local function matches_all(entry_name, filters)
-    for _,filter in ipairs(filters) do
-        if not matches(entry_name, filter) then
-            return false
-        end
-    end
-    return true
-end
-
 -- normalizes the lists in the filter and returns nil if no filter elements are
 -- populated
 local function normalize_filter_map(f)
@@ -695,15 +694,7 @@ function search_entries(include, exclude)
     ensure_db()
     include = normalize_filter_list(include)
     exclude = normalize_filter_list(exclude)
-    local entries = {}
-    for entry in pairs(entrydb) do
-        if (not include or matches_all(entry, include)) and
-                (not exclude or not matches_all(entry, exclude)) then
-            table.insert(entries, entry)
-        end
-    end
-    table.sort(entries, sort_by_basename)
-    return entries
+    return dfhack.internal.searchHelpIndex(include, exclude)
 end
 
 -- returns a list of all commands. used by Core's autocomplete functionality.
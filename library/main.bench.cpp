@@ -0,0 +1,200 @@
+#include "Bench.h"
+
+#include "json/json.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace DFHack;
+
+std::vector<Bench::Benchmark> &Bench::registry() {
+    static std::vector<Benchmark> benchmarks;
+    return benchmarks;
+}
+
+struct options {
+    std::string filter;
+    std::string json_path;
+    std::string baseline_path;
+    double min_time_ms = 200;
+    double warmup_ms = 50;
+    double threshold_pct = 10;
+    bool smoke = false;
+};
+
+struct result {
+    std::string name;
+    uint64_t iterations;
+    double ns_per_op;
+    double bytes_per_op;
+};
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  --filter STR      only run benchmarks whose name contains STR\n"
+        "  --min-time MS     target measured run time per benchmark (default 200)\n"
+        "  --warmup MS       warmup time per benchmark (default 50)\n"
+        "  --json FILE       write results to FILE as JSON\n"
+        "  --baseline FILE   compare against a JSON file from a previous run\n"
+        "  --threshold PCT   slowdown that counts as a regression (default 10)\n"
+        "  --smoke           run each benchmark once; for checking they work\n",
+        argv0);
+}
+
+static bool parse_args(int argc, char **argv, options &opts) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto need_value = [&]() -> const char * {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "missing value for %s\n", arg.c_str());
+                return NULL;
+            }
+            return argv[++i];
+        };
+        const char *val = NULL;
+        if (arg == "--smoke")
+            opts.smoke = true;
+        else if (arg == "--filter" && (val = need_value()))
+            opts.filter = val;
+        else if (arg == "--json" && (val = need_value()))
+            opts.json_path = val;
+        else if (arg == "--baseline" && (val = need_value()))
+            opts.baseline_path = val;
+        else if (arg == "--min-time" && (val = need_value()))
+            opts.min_time_ms = atof(val);
+        else if (arg == "--warmup" && (val = need_value()))
+            opts.warmup_ms = atof(val);
+        else if (arg == "--threshold" && (val = need_value()))
+            opts.threshold_pct = atof(val);
+        else {
+            usage(argv[0]);
+            return false;
+        }
+    }
+    return true;
+}
+
+// runs the benchmark for the given number of iterations and returns elapsed ns
+static double run_once(const Bench::Benchmark &bench, uint64_t iterations, uint64_t *bytes_per_op) {
+    Bench::State state(iterations);
+    auto start = std::chrono::steady_clock::now();
+    bench.fn(state);
+    auto end = std::chrono::steady_clock::now();
+    if (bytes_per_op)
+        *bytes_per_op = state.get_bytes_per_op();
+    return std::chrono::duration<double, std::nano>(end - start).count();
+}
+
+static result run_benchmark(const Bench::Benchmark &bench, const options &opts) {
+    uint64_t bytes = 0;
+    if (opts.smoke) {
+        double ns = run_once(bench, 1, &bytes);
+        return {bench.name, 1, ns, double(bytes)};
+    }
+
+    // warm up caches and estimate the per-op cost
+    uint64_t n = 1;
+    double ns = run_once(bench, n, NULL);
+    double warmup_ns = opts.warmup_ms * 1e6;
+    while (ns < warmup_ns && n < (1ull << 40)) {
+        n *= 2;
+        ns = run_once(bench, n, NULL);
+    }
+
+    double per_op = ns / n;
+    uint64_t iterations = uint64_t(opts.min_time_ms * 1e6 / (per_op > 0 ? per_op : 1));
+    if (iterations < 1)
+        iterations = 1;
+
+    ns = run_once(bench, iterations, &bytes);
+    return {bench.name, iterations, ns / iterations, double(bytes)};
+}
+
+static bool load_baseline(const std::string &path, std::map<std::string, double> &baseline) {
+    std::ifstream in(path);
+    if (!in) {
+        fprintf(stderr, "cannot open baseline file: %s\n", path.c_str());
+        return false;
+    }
+    Json::Value root;
+    Json::CharReaderBuilder builder;
+    std::string errs;
+    if (!Json::parseFromStream(builder, in, &root, &errs)) {
+        fprintf(stderr, "cannot parse baseline file %s: %s\n", path.c_str(), errs.c_str());
+        return false;
+    }
+    for (auto &entry : root["benchmarks"])
+        baseline[entry["name"].asString()] = entry["ns_per_op"].asDouble();
+    return true;
+}
+
+static bool write_json(const std::string &path, const std::vector<result> &results) {
+    Json::Value root(Json::objectValue);
+    Json::Value &list = root["benchmarks"] = Json::Value(Json::arrayValue);
+    for (auto &r : results) {
+        Json::Value entry(Json::objectValue);
+        entry["name"] = r.name;
+        entry["iterations"] = Json::UInt64(r.iterations);
+        entry["ns_per_op"] = r.ns_per_op;
+        entry["bytes_per_op"] = r.bytes_per_op;
+        list.append(entry);
+    }
+
+    std::ofstream out(path);
+    if (!out) {
+        fprintf(stderr, "cannot write json file: %s\n", path.c_str());
+        return false;
+    }
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "  ";
+    out << Json::writeString(builder, root) << std::endl;
+    return true;
+}
+
+int main(int argc, char **argv) {
+    options opts;
+    if (!parse_args(argc, argv, opts))
+        return 2;
+
+    std::map<std::string, double> baseline;
+    if (!opts.baseline_path.empty() && !load_baseline(opts.baseline_path, baseline))
+        return 2;
+
+    std::vector<result> results;
+    bool regressed = false;
+
+    printf("%-48s %14s %14s %12s\n", "benchmark", "iterations", "ns/op", "MB/s");
+    for (auto &bench : Bench::registry()) {
+        if (!opts.filter.empty() && bench.name.find(opts.filter) == std::string::npos)
+            continue;
+
+        result r = run_benchmark(bench, opts);
+        results.push_back(r);
+
+        double mbps = r.bytes_per_op > 0 ? r.bytes_per_op * 1e3 / r.ns_per_op : 0;
+        printf("%-48s %14llu %14.1f %12.1f", r.name.c_str(),
+            (unsigned long long)r.iterations, r.ns_per_op, mbps);
+
+        auto it = baseline.find(r.name);
+        if (it != baseline.end() && it->second > 0) {
+            double delta = (r.ns_per_op - it->second) * 100.0 / it->second;
+            bool slow = delta > opts.threshold_pct;
+            printf("  %+6.1f%%%s", delta, slow ? "  REGRESSION" : "");
+            regressed = regressed || slow;
+        }
+        printf("\n");
+    }
+
+    if (!opts.json_path.empty() && !write_json(opts.json_path, results))
+        return 2;
+
+    return (regressed && !opts.smoke) ? 1 : 0;
+}
@@ -372,6 +372,15 @@ bool Buildings::setOwner(df::building_civzonest *bld, df::unit *unit)
     return true;
 }
 
+static id_index<df::building> building_index;
+
+df::building *Buildings::findBuildingByID(int32_t id)
+{
+    if (!world)
+        return NULL;
+    return building_index.find(world->buildings.all, id, building_next_id ? *building_next_id : -1);
+}
+
 df::building *Buildings::findAtTile(df::coord pos)
 {
     auto occ = Maps::getTileOccupancy(pos);
@@ -38,8 +38,12 @@
 #include "df/world.h"
 
 #include <algorithm>
+#include <bitset>
 #include <cstring>
+#include <deque>
 #include <map>
+#include <memory>
+#include <queue>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
@@ -63,15 +67,131 @@ using namespace df::enums;
 
 static multimap<int32_t, EventHandler> tickQueue;
 
+/*
+ * The registered handlers for one event type. The list is never modified in
+ * place: registering or unregistering builds a new one, and dispatch just takes
+ * a reference to the current list. Handlers may still (un)register listeners
+ * while an event is being delivered, but delivering an event copies nothing.
+ */
+class HandlerList {
+public:
+    typedef std::vector<std::pair<Plugin*, EventHandler>> list_type;
+
+    // keeps the list seen by one dispatch alive
+    class Snapshot {
+        std::shared_ptr<const list_type> list;
+    public:
+        explicit Snapshot(std::shared_ptr<const list_type> list) : list(std::move(list)) {}
+        list_type::const_iterator begin() const { return list->begin(); }
+        list_type::const_iterator end() const { return list->end(); }
+    };
+
+    HandlerList() : list(std::make_shared<const list_type>()) {}
+
+    Snapshot snapshot() const { return Snapshot(list); }
+    bool empty() const { return list->empty(); }
+    // the lowest freq of all handlers; meaningless if empty()
+    int32_t minFreq() const { return min_freq; }
+
+    void insert(const EventHandler &handler) {
+        auto next = std::make_shared<list_type>(*list);
+        // grouped by plugin, then in registration order
+        auto pos = std::upper_bound(next->begin(), next->end(), handler.plugin,
+            [](Plugin *plugin, const list_type::value_type &entry) {
+                return std::less<Plugin*>()(plugin, entry.first);
+            });
+        next->emplace(pos, handler.plugin, handler);
+        replace(std::move(next));
+    }
+
+    // removes the entries pred returns true for, and returns how many there were
+    template<typename Pred>
+    size_t erase_if(Pred pred) {
+        auto next = std::make_shared<list_type>();
+        next->reserve(list->size());
+        for (auto &entry : *list) {
+            if (!pred(entry))
+                next->push_back(entry);
+        }
+        size_t removed = list->size() - next->size();
+        if (removed)
+            replace(std::move(next));
+        return removed;
+    }
+
+private:
+    void replace(std::shared_ptr<list_type> next) {
+        min_freq = 0;
+        for (size_t i = 0; i < next->size(); i++) {
+            int32_t freq = (*next)[i].second.freq;
+            if (i == 0 || freq < min_freq)
+                min_freq = freq;
+        }
+        list = std::move(next);
+    }
+
+    std::shared_ptr<const list_type> list;
+    int32_t min_freq = 0;
+};
+
 //TODO: consider unordered_map of pairs, or unordered_map of unordered_set, or whatever
-static multimap<Plugin*, EventHandler> handlers[EventType::EVENT_MAX];
+static HandlerList handlers[EventType::EVENT_MAX];
 static int32_t eventLastTick[EventType::EVENT_MAX];
 
+/*
+ * The tick each event type is next due to run. A type is due minFreq() ticks
+ * after it last ran, except TICK, which is due when the earliest registered
+ * tick comes around. Types without handlers aren't scheduled at all, so they
+ * cost nothing per tick. Entries in dueQueue whose tick doesn't match nextDue
+ * are stale and get skipped.
+ */
+static const int32_t NOT_SCHEDULED = INT32_MAX;
+static int32_t nextDue[EventType::EVENT_MAX];
+typedef std::pair<int32_t, int32_t> due_entry; // tick, event type
+static std::priority_queue<due_entry, std::vector<due_entry>, std::greater<due_entry>> dueQueue;
+
+static void schedule(size_t e) {
+    int32_t due = NOT_SCHEDULED;
+    if (e == EventType::TICK) {
+        if (!handlers[e].empty() && !tickQueue.empty())
+            due = tickQueue.begin()->first;
+    } else if (!handlers[e].empty()) {
+        int64_t when = int64_t(eventLastTick[e]) + handlers[e].minFreq();
+        due = int32_t(std::min<int64_t>(when, NOT_SCHEDULED - 1));
+    }
+    if (due == nextDue[e])
+        return;
+    nextDue[e] = due;
+    if (due == NOT_SCHEDULED)
+        return;
+
+    // don't let stale entries pile up if listeners are re-registered a lot
+    if (dueQueue.size() >= 4 * EventType::EVENT_MAX) {
+        dueQueue = decltype(dueQueue)();
+        for (size_t a = 0; a < EventType::EVENT_MAX; a++) {
+            if (nextDue[a] != NOT_SCHEDULED)
+                dueQueue.emplace(nextDue[a], int32_t(a));
+        }
+    } else {
+        dueQueue.emplace(due, int32_t(e));
+    }
+}
+
+static void resetSchedule() {
+    dueQueue = decltype(dueQueue)();
+    for (size_t a = 0; a < EventType::EVENT_MAX; a++) {
+        eventLastTick[a] = -1;
+        nextDue[a] = NOT_SCHEDULED;
+        schedule(a);
+    }
+}
+
 static const int32_t ticksPerYear = 403200;
 
 void DFHack::EventManager::registerListener(EventType::EventType e, EventHandler handler) {
     DEBUG(log).print("registering handler %p from plugin %s for event %d\n", handler.eventHandler, !handler.plugin ? "<null>" : handler.plugin->getName().c_str(), e);
-    handlers[e].insert(pair<Plugin*, EventHandler>(handler.plugin, handler));
+    handlers[e].insert(handler);
+    schedule(e);
 }
 
 int32_t DFHack::EventManager::registerTick(EventHandler handler, int32_t when, bool absolute) {
@@ -87,7 +207,8 @@ int32_t DFHack::EventManager::registerTick(EventHandler handler, int32_t when, b
     handler.freq = when;
     tickQueue.insert(pair<int32_t, EventHandler>(handler.freq, handler));
     DEBUG(log).print("registering handler %p from plugin %s for event TICK\n", handler.eventHandler, !handler.plugin ? "<null>" : handler.plugin->getName().c_str());
-    handlers[EventType::TICK].insert(pair<Plugin*,EventHandler>(handler.plugin,handler));
+    handlers[EventType::TICK].insert(handler);
+    schedule(EventType::TICK);
     return when;
 }
 
@@ -104,31 +225,28 @@ static void removeFromTickQueue(EventHandler getRidOf) {
 }
 
 void DFHack::EventManager::unregister(EventType::EventType e, EventHandler handler) {
-    for ( auto i = handlers[e].find(handler.plugin); i != handlers[e].end(); ) {
-        if ( (*i).first != handler.plugin )
-            break;
-        EventHandler &handle = (*i).second;
-        if ( handle != handler ) {
-            i++;
-            continue;
-        }
-        DEBUG(log).print("unregistering handler %p from plugin %s for event %d\n", handler.eventHandler, !handler.plugin ? "<null>" : handler.plugin->getName().c_str(), e);
-        i = handlers[e].erase(i);
-        if ( e == EventType::TICK )
-            removeFromTickQueue(handler);
-    }
+    size_t removed = handlers[e].erase_if([&](const HandlerList::list_type::value_type &entry) {
+        return entry.first == handler.plugin && entry.second == handler;
+    });
+    if ( !removed )
+        return;
+    DEBUG(log).print("unregistering handler %p from plugin %s for event %d\n", handler.eventHandler, !handler.plugin ? "<null>" : handler.plugin->getName().c_str(), e);
+    if ( e == EventType::TICK )
+        removeFromTickQueue(handler);
+    schedule(e);
 }
 
 void DFHack::EventManager::unregisterAll(Plugin* plugin) {
     DEBUG(log).print("unregistering all handlers for plugin %s\n", !plugin ? "<null>" : plugin->getName().c_str());
-    for ( auto i = handlers[EventType::TICK].find(plugin); i != handlers[EventType::TICK].end(); i++ ) {
-        if ( (*i).first != plugin )
-            break;
-
-        removeFromTickQueue((*i).second);
+    for (auto &[handler_plugin, handle] : handlers[EventType::TICK].snapshot()) {
+        if ( handler_plugin == plugin )
+            removeFromTickQueue(handle);
     }
-    for (auto &handler : handlers) {
-        handler.erase(plugin);
+    for ( size_t a = 0; a < EventType::EVENT_MAX; a++ ) {
+        handlers[a].erase_if([&](const HandlerList::list_type::value_type &entry) {
+            return entry.first == plugin;
+        });
+        schedule(a);
     }
 }
 
@@ -262,8 +380,125 @@ static int32_t lastReport;
 
 //unit attack
 static int32_t lastReportUnitAttack;
-static std::map<int32_t,std::vector<int32_t>> reportToRelevantUnits;
-static int32_t reportToRelevantUnitsTime = -1;
+
+/*
+ * Maps report ids to the units whose report logs mention them. Report ids are
+ * handed out in increasing order, so this is a window of consecutive ids
+ * starting at base_id, and lookups are just an index into it. Each update only
+ * looks at the entries of each unit log that are newer than the newest one
+ * that was seen in that same log, so a report that shows up in a log after a
+ * newer report was seen elsewhere isn't skipped. Ids that DF has dropped from
+ * world->status.reports are aged out.
+ */
+class ReportUnitIndex {
+public:
+    static constexpr size_t MAX_UNITS = 4;
+
+    struct Entry {
+        // the number of units seen; only the first MAX_UNITS ids are kept
+        size_t count = 0;
+        int32_t units[MAX_UNITS];
+
+        const int32_t *begin() const { return units; }
+        const int32_t *end() const { return units + std::min(count, MAX_UNITS); }
+
+        void add(int32_t unit_id) {
+            if (std::find(begin(), end(), unit_id) != end())
+                return;
+            if (count < MAX_UNITS)
+                units[count] = unit_id;
+            count++;
+        }
+    };
+
+    void clear() {
+        entries.clear();
+        progress.clear();
+        base_id = 0;
+        last_update_tick = -1;
+    }
+
+    // returns nullptr if no unit has the report in its log
+    const Entry *find(int32_t report_id) const {
+        if (report_id < base_id || size_t(report_id - base_id) >= entries.size())
+            return nullptr;
+        const Entry &entry = entries[report_id - base_id];
+        return entry.count ? &entry : nullptr;
+    }
+
+    void update() {
+        if (!df::global::world)
+            return;
+        if (df::global::world->frame_counter <= last_update_tick)
+            return;
+        last_update_tick = df::global::world->frame_counter;
+
+        auto &reports = df::global::world->status.reports;
+        if (reports.empty()) {
+            entries.clear();
+            return;
+        }
+
+        int32_t oldest = reports.front()->id;
+        if (entries.empty())
+            base_id = oldest;
+        else if (oldest > base_id) {
+            size_t expired = std::min(entries.size(), size_t(oldest - base_id));
+            entries.erase(entries.begin(), entries.begin() + expired);
+            base_id = oldest;
+        }
+
+        for (auto unit : df::global::world->units.all) {
+            auto &seen = progress[unit->id];
+            seen.tick = last_update_tick;
+            for (int16_t b = df::enum_traits<df::unit_report_type>::first_item_value; b <= df::enum_traits<df::unit_report_type>::last_item_value; b++) {
+                if (b == df::unit_report_type::Sparring)
+                    continue;
+                auto &log = unit->reports.log[b];
+                // logs are in id order, so the new entries are at the end
+                size_t c = log.size();
+                while (c > 0 && log[c-1] > seen.last_id[b])
+                    c--;
+                for ( ; c < log.size(); c++)
+                    add(log[c], unit->id);
+                if (!log.empty())
+                    seen.last_id[b] = std::max(seen.last_id[b], log.back());
+            }
+        }
+
+        // forget units that have left units.all
+        for (auto it = progress.begin(); it != progress.end(); ) {
+            if (it->second.tick != last_update_tick)
+                it = progress.erase(it);
+            else
+                ++it;
+        }
+    }
+
+private:
+    void add(int32_t report_id, int32_t unit_id) {
+        if (report_id < base_id)
+            return; // already aged out
+        size_t idx = report_id - base_id;
+        if (idx >= entries.size())
+            entries.resize(idx + 1);
+        entries[idx].add(unit_id);
+    }
+
+    // the newest report id seen in each of a unit's logs
+    struct LogProgress {
+        int32_t last_id[df::enum_traits<df::unit_report_type>::last_item_value + 1];
+        int32_t tick = -1;
+        LogProgress() { std::fill(std::begin(last_id), std::end(last_id), -1); }
+    };
+
+    std::deque<Entry> entries;
+    unordered_map<int32_t, LogProgress> progress;
+    int32_t base_id = 0;
+    int32_t last_update_tick = -1;
+};
+
+static ReportUnitIndex reportToRelevantUnits;
 
 //interaction
 static int32_t lastReportInteraction;
@@ -303,6 +538,7 @@ void DFHack::EventManager::onStateChange(color_ostream& out, state_change_event
         seenJobs.clear();
         prevJobs.clear();
         tickQueue.clear();
+        schedule(EventType::TICK);
         livingUnits.clear();
         buildings.clear();
         constructions.clear();
@@ -314,7 +550,7 @@ void DFHack::EventManager::onStateChange(color_ostream& out, state_change_event
         lastReportUnitAttack = -1;
         gameLoaded = false;
 
-        multimap<Plugin*,EventHandler> copy(handlers[EventType::UNLOAD].begin(), handlers[EventType::UNLOAD].end());
+        auto copy = handlers[EventType::UNLOAD].snapshot();
         for (auto &[_,handle] : copy) {
             DEBUG(log,out).print("calling handler for map unloaded state change event\n");
             run_handler(out, EventType::UNLOAD, handle, nullptr);
@@ -382,11 +618,8 @@ void DFHack::EventManager::onStateChange(color_ostream& out, state_change_event
         }
         lastReportUnitAttack = -1;
         lastReportInteraction = -1;
-        reportToRelevantUnitsTime = -1;
         reportToRelevantUnits.clear();
-        for (int &last_tick : eventLastTick) {
-            last_tick = -1;//-1000000;
-        }
+        resetSchedule();
         for (auto unit : df::global::world->history.figures) {
             if ( unit->id < 0 && unit->name.language < 0 )
                 unit->name.language = 0;
@@ -409,25 +642,28 @@ void DFHack::EventManager::manageEvents(color_ostream& out) {
     int32_t tick = df::global::world->frame_counter;
     TRACE(log,out).print("processing events at tick %d\n", tick);
 
+    std::bitset<EventType::EVENT_MAX> due;
+    while ( !dueQueue.empty() && dueQueue.top().first <= tick ) {
+        auto [when, e] = dueQueue.top();
+        dueQueue.pop();
+        if ( when != nextDue[e] )
+            continue;
+        due.set(e);
+        nextDue[e] = NOT_SCHEDULED;
+    }
+    if ( due.none() )
+        return;
+
     auto &core = Core::getInstance();
     auto &counters = core.perf_counters;
     for ( size_t a = 0; a < EventType::EVENT_MAX; a++ ) {
-        if ( handlers[a].empty() )
-            continue;
-        int32_t eventFrequency = -100;
-        if ( a != EventType::TICK )
-            for (auto &[_,handle] : handlers[a]) {
-                if (handle.freq < eventFrequency || eventFrequency == -100 )
-                    eventFrequency = handle.freq;
-            }
-        else eventFrequency = 1;
-
-        if ( tick >= eventLastTick[a] && tick - eventLastTick[a] < eventFrequency )
+        if ( !due[a] )
             continue;
 
         uint32_t start_ms = core.p->getTickCount();
         eventManager[a](out);
         eventLastTick[a] = tick;
+        schedule(a);
         counters.incCounter(counters.event_manager_event_total_ms[a], start_ms);
     }
 }
@@ -440,7 +676,7 @@ static void manageTickEvent(color_ostream& out) {
     while ( !tickQueue.empty() ) {
         if ( tick < (*tickQueue.begin()).first )
             break;
-        EventHandler &handle = (*tickQueue.begin()).second;
+        EventHandler handle = (*tickQueue.begin()).second;
         tickQueue.erase(tickQueue.begin());
         DEBUG(log,out).print("calling handler for tick event\n");
         run_handler(out, EventType::TICK, handle, (void*)intptr_t(tick));
@@ -448,17 +684,14 @@ static void manageTickEvent(color_ostream& out) {
     }
     if ( toRemove.empty() )
         return;
-    for ( auto a = handlers[EventType::TICK].begin(); a != handlers[EventType::TICK].end(); ) {
-        EventHandler &handle = (*a).second;
-        if ( toRemove.find(handle) == toRemove.end() ) {
-            a++;
-            continue;
-        }
-        a = handlers[EventType::TICK].erase(a);
-        toRemove.erase(handle);
-        if ( toRemove.empty() )
-            break;
-    }
+    // remove one registration for each handler that ran
+    handlers[EventType::TICK].erase_if([&](const HandlerList::list_type::value_type &entry) {
+        auto it = toRemove.find(entry.second);
+        if ( it == toRemove.end() )
+            return false;
+        toRemove.erase(it);
+        return true;
+    });
 }
 
 static void manageJobInitiatedEvent(color_ostream& out) {
@@ -474,7 +707,7 @@ static void manageJobInitiatedEvent(color_ostream& out) {
     if ( lastJobId+1 == *df::global::job_next_id ) {
         return; //no new jobs
     }
-    multimap<Plugin*,EventHandler> copy(handlers[EventType::JOB_INITIATED].begin(), handlers[EventType::JOB_INITIATED].end());
+    auto copy = handlers[EventType::JOB_INITIATED].snapshot();
 
     for ( df::job_list_link* link = &df::global::world->jobs.list; link != nullptr; link = link->next ) {
         if ( link->item == nullptr )
@@ -495,7 +728,7 @@ static void manageJobStartedEvent(color_ostream& out) {
         return;
 
     // iterate event handler callbacks
-    multimap<Plugin*, EventHandler> copy(handlers[EventType::JOB_STARTED].begin(), handlers[EventType::JOB_STARTED].end());
+    auto copy = handlers[EventType::JOB_STARTED].snapshot();
 
     std::vector<int32_t> newStartedJobs;
     newStartedJobs.reserve(startedJobs.size());
@@ -530,7 +763,7 @@ static void manageJobCompletedEvent(color_ostream& out) {
     if (!df::global::world)
         return;
 
-    multimap<Plugin*, EventHandler> copy(handlers[EventType::JOB_COMPLETED].begin(), handlers[EventType::JOB_COMPLETED].end());
+    auto copy = handlers[EventType::JOB_COMPLETED].snapshot();
     std::vector<JobCompleteData> nowJobs;
     // predict the size in advance, this will prevent or reduce memory reallocation.
     nowJobs.reserve(prevJobs.size());
@@ -723,7 +956,7 @@ static void manageNewUnitActiveEvent(color_ostream& out) {
     if (!df::global::world)
         return;
 
-    multimap<Plugin*,EventHandler> copy(handlers[EventType::UNIT_NEW_ACTIVE].begin(), handlers[EventType::UNIT_NEW_ACTIVE].end());
+    auto copy = handlers[EventType::UNIT_NEW_ACTIVE].snapshot();
     unordered_set<int32_t> next_activeUnits;
     vector<int32_t> newly_active_unit_ids;
     for (df::unit* unit : df::global::world->units.active) {
@@ -746,7 +979,7 @@ static void manageNewUnitActiveEvent(color_ostream& out) {
 static void manageUnitDeathEvent(color_ostream& out) {
     if (!df::global::world)
         return;
-    multimap<Plugin*,EventHandler> copy(handlers[EventType::UNIT_DEATH].begin(), handlers[EventType::UNIT_DEATH].end());
+    auto copy = handlers[EventType::UNIT_DEATH].snapshot();
     vector<int32_t> dead_unit_ids;
     for (auto unit : df::global::world->units.all) {
         //if ( unit->counters.death_id == -1 ) {
@@ -779,7 +1012,7 @@ static void manageItemCreationEvent(color_ostream& out) {
         return;
     }
 
-    multimap<Plugin*,EventHandler> copy(handlers[EventType::ITEM_CREATED].begin(), handlers[EventType::ITEM_CREATED].end());
+    auto copy = handlers[EventType::ITEM_CREATED].snapshot();
     size_t index = df::item::binsearch_index(df::global::world->items.all, nextItem, false);
     if ( index != 0 ) index--;
 
@@ -824,7 +1057,7 @@ static void manageBuildingEvent(color_ostream& out) {
      * TODO: could be faster
      * consider looking at jobs: building creation / destruction
      **/
-    multimap<Plugin*,EventHandler> copy(handlers[EventType::BUILDING].begin(), handlers[EventType::BUILDING].end());
+    auto copy = handlers[EventType::BUILDING].snapshot();
     //first alert people about new buildings
     vector<int32_t> new_buildings;
     for ( int32_t a = nextBuilding; a < *df::global::building_next_id; a++ ) {
@@ -870,7 +1103,7 @@ static void manageConstructionEvent(color_ostream& out) {
         return;
     //unordered_set<df::construction*> constructionsNow(df::global::world->event.constructions.begin(), df::global::world->event.constructions.end());
 
-    multimap<Plugin*, EventHandler> copy(handlers[EventType::CONSTRUCTION].begin(), handlers[EventType::CONSTRUCTION].end());
+    auto copy = handlers[EventType::CONSTRUCTION].snapshot();
 
     unordered_set<df::construction> next_construction_set; // will be swapped with constructions
     next_construction_set.reserve(constructions.bucket_count());
@@ -913,7 +1146,7 @@ static void manageConstructionEvent(color_ostream& out) {
 static void manageSyndromeEvent(color_ostream& out) {
     if (!df::global::world)
         return;
-    multimap<Plugin*,EventHandler> copy(handlers[EventType::SYNDROME].begin(), handlers[EventType::SYNDROME].end());
+    auto copy = handlers[EventType::SYNDROME].snapshot();
     int32_t highestTime = -1;
 
     std::vector<SyndromeData> new_syndrome_data;
@@ -947,7 +1180,7 @@ static void manageSyndromeEvent(color_ostream& out) {
 static void manageInvasionEvent(color_ostream& out) {
     if (!df::global::plotinfo)
         return;
-    multimap<Plugin*,EventHandler> copy(handlers[EventType::INVASION].begin(), handlers[EventType::INVASION].end());
+    auto copy = handlers[EventType::INVASION].snapshot();
 
     if ( df::global::plotinfo->invasions.next_id <= nextInvasion )
         return;
@@ -962,7 +1195,7 @@ static void manageInvasionEvent(color_ostream& out) {
 static void manageEquipmentEvent(color_ostream& out) {
     if (!df::global::world)
         return;
-    multimap<Plugin*,EventHandler> copy(handlers[EventType::INVENTORY_CHANGE].begin(), handlers[EventType::INVENTORY_CHANGE].end());
+    auto copy = handlers[EventType::INVENTORY_CHANGE].snapshot();
 
     unordered_map<int32_t, InventoryItem> itemIdToInventoryItem;
     unordered_set<int32_t> currentlyEquipped;
@@ -1068,31 +1301,10 @@ static void manageEquipmentEvent(color_ostream& out) {
     });
 }
 
-static void updateReportToRelevantUnits() {
-    if (!df::global::world)
-        return;
-    if ( df::global::world->frame_counter <= reportToRelevantUnitsTime )
-        return;
-    reportToRelevantUnitsTime = df::global::world->frame_counter;
-
-    for (auto unit : df::global::world->units.all) {
-        for ( int16_t b = df::enum_traits<df::unit_report_type>::first_item_value; b <= df::enum_traits<df::unit_report_type>::last_item_value; b++ ) {
-            if ( b == df::unit_report_type::Sparring )
-                continue;
-            for ( size_t c = 0; c < unit->reports.log[b].size(); c++ ) {
-                int32_t report = unit->reports.log[b][c];
-                if ( std::find(reportToRelevantUnits[report].begin(), reportToRelevantUnits[report].end(), unit->id) != reportToRelevantUnits[report].end() )
-                    continue;
-                reportToRelevantUnits[unit->reports.log[b][c]].push_back(unit->id);
-            }
-        }
-    }
-}
-
 static void manageReportEvent(color_ostream& out) {
     if (!df::global::world)
         return;
-    multimap<Plugin*,EventHandler> copy(handlers[EventType::REPORT].begin(), handlers[EventType::REPORT].end());
+    auto copy = handlers[EventType::REPORT].snapshot();
     std::vector<df::report*>& reports = df::global::world->status.reports;
     size_t idx = df::report::binsearch_index(reports, lastReport, false);
     // returns the index to the key equal to or greater than the key provided
@@ -1123,7 +1335,7 @@ static df::unit_wound* getWound(df::unit* attacker, df::unit* defender) {
 static void manageUnitAttackEvent(color_ostream& out) {
     if (!df::global::world)
         return;
-    multimap<Plugin*,EventHandler> copy(handlers[EventType::UNIT_ATTACK].begin(), handlers[EventType::UNIT_ATTACK].end());
+    auto copy = handlers[EventType::UNIT_ATTACK].snapshot();
     std::vector<df::report*>& reports = df::global::world->status.reports;
     size_t idx = df::report::binsearch_index(reports, lastReportUnitAttack, false);
     // returns the index to the key equal to or greater than the key provided
@@ -1143,7 +1355,7 @@ static void manageUnitAttackEvent(color_ostream& out) {
 
     if ( strikeReports.empty() )
         return;
-    updateReportToRelevantUnits();
+    reportToRelevantUnits.update();
     unordered_set<std::pair<int32_t, int32_t>, hash_pair> already_done;
     for (int reportId : strikeReports) {
         df::report* report = df::report::find(reportId);
@@ -1161,13 +1373,13 @@ static void manageUnitAttackEvent(color_ostream& out) {
             reportStr += report2->text;
         }
 
-        std::vector<int32_t>& relevantUnits = reportToRelevantUnits[report->id];
-        if ( relevantUnits.size() != 2 ) {
+        auto relevantUnits = reportToRelevantUnits.find(report->id);
+        if ( !relevantUnits || relevantUnits->count != 2 ) {
             continue;
         }
 
-        df::unit* unit1 = df::unit::find(relevantUnits[0]);
-        df::unit* unit2 = df::unit::find(relevantUnits[1]);
+        df::unit* unit1 = Units::findUnitByID(relevantUnits->units[0]);
+        df::unit* unit2 = Units::findUnitByID(relevantUnits->units[1]);
 
         df::unit_wound* wound1 = getWound(unit1,unit2);
         df::unit_wound* wound2 = getWound(unit2,unit1);
@@ -1391,16 +1603,18 @@ static vector<df::unit*> gatherRelevantUnits(color_ostream& out, df::report* r1,
 //out.print("%s,%d\n",__FILE__,__LINE__);
     for (auto report : reports) {
 //out.print("%s,%d\n",__FILE__,__LINE__);
-        vector<int32_t>& units = reportToRelevantUnits[report->id];
-        if ( units.size() > 2 ) {
+        auto units = reportToRelevantUnits.find(report->id);
+        if ( !units )
+            continue;
+        if ( units->count > 2 ) {
             if ( Once::doOnce("EventManager interaction too many relevant units") ) {
                 out.print("%s,%d: too many relevant units. On report\n \'%s\'\n", __FILE__, __LINE__, report->text.c_str());
             }
         }
-        for (int & unit_id : units)
+        for (int32_t unit_id : *units)
             if (ids.find(unit_id) == ids.end() ) {
                 ids.insert(unit_id);
-                result.push_back(df::unit::find(unit_id));
+                result.push_back(Units::findUnitByID(unit_id));
             }
     }
 //out.print("%s,%d\n",__FILE__,__LINE__);
@@ -1410,14 +1624,14 @@ static vector<df::unit*> gatherRelevantUnits(color_ostream& out, df::report* r1,
 static void manageInteractionEvent(color_ostream& out) {
     if (!df::global::world)
         return;
-    multimap<Plugin*,EventHandler> copy(handlers[EventType::INTERACTION].begin(), handlers[EventType::INTERACTION].end());
+    auto copy = handlers[EventType::INTERACTION].snapshot();
     std::vector<df::report*>& reports = df::global::world->status.reports;
     size_t a = df::report::binsearch_index(reports, lastReportInteraction, false);
     while (a < reports.size() && reports[a]->id <= lastReportInteraction) {
         a++;
     }
     if ( a < reports.size() )
-        updateReportToRelevantUnits();
+        reportToRelevantUnits.update();
 
     df::report* lastAttackEvent = nullptr;
     df::unit* lastAttacker = nullptr;
@@ -1471,7 +1685,7 @@ static void manageInteractionEvent(color_ostream& out) {
 #endif
         }
 //out.print("%s,%d\n",__FILE__,__LINE__);
-        lastAttacker = df::unit::find(data.attacker);
+        lastAttacker = Units::findUnitByID(data.attacker);
         //lastDefender = df::unit::find(data.defender);
         //fire event
         for (auto &[_,handle] : copy) {
@@ -105,6 +105,7 @@ distribution.
 #include "df/written_content.h"
 
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 using std::string;
@@ -194,27 +195,18 @@ bool ItemTypeInfo::find(const string &token)
     if (items.size() == 1)
         return true;
 
-    auto &defs = world->raws.itemdefs;
-    switch (type)
-    {
-#define ITEM(type,vec,tclass) \
-    case type: \
-        for (size_t i = 0; i < defs.vec.size(); i++) { \
-            if (defs.vec[i]->id == items[1]) { \
-                subtype = i; custom = defs.vec[i]; return true; \
-            } \
-        } \
-        break;
-ITEMDEF_VECTORS
-#undef ITEM
+    if (Items::getSubtypeCount(type) < 0) {
+        return items[1] == "NONE";
+    }
 
-    default:
-        if (items[1] == "NONE")
-            return true;
-        break;
+    int32_t idx = RawTokens::findItemdef(type, items[1]);
+    if (idx >= 0) {
+        subtype = idx;
+        custom = Items::getSubtypeDef(type, idx);
+        return true;
     }
 
-    return (subtype >= 0);
+    return false;
 }
 
 bool ItemTypeInfo::matches(df::job_item_vector_id vec_id) {
@@ -464,8 +456,13 @@ ITEMDEF_VECTORS
 }
 #undef ITEMDEF_VECTORS
 
+static id_index<df::item> item_index;
+
 df::item *Items::findItemByID(int32_t id) {
-    return id < 0 ? NULL : df::item::find(id);
+    if (id < 0 || !world)
+        return NULL;
+    using df::global::item_next_id;
+    return item_index.find(world->items.all, id, item_next_id ? *item_next_id : -1);
 }
 
 df::general_ref *Items::getGeneralRef(df::item *item, df::general_ref_type type) {
@@ -1067,7 +1064,7 @@ df::proj_itemst *Items::makeProjectile(df::item *item)
     return proj;
 }
 
-int Items::getItemBaseValue(int16_t item_type, int16_t item_subtype,
+static int compute_item_base_value(int16_t item_type, int16_t item_subtype,
     int16_t mat_type, int32_t mat_subtype)
 {
     int value = 0;
@@ -1251,17 +1248,82 @@ int Items::getItemBaseValue(int16_t item_type, int16_t item_subtype,
     return value;
 }
 
-static int32_t get_war_multiplier(df::item *item, df::caravan_state *caravan) {
-    CHECK_NULL_POINTER(item);
-    static const int32_t DEFAULT_WAR_MULTIPLIER = 256;
-    if (!caravan)
-        return DEFAULT_WAR_MULTIPLIER;
+namespace {
+    struct base_value_key {
+        int16_t item_type;
+        int16_t item_subtype;
+        int16_t mat_type;
+        int32_t mat_subtype;
+
+        bool operator==(const base_value_key &other) const = default;
+    };
+
+    struct base_value_key_hash {
+        size_t operator()(const base_value_key &k) const {
+            uint64_t v = (uint64_t(uint16_t(k.item_type)) << 48) |
+                         (uint64_t(uint16_t(k.item_subtype)) << 32) |
+                         (uint64_t(uint16_t(k.mat_type)) << 16);
+            return std::hash<uint64_t>()(v ^ uint32_t(k.mat_subtype));
+        }
+    };
+}
 
-    auto caravan_he = df::historical_entity::find(caravan->entity);
-    if (!caravan_he)
+// base values depend only on the raws, so they are kept until the world changes
+static std::unordered_map<base_value_key, int, base_value_key_hash> base_value_cache;
+
+int Items::getItemBaseValue(int16_t item_type, int16_t item_subtype,
+    int16_t mat_type, int32_t mat_subtype)
+{
+    base_value_key key{item_type, item_subtype, mat_type, mat_subtype};
+    auto it = base_value_cache.find(key);
+    if (it != base_value_cache.end())
+        return it->second;
+
+    int value = compute_item_base_value(item_type, item_subtype, mat_type, mat_subtype);
+    base_value_cache.emplace(key, value);
+    return value;
+}
+
+void items_onStateChange(color_ostream &out, state_change_event event)
+{
+    switch (event) {
+    case SC_WORLD_LOADED:
+    case SC_WORLD_UNLOADED:
+        base_value_cache.clear();
+        break;
+    default:
+        break;
+    }
+}
+
+static const int32_t DEFAULT_WAR_MULTIPLIER = 256;
+
+namespace {
+    // Caravan lookups shared by every item that is valued against the same caravan.
+    struct caravan_info {
+        df::caravan_state *caravan = NULL;
+        df::historical_entity *entity = NULL;
+        df::creature_raw *race = NULL;
+        int32_t war_alignment = DEFAULT_WAR_MULTIPLIER;
+
+        explicit caravan_info(df::caravan_state *caravan) : caravan(caravan) {
+            if (!caravan)
+                return;
+            entity = df::historical_entity::find(caravan->entity);
+            if (!entity)
+                return;
+            race = df::creature_raw::find(entity->race);
+            war_alignment = entity->entity_raw->sphere_alignment[sphere_type::WAR];
+        }
+    };
+}
+
+static int32_t get_war_multiplier(df::item *item, const caravan_info &info) {
+    CHECK_NULL_POINTER(item);
+    if (!info.entity)
         return DEFAULT_WAR_MULTIPLIER;
 
-    int32_t war_alignment = caravan_he->entity_raw->sphere_alignment[sphere_type::WAR];
+    int32_t war_alignment = info.war_alignment;
     if (war_alignment == DEFAULT_WAR_MULTIPLIER)
         return DEFAULT_WAR_MULTIPLIER;
 
@@ -1270,7 +1332,7 @@ static int32_t get_war_multiplier(df::item *item, df::caravan_state *caravan) {
     case WEAPON:
     {
         auto weap_def = df::itemdef_weaponst::find(item->getSubtype());
-        auto caravan_cre_raw = df::creature_raw::find(caravan_he->race);
+        auto caravan_cre_raw = info.race;
         if (!weap_def || !caravan_cre_raw || caravan_cre_raw->adultsize < weap_def->minimum_size)
             return DEFAULT_WAR_MULTIPLIER;
         break;
@@ -1284,7 +1346,7 @@ static int32_t get_war_multiplier(df::item *item, df::caravan_state *caravan) {
         if (item->getEffectiveArmorLevel() <= 0)
             return DEFAULT_WAR_MULTIPLIER;
 
-        auto caravan_cre_raw = df::creature_raw::find(caravan_he->race);
+        auto caravan_cre_raw = info.race;
         auto maker_cre_raw = df::creature_raw::find(item->getMakerRace());
         if (!caravan_cre_raw || !maker_cre_raw)
             return DEFAULT_WAR_MULTIPLIER;
@@ -1578,26 +1640,26 @@ static int32_t get_sell_request_multiplier(df::item *item,
     return DEFAULT_AGREEMENT_MULTIPLIER;
 }
 
-static int32_t get_sell_request_multiplier(df::item *item, const df::caravan_state *caravan) {
-    CHECK_NULL_POINTER(caravan);
-    auto sell_prices = caravan->sell_prices;
+static int32_t get_sell_request_multiplier(df::item *item, const caravan_info &info) {
+    CHECK_NULL_POINTER(info.caravan);
+    auto sell_prices = info.caravan->sell_prices;
     if (!sell_prices)
         return DEFAULT_AGREEMENT_MULTIPLIER;
 
-    auto caravan_he = df::historical_entity::find(caravan->entity);
+    auto caravan_he = info.entity;
     if (!caravan_he)
         return DEFAULT_AGREEMENT_MULTIPLIER;
     return get_sell_request_multiplier(item, caravan_he->resources, &sell_prices->price[0]);
 }
 
-static int32_t get_sell_request_multiplier(df::unit *unit, const df::caravan_state *caravan) {
+static int32_t get_sell_request_multiplier(df::unit *unit, const caravan_info &info) {
     CHECK_NULL_POINTER(unit);
-    CHECK_NULL_POINTER(caravan);
-    auto sell_prices = caravan->sell_prices;
+    CHECK_NULL_POINTER(info.caravan);
+    auto sell_prices = info.caravan->sell_prices;
     if (!sell_prices)
         return DEFAULT_AGREEMENT_MULTIPLIER;
 
-    auto caravan_he = df::historical_entity::find(caravan->entity);
+    auto caravan_he = info.entity;
     if (!caravan_he)
         return DEFAULT_AGREEMENT_MULTIPLIER;
 
@@ -1607,8 +1669,9 @@ static int32_t get_sell_request_multiplier(df::unit *unit, const df::caravan_sta
     return (price != -1) ? price : DEFAULT_AGREEMENT_MULTIPLIER;
 }
 
-int Items::getValue(df::item *item, df::caravan_state *caravan) {
+static int get_value(df::item *item, const caravan_info &info) {
     CHECK_NULL_POINTER(item);
+    auto caravan = info.caravan;
     int16_t item_type = item->getType();
     int16_t item_subtype = item->getSubtype();
     int16_t mat_type = item->getMaterial();
@@ -1617,7 +1680,7 @@ int Items::getValue(df::item *item, df::caravan_state *caravan) {
     // Get base value for item type, subtype, and material
     int value = getItemBaseValue(item_type, item_subtype, mat_type, mat_subtype);
     // Entity value modifications
-    value *= get_war_multiplier(item, caravan);
+    value *= get_war_multiplier(item, info);
     value >>= 8;
 
     // Improve value based on quality
@@ -1654,7 +1717,7 @@ int Items::getValue(df::item *item, df::caravan_state *caravan) {
     if (caravan) {
         int32_t buy_multiplier = get_buy_request_multiplier(item, caravan->buy_prices);
         if (buy_multiplier == DEFAULT_AGREEMENT_MULTIPLIER)
-            value *= get_sell_request_multiplier(item, caravan);
+            value *= get_sell_request_multiplier(item, info);
         else
             value *= buy_multiplier;
         value >>= 7;
@@ -1700,7 +1763,7 @@ int Items::getValue(df::item *item, df::caravan_state *caravan) {
             if (Units::isWar(unit) || Units::isHunter(unit))
                 unit_value *= 2;
             if (caravan) {
-                unit_value *= get_sell_request_multiplier(unit, caravan);
+                unit_value *= get_sell_request_multiplier(unit, info);
                 unit_value >>= 7;
             }
             value += unit_value;
@@ -1709,6 +1772,19 @@ int Items::getValue(df::item *item, df::caravan_state *caravan) {
     return value;
 }
 
+int Items::getValue(df::item *item, df::caravan_state *caravan) {
+    return get_value(item, caravan_info(caravan));
+}
+
+vector<int> Items::getValues(const vector<df::item *> &items, df::caravan_state *caravan) {
+    caravan_info info(caravan);
+    vector<int> values;
+    values.reserve(items.size());
+    for (auto item : items)
+        values.push_back(get_value(item, info));
+    return values;
+}
+
 bool Items::createItem(vector<df::item *> &out_items, df::unit *unit, df::item_type item_type,
     int16_t item_subtype, int16_t mat_type, int32_t mat_index, bool no_floor)
 {   // Based on Quietust's plugins/createitem.cpp
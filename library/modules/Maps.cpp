@@ -69,6 +69,8 @@ distribution.
 #include <set>
 #include <cstdlib>
 #include <iostream>
+#include <algorithm>
+#include <bit>
 
 using std::max;
 using std::min;
@@ -1263,3 +1265,207 @@ int Maps::removeAreaAquifer(df::coord pos1, df::coord pos2, std::function<bool(d
 
     return totalAffectedCount;
 }
+
+/*
+ * Flood fill
+ */
+
+void Maps::TileBitmap::reset(const BlockGrid &new_grid) {
+    grid = new_grid;
+    slots.assign(grid.size(), -1);
+    bits.clear();
+    origins.clear();
+}
+
+Maps::TileBitmap::rows_type &Maps::TileBitmap::rowsAt(const df::coord &pos) {
+    int32_t &slot = slots[grid.index(pos)];
+    if (slot < 0) {
+        slot = bits.size();
+        bits.emplace_back().fill(0);
+        origins.emplace_back(pos.x & ~15, pos.y & ~15, pos.z);
+    }
+    return bits[slot];
+}
+
+bool Maps::TileBitmap::set(const df::coord &pos) {
+    if (!grid.contains(pos))
+        return false;
+    uint16_t &row = rowsAt(pos)[pos.y & 15];
+    uint16_t mask = 1 << (pos.x & 15);
+    if (row & mask)
+        return false;
+    row |= mask;
+    return true;
+}
+
+void Maps::TileBitmap::setRow(const df::coord &pos, int16_t x2) {
+    df::coord cur = pos;
+    while (cur.x <= x2 && grid.contains(cur)) {
+        int16_t end = min<int16_t>(x2, cur.x | 15);
+        unsigned lo = cur.x & 15, len = end - cur.x + 1;
+        rowsAt(cur)[cur.y & 15] |= uint16_t(((1u << len) - 1) << lo);
+        cur.x = end + 1;
+    }
+}
+
+size_t Maps::TileBitmap::count() const {
+    size_t total = 0;
+    for (auto &rows : bits) {
+        for (uint16_t row : rows)
+            total += std::popcount(row);
+    }
+    return total;
+}
+
+void Maps::TileBitmap::forBlock(std::function<void(const df::coord &, const rows_type &)> fn) const {
+    for (size_t slot = 0; slot < bits.size(); ++slot)
+        fn(origins[slot], bits[slot]);
+}
+
+void Maps::TileBitmap::forSpan(std::function<void(const df::coord &, int16_t)> fn) const {
+    for (size_t slot = 0; slot < bits.size(); ++slot) {
+        const df::coord &origin = origins[slot];
+        for (int16_t y = 0; y < 16; ++y) {
+            unsigned row = bits[slot][y];
+            while (row) {
+                int x = std::countr_zero(row);
+                int len = std::countr_one(row >> x);
+                fn(df::coord(origin.x + x, origin.y + y, origin.z), len);
+                row &= ~(((1u << len) - 1) << x);
+            }
+        }
+    }
+}
+
+size_t Maps::floodFill(TileBitmap &flooded, const BlockGrid &grid, const df::coord &start,
+    std::function<bool(const df::coord &)> passable, const FloodOptions &opts)
+{
+    flooded.reset(grid);
+    if (!grid.contains(start) || !passable(start))
+        return 0;
+
+    const int16_t x_max = grid.x_blocks * 16 - 1;
+    const int16_t y_max = grid.y_blocks * 16 - 1;
+    const int16_t d = opts.diagonal ? 1 : 0;
+
+    // each seed is a passable tile; its whole row run gets filled when it is popped
+    vector<df::coord> seeds;
+    seeds.push_back(start);
+
+    // pushes a seed for each run of tiles in [x1, x2] that accept() takes
+    auto scan = [&](int16_t x1, int16_t x2, int16_t y, int16_t z, auto &&accept) {
+        bool in_run = false;
+        for (int16_t x = x1; x <= x2; ++x) {
+            df::coord pos(x, y, z);
+            bool ok = !flooded.get(pos) && passable(pos) && accept(pos);
+            if (ok && !in_run)
+                seeds.push_back(pos);
+            in_run = ok;
+        }
+    };
+    auto any = [](const df::coord &) { return true; };
+
+    size_t count = 0;
+    while (!seeds.empty()) {
+        df::coord seed = seeds.back();
+        seeds.pop_back();
+        if (flooded.get(seed))
+            continue;
+
+        int16_t x1 = seed.x, x2 = seed.x, y = seed.y, z = seed.z;
+        while (x1 > 0 && !flooded.get(df::coord(x1 - 1, y, z)) && passable(df::coord(x1 - 1, y, z)))
+            --x1;
+        while (x2 < x_max && !flooded.get(df::coord(x2 + 1, y, z)) && passable(df::coord(x2 + 1, y, z)))
+            ++x2;
+        flooded.setRow(df::coord(x1, y, z), x2);
+        count += x2 - x1 + 1;
+
+        int16_t lo = max<int16_t>(0, x1 - d), hi = min<int16_t>(x_max, x2 + d);
+        if (y > 0)
+            scan(lo, hi, y - 1, z, any);
+        if (y < y_max)
+            scan(lo, hi, y + 1, z, any);
+        if (opts.up && z + 1 < grid.z_levels) {
+            scan(x1, x2, y, z + 1, [&](const df::coord &to) {
+                return opts.up(df::coord(to.x, y, z), to);
+            });
+        }
+        if (opts.down && z > 0) {
+            scan(x1, x2, y, z - 1, [&](const df::coord &to) {
+                return opts.down(df::coord(to.x, y, z), to);
+            });
+        }
+    }
+    return count;
+}
+
+/*
+ * Tile snapshots
+ */
+
+void Maps::TileSnapshot::reset(const cuboid &new_bounds, uint32_t new_fields) {
+    bounds = new_bounds;
+    fields = new_fields;
+    size_t size = 0;
+    if (bounds.isValid()) {
+        dim_x = bounds.x_max - bounds.x_min + 1;
+        dim_y = bounds.y_max - bounds.y_min + 1;
+        size = size_t(dim_x) * dim_y * (bounds.z_max - bounds.z_min + 1);
+    } else {
+        bounds.clear();
+        dim_x = dim_y = 0;
+    }
+
+    present.assign(size, 0);
+    tiletypes.assign((fields & FIELD_TILETYPE) ? size : 0, 0);
+    designations.assign((fields & FIELD_DESIGNATION) ? size : 0, 0);
+    occupancies.assign((fields & FIELD_OCCUPANCY) ? size : 0, 0);
+    walkable.assign((fields & FIELD_WALKABLE) ? size : 0, 0);
+    liquid.assign((fields & FIELD_LIQUID) ? size : 0, 0);
+}
+
+size_t Maps::TileSnapshot::refresh() {
+    return refresh(bounds);
+}
+
+size_t Maps::TileSnapshot::refresh(const cuboid &area) {
+    cuboid c = area.clampNew(bounds);
+    if (!c.isValid())
+        return 0;
+
+    // tiles in blocks that have gone away have no data
+    for (int16_t z = c.z_min; z <= c.z_max; ++z) {
+        for (int16_t y = c.y_min; y <= c.y_max; ++y) {
+            size_t idx = index(df::coord(c.x_min, y, z));
+            std::fill_n(present.begin() + idx, c.x_max - c.x_min + 1, 0);
+        }
+    }
+
+    size_t count = 0;
+    c.forBlock([&](df::map_block *block, cuboid inter) {
+        copyBlock(block, inter);
+        ++count;
+        return true;
+    });
+    return count;
+}
+
+void Maps::TileSnapshot::copyBlock(const df::map_block *block, const cuboid &area) {
+    for (int16_t y = area.y_min; y <= area.y_max; ++y) {
+        size_t idx = index(df::coord(area.x_min, y, area.z_min));
+        for (int16_t x = area.x_min; x <= area.x_max; ++x, ++idx) {
+            int bx = x & 15, by = y & 15;
+            present[idx] = 1;
+            if (fields & FIELD_TILETYPE)
+                tiletypes[idx] = block->tiletype[bx][by];
+            if (fields & FIELD_DESIGNATION)
+                designations[idx] = block->designation[bx][by].whole;
+            if (fields & FIELD_OCCUPANCY)
+                occupancies[idx] = block->occupancy[bx][by].whole;
+            if (fields & FIELD_WALKABLE)
+                walkable[idx] = block->walkable[bx][by];
+            if (fields & FIELD_LIQUID)
+                liquid[idx] = block->designation[bx][by].bits.flow_size;
+        }
+    }
+}
@@ -31,6 +31,7 @@ distribution.
 #include "ModuleFactory.h"
 #include "Core.h"
 #include "MiscUtils.h"
+#include "modules/Items.h"
 
 #include "df/plotinfost.h"
 #include "df/item.h"
@@ -45,6 +46,7 @@ distribution.
 #include "df/dfhack_material_category.h"
 #include "df/matter_state.h"
 #include "df/material.h"
+#include "df/material_template.h"
 #include "df/material_vec_ref.h"
 #include "df/descriptor_color.h"
 #include "df/descriptor_pattern.h"
@@ -57,6 +59,7 @@ distribution.
 
 #include <string>
 #include <vector>
+#include <algorithm>
 #include <map>
 #include <cstring>
 
@@ -236,13 +239,9 @@ bool MaterialInfo::findInorganic(const std::string &token)
         return true;
     }
 
-    df::world_raws &raws = world->raws;
-    for (size_t i = 0; i < raws.inorganics.size(); i++)
-    {
-        df::inorganic_raw *p = raws.inorganics[i];
-        if (p->id == token)
-            return decode(0, i);
-    }
+    int32_t idx = RawTokens::findInorganic(token);
+    if (idx >= 0)
+        return decode(0, idx);
     return decode(-1);
 }
 
@@ -250,23 +249,19 @@ bool MaterialInfo::findPlant(const std::string &token, const std::string &subtok
 {
     if (token.empty())
         return decode(-1);
-    df::world_raws &raws = world->raws;
-    for (size_t i = 0; i < raws.plants.all.size(); i++)
-    {
-        df::plant_raw *p = raws.plants.all[i];
-        if (p->id != token)
-            continue;
+    int32_t i = RawTokens::findPlant(token);
+    if (i < 0)
+        return decode(-1);
+    df::plant_raw *p = world->raws.plants.all[i];
 
-        // As a special exception, return the structural material with empty subtoken
-        if (subtoken.empty())
-            return decode(p->material_defs.type[plant_material_def::basic_mat], p->material_defs.idx[plant_material_def::basic_mat]);
+    // As a special exception, return the structural material with empty subtoken
+    if (subtoken.empty())
+        return decode(p->material_defs.type[plant_material_def::basic_mat], p->material_defs.idx[plant_material_def::basic_mat]);
 
-        for (size_t j = 0; j < p->material.size(); j++)
-            if (p->material[j]->id == subtoken)
-                return decode(PLANT_BASE+j, i);
+    for (size_t j = 0; j < p->material.size(); j++)
+        if (p->material[j]->id == subtoken)
+            return decode(PLANT_BASE+j, i);
 
-        break;
-    }
     return decode(-1);
 }
 
@@ -274,19 +269,15 @@ bool MaterialInfo::findCreature(const std::string &token, const std::string &sub
 {
     if (token.empty() || subtoken.empty())
         return decode(-1);
-    df::world_raws &raws = world->raws;
-    for (size_t i = 0; i < raws.creatures.all.size(); i++)
-    {
-        df::creature_raw *p = raws.creatures.all[i];
-        if (p->creature_id != token)
-            continue;
+    int32_t i = RawTokens::findCreature(token);
+    if (i < 0)
+        return decode(-1);
+    df::creature_raw *p = world->raws.creatures.all[i];
 
-        for (size_t j = 0; j < p->material.size(); j++)
-            if (p->material[j]->id == subtoken)
-                return decode(CREATURE_BASE+j, i);
+    for (size_t j = 0; j < p->material.size(); j++)
+        if (p->material[j]->id == subtoken)
+            return decode(CREATURE_BASE+j, i);
 
-        break;
-    }
     return decode(-1);
 }
 
@@ -600,6 +591,129 @@ bool DFHack::isStoneInorganic(int material)
     return true;
 }
 
+namespace {
+    /*
+     * Sorted (token, index) pairs for one raws vector. The size and address
+     * of the first element are remembered so that a reallocated or resized
+     * vector is noticed even if the state change hook was missed.
+     */
+    struct token_index {
+        bool valid = false;
+        size_t size = 0;
+        const void *first = NULL;
+        std::vector<std::pair<std::string, int32_t>> entries;
+
+        template<class F>
+        void refresh(size_t n, const void *head, F get_id)
+        {
+            if (valid && size == n && first == head)
+                return;
+
+            entries.clear();
+            entries.reserve(n);
+            for (size_t i = 0; i < n; i++)
+                entries.emplace_back(get_id(i), int32_t(i));
+
+            // stable so that the first of several duplicate ids wins, matching
+            // the behavior of the linear scans this replaces
+            std::stable_sort(entries.begin(), entries.end(),
+                [](const auto &a, const auto &b) { return a.first < b.first; });
+
+            valid = true;
+            size = n;
+            first = head;
+        }
+
+        template<class T>
+        void refresh(const std::vector<T*> &vec)
+        {
+            refresh(vec.size(), vec.empty() ? NULL : vec[0],
+                [&](size_t i) -> const std::string & { return vec[i]->id; });
+        }
+
+        int32_t lookup(const std::string &token) const
+        {
+            auto it = std::lower_bound(entries.begin(), entries.end(), token,
+                [](const auto &a, const std::string &b) { return a.first < b; });
+            if (it == entries.end() || it->first != token)
+                return -1;
+            return it->second;
+        }
+    };
+
+    token_index inorganic_tokens;
+    token_index plant_tokens;
+    token_index creature_tokens;
+    token_index template_tokens;
+    std::map<df::item_type, token_index> itemdef_tokens;
+}
+
+int32_t RawTokens::findInorganic(const std::string &token)
+{
+    if (!world)
+        return -1;
+    inorganic_tokens.refresh(world->raws.inorganics);
+    return inorganic_tokens.lookup(token);
+}
+
+int32_t RawTokens::findPlant(const std::string &token)
+{
+    if (!world)
+        return -1;
+    plant_tokens.refresh(world->raws.plants.all);
+    return plant_tokens.lookup(token);
+}
+
+int32_t RawTokens::findCreature(const std::string &token)
+{
+    if (!world)
+        return -1;
+    auto &vec = world->raws.creatures.all;
+    creature_tokens.refresh(vec.size(), vec.empty() ? NULL : vec[0],
+        [&](size_t i) -> const std::string & { return vec[i]->creature_id; });
+    return creature_tokens.lookup(token);
+}
+
+int32_t RawTokens::findMaterialTemplate(const std::string &token)
+{
+    if (!world)
+        return -1;
+    template_tokens.refresh(world->raws.material_templates);
+    return template_tokens.lookup(token);
+}
+
+int32_t RawTokens::findItemdef(df::item_type type, const std::string &token)
+{
+    int count = Items::getSubtypeCount(type);
+    if (count <= 0)
+        return -1;
+    auto &index = itemdef_tokens[type];
+    index.refresh(count, Items::getSubtypeDef(type, 0),
+        [&](size_t i) -> const std::string & { return Items::getSubtypeDef(type, i)->id; });
+    return index.lookup(token);
+}
+
+void RawTokens::invalidate()
+{
+    inorganic_tokens = token_index();
+    plant_tokens = token_index();
+    creature_tokens = token_index();
+    template_tokens = token_index();
+    itemdef_tokens.clear();
+}
+
+void materials_onStateChange(color_ostream &out, state_change_event event)
+{
+    switch (event) {
+    case SC_WORLD_LOADED:
+    case SC_WORLD_UNLOADED:
+        RawTokens::invalidate();
+        break;
+    default:
+        break;
+    }
+}
+
 std::unique_ptr<Module> DFHack::createMaterials()
 {
     return std::make_unique<Materials>();
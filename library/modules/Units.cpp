@@ -86,6 +86,7 @@ distribution.
 #include <cstring>
 #include <functional>
 #include <map>
+#include <memory>
 #include <numeric>
 #include <stddef.h>
 #include <string>
@@ -662,6 +663,15 @@ bool Units::isUnitInBox(df::unit *u, const cuboid &box) {
     return box.containsPos(getPosition(u));
 }
 
+static id_index<df::unit> unit_index;
+
+df::unit *Units::findUnitByID(int32_t id) {
+    if (!world)
+        return NULL;
+    using df::global::unit_next_id;
+    return unit_index.find(world->units.all, id, unit_next_id ? *unit_next_id : -1);
+}
+
 bool Units::getUnitsInBox(vector<df::unit *> &units, const cuboid &box, std::function<bool(df::unit *)> filter) {
     if (!world)
         return false;
@@ -742,6 +752,106 @@ bool Units::getCitizens(vector<df::unit *> &citizens, bool exclude_residents, bo
     return true;
 }
 
+static std::shared_ptr<Units::UnitClasses> unit_classes;
+static bool unit_classes_valid = false;
+
+static uint64_t classify_unit(df::unit *unit) {
+    using namespace Units;
+    using namespace Units::UnitClass;
+    uint64_t flags = 0;
+    auto set = [&](uint64_t bit, bool value) {
+        if (value)
+            flags |= bit;
+    };
+    set(ACTIVE, isActive(unit));
+    set(DEAD, isDead(unit));
+    set(UNDEAD, isUndead(unit));
+    set(CITIZEN, isCitizen(unit));
+    set(CITIZEN_INSANE, isCitizen(unit, true));
+    set(RESIDENT, isResident(unit));
+    set(RESIDENT_INSANE, isResident(unit, true));
+    set(OWN_CIV, isOwnCiv(unit));
+    set(OWN_RACE, isOwnRace(unit));
+    set(ANIMAL, isAnimal(unit));
+    set(TAME, isTame(unit));
+    set(DOMESTICATED, isDomesticated(unit));
+    set(PET, isPet(unit));
+    set(AVAILABLE_FOR_ADOPTION, isAvailableForAdoption(unit));
+    set(WAR, isWar(unit));
+    set(HUNTER, isHunter(unit));
+    set(MARKED_FOR_SLAUGHTER, isMarkedForSlaughter(unit));
+    set(MARKED_FOR_TRAINING, isMarkedForTraining(unit));
+    set(MARKED_FOR_TAMING, isMarkedForTaming(unit));
+    set(MARKED_FOR_WAR_TRAINING, isMarkedForWarTraining(unit));
+    set(MARKED_FOR_HUNT_TRAINING, isMarkedForHuntTraining(unit));
+    set(MARKED_FOR_GELDING, isMarkedForGelding(unit));
+    set(GELDED, isGelded(unit));
+    set(EGG_LAYER, isEggLayer(unit));
+    set(GRAZER, isGrazer(unit));
+    set(MILKABLE, isMilkable(unit));
+    set(MERCHANT, isMerchant(unit));
+    set(FOREST, isForest(unit));
+    set(VISITOR, isVisitor(unit));
+    set(INVADER, isInvader(unit));
+    set(BABY, isBaby(unit));
+    set(CHILD, isChild(unit));
+    set(ADULT, isAdult(unit));
+    set(MALE, isMale(unit));
+    set(FEMALE, isFemale(unit));
+    set(GAY, isGay(unit));
+    return flags;
+}
+
+static void build_unit_classes(Units::UnitClasses &classes, const vector<df::unit *> &active) {
+    using namespace Units::UnitClass;
+    classes.units.assign(active.begin(), active.end());
+    classes.flags.resize(active.size());
+    classes.citizens.clear();
+    classes.tame.clear();
+    // keep the per-race vectors around; a fort's races rarely change
+    for (auto &entry : classes.races)
+        entry.second.clear();
+
+    for (uint32_t idx = 0; idx < active.size(); idx++) {
+        df::unit *unit = active[idx];
+        uint64_t flags = classify_unit(unit);
+        classes.flags[idx] = flags;
+        classes.races[unit->race].push_back(idx);
+        if (!(flags & ACTIVE) || (flags & DEAD))
+            continue;
+        if (flags & (CITIZEN_INSANE | RESIDENT_INSANE))
+            classes.citizens.push_back(idx);
+        if (flags & TAME)
+            classes.tame.push_back(idx);
+    }
+}
+
+std::shared_ptr<const Units::UnitClasses> Units::getUnitClasses() {
+    if (!world) {
+        static auto none = std::make_shared<const UnitClasses>();
+        return none;
+    }
+    if (!unit_classes)
+        unit_classes = std::make_shared<UnitClasses>();
+
+    // units can come and go within a frame, e.g. when a tool creates one
+    auto &active = world->units.active;
+    if (unit_classes_valid && std::equal(active.begin(), active.end(),
+            unit_classes->units.begin(), unit_classes->units.end()))
+        return unit_classes;
+
+    // don't rebuild under a caller that is still iterating the old one
+    if (unit_classes.use_count() > 1)
+        unit_classes = std::make_shared<UnitClasses>();
+    build_unit_classes(*unit_classes, active);
+    unit_classes_valid = true;
+    return unit_classes;
+}
+
+void Units::clearUnitClasses() {
+    unit_classes_valid = false;
+}
+
 df::coord Units::getPosition(df::unit *unit) {
     CHECK_NULL_POINTER(unit);
     if (unit->flags1.bits.caged) {
@@ -23,6 +23,7 @@ distribution.
 */
 
 
+#include "Core.h"
 #include "Internal.h"
 
 #include "modules/Gui.h"
@@ -41,6 +42,10 @@ distribution.
 #include "df/world_data.h"
 #include "df/world_site.h"
 
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
 using std::string;
 
 using namespace DFHack;
@@ -286,6 +291,56 @@ bool World::DeletePersistentData(const PersistentDataItem &item) {
     return Persistence::deleteItem(item);
 }
 
+/*
+ * The blocks that carry a tilemask, by the fake df id of the persistent item
+ * that owns it. Built from the map on first use and kept up to date by
+ * getPersistentTilemask and deletePersistentTilemask after that. Masks removed
+ * by other means leave stale entries, which are dropped when they are noticed.
+ */
+static std::unordered_map<int, std::unordered_set<df::map_block *>> tilemask_blocks;
+static bool tilemask_blocks_built = false;
+
+void world_onStateChange(color_ostream &out, state_change_event event) {
+    switch (event) {
+    case SC_MAP_LOADED:
+    case SC_MAP_UNLOADED:
+    case SC_WORLD_UNLOADED:
+        tilemask_blocks.clear();
+        tilemask_blocks_built = false;
+        break;
+    default:
+        break;
+    }
+}
+
+static df::block_square_event_world_constructionst *get_tilemask_event(df::map_block *block, int id) {
+    for (auto ev : block->block_events) {
+        if (ev->getType() != block_square_event_type::world_construction)
+            continue;
+        auto wcsev = strict_virtual_cast<df::block_square_event_world_constructionst>(ev);
+        if (wcsev && wcsev->construction_id == id)
+            return wcsev;
+    }
+    return NULL;
+}
+
+static void build_tilemask_blocks() {
+    if (tilemask_blocks_built || !world)
+        return;
+
+    tilemask_blocks.clear();
+    for (auto block : world->map.map_blocks) {
+        for (auto ev : block->block_events) {
+            if (ev->getType() != block_square_event_type::world_construction)
+                continue;
+            auto wcsev = strict_virtual_cast<df::block_square_event_world_constructionst>(ev);
+            if (wcsev && wcsev->construction_id <= -100)
+                tilemask_blocks[wcsev->construction_id].insert(block);
+        }
+    }
+    tilemask_blocks_built = true;
+}
+
 df::tile_bitmask *World::getPersistentTilemask(PersistentDataItem &item, df::map_block *block, bool create) {
     if (!block)
         return NULL;
@@ -294,14 +349,8 @@ df::tile_bitmask *World::getPersistentTilemask(PersistentDataItem &item, df::map
     if (id > -100)
         return NULL;
 
-    for (auto ev : block->block_events) {
-        if (ev->getType() != block_square_event_type::world_construction)
-            continue;
-        auto wcsev = strict_virtual_cast<df::block_square_event_world_constructionst>(ev);
-        if (!wcsev || wcsev->construction_id != id)
-            continue;
+    if (auto wcsev = get_tilemask_event(block, id))
         return &wcsev->tile_bitmask;
-    }
 
     if (!create)
         return NULL;
@@ -313,6 +362,8 @@ df::tile_bitmask *World::getPersistentTilemask(PersistentDataItem &item, df::map
     ev->construction_id = id;
     ev->tile_bitmask.clear();
     vector_insert_at(block->block_events, 0, (df::block_square_event*)ev);
+    if (tilemask_blocks_built)
+        tilemask_blocks[id].insert(block);
 
     return &ev->tile_bitmask;
 }
@@ -339,5 +390,37 @@ bool World::deletePersistentTilemask(PersistentDataItem &item, df::map_block *bl
         found = true;
     }
 
+    if (tilemask_blocks_built) {
+        auto it = tilemask_blocks.find(id);
+        if (it != tilemask_blocks.end()) {
+            it->second.erase(block);
+            if (it->second.empty())
+                tilemask_blocks.erase(it);
+        }
+    }
+
     return found;
 }
+
+void World::getPersistentTilemaskBlocks(std::vector<df::map_block *> *vec, PersistentDataItem &item) {
+    int id = item.fake_df_id();
+    if (!vec || id > -100)
+        return;
+
+    build_tilemask_blocks();
+    auto it = tilemask_blocks.find(id);
+    if (it == tilemask_blocks.end())
+        return;
+
+    auto &blocks = it->second;
+    for (auto bit = blocks.begin(); bit != blocks.end(); ) {
+        if (get_tilemask_event(*bit, id)) {
+            vec->push_back(*bit);
+            ++bit;
+        } else {
+            bit = blocks.erase(bit);
+        }
+    }
+    if (blocks.empty())
+        tilemask_blocks.erase(it);
+}
@@ -29,6 +29,7 @@
 #include <iomanip>
 #include <map>
 #include <algorithm>
+#include <thread>
 #include <vector>
 #include <math.h>
 
@@ -273,7 +274,7 @@ struct GeoBlock
     GeoColumn *column;
     df::coord pos;
 
-    uint16_t arena_mask, arena_unmined;
+    uint16_t arena_mask;
     int16_t arena_material;
 
     df::tile_bitmask unmined;
@@ -285,8 +286,8 @@ struct GeoBlock
         memset(material, -1, sizeof(material));
     }
 
-    bool prepare_arena(int16_t env_material, NoiseFunction::Ptr fn);
-    int measure_placement(float threshold);
+    bool prepare_arena(int16_t env_material, const NoiseFunction::Ptr &fn);
+    void collect_unmined_weights(std::vector<float> &out);
     void place_tiles(float threshold, int16_t new_material, df::inclusion_type itype);
 };
 
@@ -1119,9 +1120,9 @@ void VeinGenerator::write_block_tiles(Block *b, df::coord2d column, int z)
  * Vein placement code
  */
 
-bool GeoBlock::prepare_arena(int16_t basemat, NoiseFunction::Ptr fn)
+bool GeoBlock::prepare_arena(int16_t basemat, const NoiseFunction::Ptr &fn)
 {
-    arena_mask = arena_unmined = 0;
+    arena_mask = 0;
     arena_material = basemat;
 
     df::coord origin = pos + layer->world_pos;
@@ -1140,37 +1141,25 @@ bool GeoBlock::prepare_arena(int16_t basemat, NoiseFunction::Ptr fn)
             weight[x][y] = fn->eval(x0+x, y0+y, z);
 
             arena_mask |= (1<<x);
-            if (unmined.getassignment(x,y))
-                arena_unmined |= (1<<x);
         }
     }
 
     return arena_mask != 0;
 }
 
-int GeoBlock::measure_placement(float threshold)
+void GeoBlock::collect_unmined_weights(std::vector<float> &out)
 {
-    if (!arena_unmined)
-        return 0;
-
-    int count = 0;
-
     for (int x = 0; x < 16; x++)
     {
-        if ((arena_unmined & (1<<x)) == 0)
+        if ((arena_mask & (1<<x)) == 0)
             continue;
 
         for (int y = 0; y < 16; y++)
         {
-            if (material[x][y] != arena_material || weight[x][y] < threshold)
-                continue;
-
-            if (unmined.getassignment(x,y))
-                count++;
+            if (material[x][y] == arena_material && unmined.getassignment(x,y))
+                out.push_back(weight[x][y]);
         }
     }
-
-    return count;
 }
 
 void GeoBlock::place_tiles(float threshold, int16_t new_material, df::inclusion_type itype)
@@ -1191,12 +1180,35 @@ void GeoBlock::place_tiles(float threshold, int16_t new_material, df::inclusion_
     }
 }
 
-static int measure(const std::vector<GeoBlock*> &arena, float threshold)
+/*
+ * Calls fn(begin, end) for contiguous slices of [0, count) from several
+ * threads. The slices depend only on count, and fn must only touch the
+ * elements of its own slice, so the outcome is the same as a serial run.
+ */
+template<class F>
+static void parallel_slices(size_t count, F fn)
 {
-    int count = 0;
-    for (size_t i = 0; i < arena.size(); i++)
-        count += arena[i]->measure_placement(threshold);
-    return count;
+    const size_t MIN_SLICE = 16;
+
+    size_t nthreads = std::max(1u, std::thread::hardware_concurrency());
+    nthreads = std::min(nthreads, (count + MIN_SLICE - 1) / MIN_SLICE);
+
+    if (nthreads <= 1)
+    {
+        fn(size_t(0), count);
+        return;
+    }
+
+    size_t step = (count + nthreads - 1) / nthreads;
+    std::vector<std::thread> workers;
+
+    for (size_t begin = step; begin < count; begin += step)
+        workers.emplace_back(fn, begin, std::min(count, begin + step));
+
+    fn(size_t(0), step);
+
+    for (auto &t : workers)
+        t.join();
 }
 
 void VeinExtent::link(GeoLayer *layer)
@@ -1237,21 +1249,38 @@ void VeinExtent::merge_into(Ptr target)
 
 void VeinExtent::place_tiles()
 {
-    std::vector<GeoBlock*> arena;
+    std::vector<GeoBlock*> blocks, arena;
 
     int env_material = parent_mat();
 
     for (size_t i = 0; i < layers.size(); i++)
     {
         auto layer = layers[i];
+        blocks.insert(blocks.end(), layer->block_list.begin(), layer->block_list.end());
+    }
 
-        for (auto bit = layer->block_list.begin(); bit != layer->block_list.end(); ++bit)
-        {
-            if ((*bit)->prepare_arena(env_material, distribution))
-                arena.push_back(*bit);
-        }
+    // Evaluating the noise is the expensive part, and every block
+    // only reads and writes its own arena, so split it over threads.
+    std::vector<uint8_t> in_arena(blocks.size());
+
+    parallel_slices(blocks.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+            in_arena[i] = blocks[i]->prepare_arena(env_material, distribution);
+    });
+
+    for (size_t i = 0; i < blocks.size(); i++)
+    {
+        if (in_arena[i])
+            arena.push_back(blocks[i]);
     }
 
+    // With the weights of all unmined candidate tiles sorted, the
+    // number of tiles at or above a threshold is a single lookup.
+    std::vector<float> weights;
+    for (size_t i = 0; i < arena.size(); i++)
+        arena[i]->collect_unmined_weights(weights);
+    std::sort(weights.begin(), weights.end());
+
     // Binary search to meet the required number
     auto range = distribution->range();
     float mid;
@@ -1259,7 +1288,8 @@ void VeinExtent::place_tiles()
     for (int i = 0; i < 32; i++) // iteration limit
     {
         mid = (range.first + range.second) / 2;
-        int count = placed_tiles = measure(arena, mid);
+        int count = placed_tiles =
+            weights.end() - std::lower_bound(weights.begin(), weights.end(), mid);
 
         if (count == num_tiles)
             break;
@@ -1,19 +1,89 @@
 #pragma once
 #include <llimits.h>
+#include <algorithm>
+#include <bit>
+#include <functional>
 #include <sstream>
 #include <string>
-#include <stack>
-#include <set>
 
 typedef vector <df::coord> coord_vec;
+// the tiles of one block that a brush covers: bit x of rows[y] is tile (x, y)
+typedef DFHack::Maps::TileBitmap::rows_type brush_rows;
+typedef std::function<void(const df::coord &origin, const brush_rows &rows)> brush_block_fn;
+
+// calls fn with the block-relative position of each tile in rows, row by row
+template<typename Fn>
+inline void forBrushTiles(const brush_rows &rows, Fn fn)
+{
+    for (int16_t y = 0; y < 16; y++)
+    {
+        unsigned row = rows[y];
+        while (row)
+        {
+            fn(df::coord2d(std::countr_zero(row), y));
+            row &= row - 1;
+        }
+    }
+}
+
 class Brush
 {
 public:
     virtual ~Brush(){};
-    virtual coord_vec points(MapExtras::MapCache & mc,DFHack::DFCoord start) = 0;
+    /**
+     * Calls fn once for each existing map block that the brush covers when
+     * placed at start, with the block's corner tile and the covered tiles of
+     * the block. Nothing is collected up front, so painting a huge area only
+     * ever holds one block's worth of brush data.
+     */
+    virtual void forBlocks(MapExtras::MapCache & mc, DFHack::DFCoord start, brush_block_fn fn) = 0;
+    // every covered tile; use forBlocks for anything that can be large
+    coord_vec points(MapExtras::MapCache & mc, DFHack::DFCoord start)
+    {
+        coord_vec v;
+        forBlocks(mc, start, [&](const df::coord &origin, const brush_rows &rows) {
+            forBrushTiles(rows, [&](const df::coord2d &pos) {
+                v.emplace_back(origin.x + pos.x, origin.y + pos.y, origin.z);
+            });
+        });
+        return v;
+    }
     virtual std::string str() const {
         return "unknown";
     }
+protected:
+    // reports the blocks of the cuboid from lo to hi, clipped to the map
+    static void forCuboid(MapExtras::MapCache & mc, df::coord lo, df::coord hi, const brush_block_fn &fn)
+    {
+        int32_t x_blocks, y_blocks, z_levels;
+        DFHack::Maps::getSize(x_blocks, y_blocks, z_levels);
+        lo.x = std::max<int16_t>(lo.x, 0);
+        lo.y = std::max<int16_t>(lo.y, 0);
+        lo.z = std::max<int16_t>(lo.z, 0);
+        hi.x = std::min<int16_t>(hi.x, x_blocks * 16 - 1);
+        hi.y = std::min<int16_t>(hi.y, y_blocks * 16 - 1);
+        hi.z = std::min<int16_t>(hi.z, z_levels - 1);
+
+        for (int16_t z = lo.z; z <= hi.z; z++)
+        {
+            for (int16_t by = lo.y & ~15; by <= hi.y; by += 16)
+            {
+                for (int16_t bx = lo.x & ~15; bx <= hi.x; bx += 16)
+                {
+                    df::coord origin(bx, by, z);
+                    if (!mc.testCoord(origin))
+                        continue;
+                    int x1 = std::max(lo.x, bx) - bx, x2 = std::min<int>(hi.x, bx + 15) - bx;
+                    int y1 = std::max(lo.y, by) - by, y2 = std::min<int>(hi.y, by + 15) - by;
+                    brush_rows rows{};
+                    uint16_t mask = uint16_t(((1u << (x2 - x1 + 1)) - 1) << x1);
+                    for (int y = y1; y <= y2; y++)
+                        rows[y] = mask;
+                    fn(origin, rows);
+                }
+            }
+        }
+    }
 };
 /**
  * generic 3D rectangle brush. you can specify the dimensions of
@@ -40,28 +110,10 @@ public:
         y_ = y;
         z_ = z;
     };
-    coord_vec points(MapExtras::MapCache & mc, DFHack::DFCoord start)
+    void forBlocks(MapExtras::MapCache & mc, DFHack::DFCoord start, brush_block_fn fn)
     {
-        coord_vec v;
-        DFHack::DFCoord iterstart(start.x - cx_, start.y - cy_, start.z - cz_);
-        DFHack::DFCoord iter = iterstart;
-        for(int xi = 0; xi < x_; xi++)
-        {
-            for(int yi = 0; yi < y_; yi++)
-            {
-                for(int zi = 0; zi < z_; zi++)
-                {
-                    if(mc.testCoord(iter))
-                        v.push_back(iter);
-                    iter.z++;
-                }
-                iter.z = iterstart.z;
-                iter.y++;
-            }
-            iter.y = iterstart.y;
-            iter.x ++;
-        }
-        return v;
+        df::coord lo(start.x - cx_, start.y - cy_, start.z - cz_);
+        forCuboid(mc, lo, df::coord(lo.x + x_ - 1, lo.y + y_ - 1, lo.z + z_ - 1), fn);
     };
     ~RectangleBrush(){};
     std::string str() const {
@@ -89,25 +141,10 @@ class BlockBrush : public Brush
 public:
     BlockBrush(){};
     ~BlockBrush(){};
-    coord_vec points(MapExtras::MapCache & mc, DFHack::DFCoord start)
+    void forBlocks(MapExtras::MapCache & mc, DFHack::DFCoord start, brush_block_fn fn)
     {
-        coord_vec v;
-        DFHack::DFCoord blockc = start / 16;
-        DFHack::DFCoord iterc = blockc * 16;
-        if( !mc.testCoord(start) )
-            return v;
-        auto starty = iterc.y;
-        for(int xi = 0; xi < 16; xi++)
-        {
-            for(int yi = 0; yi < 16; yi++)
-            {
-                v.push_back(iterc);
-                iterc.y++;
-            }
-            iterc.y = starty;
-            iterc.x ++;
-        }
-        return v;
+        df::coord origin(start.x & ~15, start.y & ~15, start.z);
+        forCuboid(mc, origin, df::coord(origin.x + 15, origin.y + 15, origin.z), fn);
     };
     std::string str() const {
         return "block";
@@ -123,22 +160,22 @@ class ColumnBrush : public Brush
 public:
     ColumnBrush(){};
     ~ColumnBrush(){};
-    coord_vec points(MapExtras::MapCache & mc, DFHack::DFCoord start)
+    void forBlocks(MapExtras::MapCache & mc, DFHack::DFCoord start, brush_block_fn fn)
     {
-        coord_vec v;
         bool juststarted = true;
         while (mc.testCoord(start))
         {
             df::tiletype tt = mc.tiletypeAt(start);
             if(DFHack::LowPassable(tt) || (juststarted && DFHack::HighPassable(tt)))
             {
-                v.push_back(start);
+                brush_rows rows{};
+                rows[start.y & 15] = 1 << (start.x & 15);
+                fn(df::coord(start.x & ~15, start.y & ~15, start.z), rows);
                 juststarted = false;
                 start.z++;
             }
             else break;
         }
-        return v;
     };
     std::string str() const {
         return "column";
@@ -154,57 +191,31 @@ class FloodBrush : public Brush
 public:
     FloodBrush(DFHack::Core *c){c_ = c;};
     ~FloodBrush(){};
-    coord_vec points(MapExtras::MapCache & mc, DFHack::DFCoord start)
+    void forBlocks(MapExtras::MapCache & mc, DFHack::DFCoord start, brush_block_fn fn)
     {
         using namespace DFHack;
-        coord_vec v;
-
-        std::stack<DFCoord> to_flood;
-        to_flood.push(start);
-
-        std::set<DFCoord> seen;
+        auto is_water = [&](const df::coord &pos) {
+            df::tile_designation des = mc.designationAt(pos);
+            return des.bits.flow_size && des.bits.liquid_type == tile_liquid::Water;
+        };
+        Maps::FloodOptions opts;
+        opts.down = [&](const df::coord &from, const df::coord &) {
+            return LowPassable(mc.tiletypeAt(from));
+        };
+        opts.up = [&](const df::coord &from, const df::coord &) {
+            return HighPassable(mc.tiletypeAt(from));
+        };
 
-        while (!to_flood.empty()) {
-            DFCoord xy = to_flood.top();
-            to_flood.pop();
-
-                        df::tile_designation des = mc.designationAt(xy);
-
-            if (seen.find(xy) == seen.end()
-                            && des.bits.flow_size
-                            && des.bits.liquid_type == tile_liquid::Water) {
-                v.push_back(xy);
-                seen.insert(xy);
-
-                maybeFlood(DFCoord(xy.x - 1, xy.y, xy.z), to_flood, mc);
-                maybeFlood(DFCoord(xy.x + 1, xy.y, xy.z), to_flood, mc);
-                maybeFlood(DFCoord(xy.x, xy.y - 1, xy.z), to_flood, mc);
-                maybeFlood(DFCoord(xy.x, xy.y + 1, xy.z), to_flood, mc);
-
-                df::tiletype tt = mc.tiletypeAt(xy);
-                if (LowPassable(tt))
-                {
-                    maybeFlood(DFCoord(xy.x, xy.y, xy.z - 1), to_flood, mc);
-                }
-                if (HighPassable(tt))
-                {
-                    maybeFlood(DFCoord(xy.x, xy.y, xy.z + 1), to_flood, mc);
-                }
-            }
-        }
-
-        return v;
+        Maps::BlockGrid grid;
+        grid.reset();
+        Maps::TileBitmap flooded;
+        Maps::floodFill(flooded, grid, start, is_water, opts);
+        flooded.forBlock(fn);
     }
     std::string str() const {
         return "flood";
     }
 private:
-    void maybeFlood(DFHack::DFCoord c, std::stack<DFHack::DFCoord> &to_flood,
-                    MapExtras::MapCache &mc) {
-        if (mc.testCoord(c)) {
-            to_flood.push(c);
-        }
-    }
     DFHack::Core *c_;
 };
 
@@ -211,6 +211,7 @@ static void doMarkForSlaughter(df::unit *unit) {
         isHighPriority(unit) ? "yes" : "no",
         Units::getAge(unit));
     unit->flags2.bits.slaughter = 1;
+    Units::clearUnitClasses();
 }
 
 // returns true if b should be butchered before a
@@ -647,28 +648,31 @@ static bool isInBuiltCageRoom(df::unit *unit) {
 
 // This can be used to identify completely inappropriate units (dead, undead, not belonging to the fort, ...)
 // that autobutcher should be ignoring.
-static bool isInappropriateUnit(df::unit *unit) {
-    return !Units::isActive(unit)
-        || Units::isUndead(unit)
-        || Units::isMerchant(unit) // ignore merchants' draft animals
-        || Units::isForest(unit) // ignore merchants' caged animals
-        || !Units::isOwnCiv(unit)
+static bool isInappropriateUnit(const Units::UnitClasses &classes, size_t idx) {
+    using namespace Units::UnitClass;
+    df::unit *unit = classes.units[idx];
+    return !classes.is(idx, ACTIVE | OWN_CIV,
+            UNDEAD
+            | MERCHANT // ignore merchants' draft animals
+            | FOREST) // ignore merchants' caged animals
         || (!isContainedInItem(unit) && !hasValidMapPos(unit));
 }
 
 // This can be used to identify protected units that should be counted towards fort totals, but not scheduled
 // for butchering. This way they count towards target quota, so if you order that you want 1 female adult cat
 // and have 2 cats, one of them being a pet, the other gets butchered
-static bool isProtectedUnit(df::unit *unit) {
-    return Units::isWar(unit)    // ignore war dogs etc
-        || Units::isHunter(unit) // ignore hunting dogs etc
-        || Units::isMarkedForWarTraining(unit) // ignore units marked for any kind of training
-        || Units::isMarkedForHuntTraining(unit)
+static bool isProtectedUnit(const Units::UnitClasses &classes, size_t idx) {
+    using namespace Units::UnitClass;
+    df::unit *unit = classes.units[idx];
+    return (classes.flags[idx] & (WAR // ignore war dogs etc
+            | HUNTER // ignore hunting dogs etc
+            | MARKED_FOR_WAR_TRAINING // ignore units marked for any kind of training
+            | MARKED_FOR_HUNT_TRAINING
+            | AVAILABLE_FOR_ADOPTION))
         // ignore creatures in built cages which are defined as rooms to leave zoos alone
         // (TODO: better solution would be to allow some kind of slaughter cages which you can place near the butcher)
         || (isContainedInItem(unit) && isInBuiltCageRoom(unit))  // !!! see comments in isBuiltCageRoom()
         || (unit->pregnancy_timer != 0) // do not butcher pregnant animals (which includes brooding female egglayers)
-        || Units::isAvailableForAdoption(unit)
         || unit->name.has_name
         || !unit->name.nickname.empty();
 }
@@ -692,17 +696,19 @@ static void autobutcher_cycle(color_ostream &out) {
             return;
     }
 
-    for (auto unit : world->units.active) {
+    auto classes = Units::getUnitClasses();
+    for (auto idx : classes->tame) {
         // this check is now divided into two steps, squeezed autowatch into the middle
         // first one ignores completely inappropriate units (dead, undead, not belonging to the fort, ...)
         // then let autowatch add units to the watchlist which will probably start breeding (owned pets, war animals, ...)
         // then process units counting those which can't be butchered (war animals, named pets, ...)
         // so that they are treated as "own stock" as well and count towards the target quota
-        if (isInappropriateUnit(unit)
-            || Units::isMarkedForSlaughter(unit)
-            || !Units::isTame(unit))
+        if (isInappropriateUnit(*classes, idx)
+            || classes->is(idx, Units::UnitClass::MARKED_FOR_SLAUGHTER))
             continue;
 
+        df::unit *unit = classes->units[idx];
+
         WatchedRace *w;
         if (watched_races.count(unit->race)) {
             w = watched_races[unit->race];
@@ -725,7 +731,7 @@ static void autobutcher_cycle(color_ostream &out) {
             // don't butcher protected units, but count them as stock as well
             // this way they count towards target quota, so if you order that you want 1 female adult cat
             // and have 2 cats, one of them being a pet, the other gets butchered
-            if(isProtectedUnit(unit))
+            if(isProtectedUnit(*classes, idx))
                 w->PushProtectedUnit(unit);
             else
                 w->PushButcherableUnit(unit);
@@ -750,61 +756,53 @@ static void autobutcher_cycle(color_ostream &out) {
 // calling method must delete pointer!
 static WatchedRace * checkRaceStocksTotal(color_ostream &out, int race) {
     WatchedRace * w = new WatchedRace(out, race, true, 0, 0, 0, 0);
-    for (auto unit : world->units.active) {
-        if (unit->race != race)
-            continue;
-
-        if (isInappropriateUnit(unit))
+    auto classes = Units::getUnitClasses();
+    for (auto idx : classes->ofRace(race)) {
+        if (isInappropriateUnit(*classes, idx))
             continue;
 
-        w->PushButcherableUnit(unit);
+        w->PushButcherableUnit(classes->units[idx]);
     }
     return w;
 }
 
 WatchedRace * checkRaceStocksProtected(color_ostream &out, int race) {
     WatchedRace * w = new WatchedRace(out, race, true, 0, 0, 0, 0);
-    for (auto unit : world->units.active) {
-        if (unit->race != race)
+    auto classes = Units::getUnitClasses();
+    for (auto idx : classes->ofRace(race)) {
+        if (isInappropriateUnit(*classes, idx))
             continue;
 
-        if (isInappropriateUnit(unit))
-            continue;
-
-        if (!Units::isTame(unit) || isProtectedUnit(unit))
-            w->PushButcherableUnit(unit);
+        if (!classes->is(idx, Units::UnitClass::TAME) || isProtectedUnit(*classes, idx))
+            w->PushButcherableUnit(classes->units[idx]);
     }
     return w;
 }
 
 WatchedRace * checkRaceStocksButcherable(color_ostream &out, int race) {
     WatchedRace * w = new WatchedRace(out, race, true, 0, 0, 0, 0);
-    for (auto unit : world->units.active) {
-        if (unit->race != race)
-            continue;
-
-        if (   isInappropriateUnit(unit)
-            || !Units::isTame(unit)
-            || isProtectedUnit(unit)
+    auto classes = Units::getUnitClasses();
+    for (auto idx : classes->ofRace(race)) {
+        if (   isInappropriateUnit(*classes, idx)
+            || !classes->is(idx, Units::UnitClass::TAME)
+            || isProtectedUnit(*classes, idx)
             )
             continue;
 
-        w->PushButcherableUnit(unit);
+        w->PushButcherableUnit(classes->units[idx]);
     }
     return w;
 }
 
 WatchedRace * checkRaceStocksButcherFlag(color_ostream &out, int race) {
     WatchedRace * w = new WatchedRace(out, race, true, 0, 0, 0, 0);
-    for (auto unit : world->units.active) {
-        if(unit->race != race)
+    auto classes = Units::getUnitClasses();
+    for (auto idx : classes->ofRace(race)) {
+        if (isInappropriateUnit(*classes, idx))
             continue;
 
-        if (isInappropriateUnit(unit))
-            continue;
-
-        if (Units::isMarkedForSlaughter(unit))
-            w->PushButcherableUnit(unit);
+        if (classes->is(idx, Units::UnitClass::MARKED_FOR_SLAUGHTER))
+            w->PushButcherableUnit(classes->units[idx]);
     }
     return w;
 }
@@ -875,31 +873,29 @@ static void autobutcher_setDefaultTargetAll(color_ostream &out, unsigned fk, uns
 }
 
 static void autobutcher_butcherRace(color_ostream &out, int id) {
-    for (auto unit : world->units.active) {
-        if(unit->race != id)
-            continue;
-
-        if(    isInappropriateUnit(unit)
-            || !Units::isTame(unit)
-            || isProtectedUnit(unit)
+    auto classes = Units::getUnitClasses();
+    for (auto idx : classes->ofRace(id)) {
+        if(    isInappropriateUnit(*classes, idx)
+            || !classes->is(idx, Units::UnitClass::TAME)
+            || isProtectedUnit(*classes, idx)
             )
             continue;
 
-        doMarkForSlaughter(unit);
+        doMarkForSlaughter(classes->units[idx]);
     }
 }
 
 // remove butcher flag for all units of a given race
 static void autobutcher_unbutcherRace(color_ostream &out, int id) {
-    for (auto unit : world->units.active) {
-        if(unit->race != id)
-            continue;
-
-        if(isInappropriateUnit(unit) || !Units::isMarkedForSlaughter(unit))
+    auto classes = Units::getUnitClasses();
+    for (auto idx : classes->ofRace(id)) {
+        if(    isInappropriateUnit(*classes, idx)
+            || !classes->is(idx, Units::UnitClass::MARKED_FOR_SLAUGHTER))
             continue;
 
-        unit->flags2.bits.slaughter = 0;
+        classes->units[idx]->flags2.bits.slaughter = 0;
     }
+    Units::clearUnitClasses();
 }
 
 // push autobutcher settings on lua stack
@@ -14,7 +14,10 @@
 #include <queue>
 #include <map>
 #include <iterator>
+#include <chrono>
+#include <climits>
 
+#include "modules/Buildings.h"
 #include "modules/Units.h"
 #include "modules/World.h"
 #include "modules/Maps.h"
@@ -94,6 +97,9 @@ static bool pause_on_error = 1;
 
 static std::vector<int> state_count(5);
 
+// wall time spent in each phase of the last assignment cycle, for "status"
+static std::vector<std::pair<const char*, double>> last_phase_times;
+
 static PersistentDataItem config;
 
 enum ConfigFlags {
@@ -265,9 +271,13 @@ struct dwarf_info_t
 
     df::unit_labor using_labor;
 
+    // cached Units::computeMovementSpeed, which is the same for every labor
+    int movement_speed;
+
     dwarf_info_t(df::unit* dw) : dwarf(dw), state(OTHER),
         clear_all(false), high_skill(0), has_children(false), armed(false),
-        unmanaged_labors_assigned(0), using_labor(df::unit_labor::NONE)
+        unmanaged_labors_assigned(0), using_labor(df::unit_labor::NONE),
+        movement_speed(-1)
     {
         for (int e = TOOL_NONE; e < TOOLS_MAX; e++)
             has_tool[e] = false;
@@ -701,7 +711,7 @@ private:
 
         if (bld != -1)
         {
-            df::building* b = binsearch_in_vector(world->buildings.all, bld);
+            df::building* b = Buildings::findBuildingByID(bld);
 
             // check if this job is the first nonsuspended job on this building; if not, ignore it
             // (except for farms and trade depots)
@@ -1285,7 +1295,9 @@ private:
             }
         }
 
-        score -= Units::computeMovementSpeed(d->dwarf);
+        if (d->movement_speed < 0)
+            d->movement_speed = Units::computeMovementSpeed(d->dwarf);
+        score -= d->movement_speed;
 
         // significantly disfavor dwarves who have unmanaged labors assigned
         score -= 1000 * d->unmanaged_labors_assigned;
@@ -1293,12 +1305,32 @@ private:
         return score;
     }
 
+    typedef std::chrono::steady_clock phase_clock;
+    phase_clock::time_point phase_start;
+    std::vector<std::pair<const char*, double>> phase_times;
+
+    void end_phase(const char* name)
+    {
+        auto now = phase_clock::now();
+        phase_times.emplace_back(name,
+            std::chrono::duration<double, std::milli>(now - phase_start).count());
+        phase_start = now;
+    }
+
+    struct assignment_edge {
+        int score;
+        int labor_idx;
+        int dwarf_idx;
+    };
+
 public:
     void process()
     {
         if (*df::global::process_dig || *df::global::process_jobs)
             return;
 
+        phase_start = phase_clock::now();
+
         release_dwarf_list();
 
         dig_count = tree_count = plant_count = detail_count = 0;
@@ -1341,6 +1373,8 @@ public:
 
         collect_dwarf_list();
 
+        end_phase("scan");
+
         // add job entries for designation-related jobs
 
         labor_needed[df::unit_labor::MINE] += dig_count;
@@ -1581,38 +1615,67 @@ public:
             (1 << df::unit_labor::HAUL_FURNITURE) |
             (1 << df::unit_labor::HAUL_ANIMALS);
 
-        while (!available_dwarfs.empty())
-        {
-            std::list<dwarf_info_t*>::iterator bestdwarf = available_dwarfs.begin();
+        end_phase("demand");
 
-            int best_score = INT_MIN;
-            df::unit_labor best_labor = df::unit_labor::NONE;
+        // Score each available dwarf against each needed labor once, into a
+        // flat list of (score, labor, dwarf) entries. Assigning a labor to one
+        // dwarf doesn't change anyone else's scores, so handing out labors in
+        // descending score order gives the same result as rescanning every
+        // pair for the best one after each pick, without the quadratic
+        // score_labor calls.
 
-            for (auto j = to_assign.begin(); j != to_assign.end(); j++)
-            {
-                if (j->second <= 0)
-                    continue;
+        std::vector<std::list<dwarf_info_t*>::iterator> candidates;
+        for (auto k = available_dwarfs.begin(); k != available_dwarfs.end(); k++)
+            candidates.push_back(k);
 
-                df::unit_labor labor = j->first;
+        std::vector<df::unit_labor> needed_labors;
+        for (auto j = to_assign.begin(); j != to_assign.end(); j++)
+            if (j->second > 0)
+                needed_labors.push_back(j->first);
 
-                for (std::list<dwarf_info_t*>::iterator k = available_dwarfs.begin(); k != available_dwarfs.end(); k++)
-                {
-                    dwarf_info_t* d = (*k);
-                    if (Units::isValidLabor(d->dwarf, labor))
-                    {
-                        int score = score_labor(d, labor);
-                        if (score > best_score)
-                        {
-                            bestdwarf = k;
-                            best_score = score;
-                            best_labor = labor;
-                        }
-                    }
-                }
+        std::vector<int> remaining;
+        for (auto labor : needed_labors)
+            remaining.push_back(to_assign[labor]);
+
+        std::vector<assignment_edge> edges;
+        edges.reserve(candidates.size() * needed_labors.size());
+
+        for (size_t k = 0; k < candidates.size(); k++)
+        {
+            dwarf_info_t* d = *candidates[k];
+            for (size_t j = 0; j < needed_labors.size(); j++)
+            {
+                if (Units::isValidLabor(d->dwarf, needed_labors[j]))
+                    edges.push_back({score_labor(d, needed_labors[j]), int(j), int(k)});
             }
+        }
+
+        // ties go to the lower labor, then to the dwarf earlier in the list
+        std::sort(edges.begin(), edges.end(),
+            [](const assignment_edge& a, const assignment_edge& b) {
+                if (a.score != b.score)
+                    return a.score > b.score;
+                if (a.labor_idx != b.labor_idx)
+                    return a.labor_idx < b.labor_idx;
+                return a.dwarf_idx < b.dwarf_idx;
+            });
 
-            if (best_labor == df::unit_labor::NONE)
+        end_phase("score");
+
+        std::vector<bool> dwarf_assigned(candidates.size(), false);
+
+        for (auto& edge : edges)
+        {
+            if (available_dwarfs.empty())
                 break;
+            if (dwarf_assigned[edge.dwarf_idx] || remaining[edge.labor_idx] <= 0)
+                continue;
+
+            std::list<dwarf_info_t*>::iterator bestdwarf = candidates[edge.dwarf_idx];
+            int best_score = edge.score;
+            df::unit_labor best_labor = needed_labors[edge.labor_idx];
+            dwarf_assigned[edge.dwarf_idx] = true;
+            remaining[edge.labor_idx]--;
 
             if (print_debug)
                 out.print("assign \"%s\" labor %s score=%d\n", (*bestdwarf)->dwarf->name.first_name.c_str(), ENUM_KEY_STR(unit_labor, best_labor).c_str(), best_score);
@@ -1672,6 +1735,8 @@ public:
             available_dwarfs.erase(bestdwarf);
         }
 
+        end_phase("assign");
+
         for (auto d = busy_dwarfs.begin(); d != busy_dwarfs.end(); d++)
         {
             int current_score = score_labor(*d, (*d)->using_labor);
@@ -1852,6 +1917,15 @@ public:
 
         release_dwarf_list();
 
+        end_phase("finalize");
+        last_phase_times = phase_times;
+
+        if (print_debug)
+        {
+            for (auto& phase : phase_times)
+                out.print("phase %s: %.3f ms\n", phase.first, phase.second);
+        }
+
         if (labors_changed)
         {
             *df::global::process_dig = true;
@@ -2100,6 +2174,18 @@ command_result labormanager(color_ostream &out, std::vector <std::string> & para
         }
         out << endl;
 
+        if (!last_phase_times.empty())
+        {
+            double total = 0;
+            out << "Last cycle:";
+            for (auto& phase : last_phase_times)
+            {
+                out.print(" %s %.2f ms,", phase.first, phase.second);
+                total += phase.second;
+            }
+            out.print(" total %.2f ms\n", total);
+        }
+
         if (parameters[0] == "list")
         {
             FOR_ENUM_ITEMS(unit_labor, labor)
@@ -200,24 +200,22 @@ static bool isAssigned(df::unit *unit) {
     return false;
 }
 
-static bool unlikely_to_revert_to_wild(df::unit *unit) {
-    if (Units::isDomesticated(unit))
+static bool unlikely_to_revert_to_wild(const Units::UnitClasses &classes, size_t idx) {
+    using namespace Units::UnitClass;
+    if (classes.is(idx, DOMESTICATED))
         return true;
-    return Units::isTame(unit) && Units::isMarkedForTraining(unit);
+    return classes.is(idx, TAME | MARKED_FOR_TRAINING);
 }
 
-static bool isFreeEgglayer(df::unit *unit) {
-    return Units::isActive(unit)
-        && !Units::isUndead(unit)
-        && Units::isFemale(unit)
-        && Units::isAdult(unit)
-        && unlikely_to_revert_to_wild(unit)
-        && Units::isOwnCiv(unit)
-        && Units::isEggLayer(unit)
-        && !isAssigned(unit)
-        && !Units::isGrazer(unit) // exclude grazing birds because they're messy
-        && !Units::isMerchant(unit) // don't steal merchant mounts
-        && !Units::isForest(unit);  // don't steal birds from traders, they hate that
+static bool isFreeEgglayer(const Units::UnitClasses &classes, size_t idx) {
+    using namespace Units::UnitClass;
+    return classes.is(idx, ACTIVE | FEMALE | ADULT | OWN_CIV | EGG_LAYER,
+            UNDEAD
+            | GRAZER // exclude grazing birds because they're messy
+            | MERCHANT // don't steal merchant mounts
+            | FOREST) // don't steal birds from traders, they hate that
+        && unlikely_to_revert_to_wild(classes, idx)
+        && !isAssigned(classes.units[idx]);
 }
 
 static df::general_ref_building_civzone_assignedst * createCivzoneRef() {
@@ -295,9 +293,10 @@ static size_t getFreeNestboxZones(color_ostream &out, vector<df::building_civzon
 
 static vector<df::unit *> getFreeEggLayers(color_ostream &out) {
     vector<df::unit *> ret;
-    for (auto unit : world->units.active) {
-        if (isFreeEgglayer(unit))
-            ret.push_back(unit);
+    auto classes = Units::getUnitClasses();
+    for (size_t idx = 0; idx < classes->units.size(); ++idx) {
+        if (isFreeEgglayer(*classes, idx))
+            ret.push_back(classes->units[idx]);
     }
     return ret;
 }
@@ -5,7 +5,11 @@
  * Written by cdombroski.
  */
 
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
 #include <sstream>
+#include <thread>
 #include <unordered_map>
 
 #include "Console.h"
@@ -43,6 +47,7 @@
 using std::endl;
 using std::map;
 using std::ofstream;
+using std::ostream;
 using std::ostringstream;
 using std::pair;
 using std::string;
@@ -159,16 +164,18 @@ struct tile_context {
     df::building* b = NULL;
 };
 
-typedef vector<const char *> bp_row;     // index is x coordinate
-typedef map<int16_t, bp_row> bp_area;    // key is y coordinate
-typedef map<int16_t, bp_area> bp_volume; // key is z coordinate
+// the tiles of one z-level of the blueprint area, row by row
+typedef vector<const char *> bp_level;
 
 typedef const char * (get_tile_fn)(const df::coord &pos,
                                    const tile_context &ctx);
 typedef void (init_ctx_fn)(const df::coord &pos, tile_context &ctx);
 
 struct blueprint_processor {
-    bp_volume mapdata;
+    bp_level level;         // the z-level that is being classified
+    FILE *body = NULL;      // the csv rows of the levels written so far
+    bool has_tiles = false; // whether any level had a tile for this phase
+    int16_t cur_z = 0;      // the level the minimal format output is at
     const string mode;
     const string phase;
     const bool force_create;
@@ -182,7 +189,8 @@ struct blueprint_processor {
           get_tile(get_tile), init_ctx(init_ctx) { }
 };
 
-// global caches, cleared when the string cache is cleared
+// global caches, cleared by clear_caches() when the blueprint is done. they
+// are only read while tiles are being classified.
 static std::unordered_map<df::coord, df::engraving *> engravings_cache;
 static std::unordered_map<df::coord, df::job *> dig_job_cache;
 static PersistentDataItem warm_config, damp_config;
@@ -214,27 +222,22 @@ static void init_caches(DFHack::color_ostream &out, bool cache_engravings) {
     });
 }
 
+static void clear_caches() {
+    engravings_cache.clear();
+    dig_job_cache.clear();
+}
+
 // We use const char * throughout this code instead of std::string to avoid
 // having to allocate memory for all the small string literals. This
 // significantly speeds up processing and allows us to handle very large maps
 // (e.g. 16x16 embarks) without running out of memory. This cache provides a
 // mechanism for storing dynamically created strings so their memory stays
-// allocated until we write out the blueprints at the end.
-// If NULL is passed as the str, the cache is cleared.
+// allocated until the z-level they are on has been written out. Tiles are
+// classified on several threads, so each thread interns into its own set,
+// which do_transform points tile_strings at.
+static thread_local std::set<string> *tile_strings = NULL;
 static const char * cache(const char *str) {
-    // this local static assumes that no two blueprints are being generated at
-    // the same time, which is currently ensured by the higher-level DFHack
-    // command handling code. if this assumption ever becomes untrue, we'll
-    // need to protect the cache with thread synchronization primitives or make
-    // the cache per-blueprint.
-    static std::set<string> _cache;
-    if (!str) {
-        _cache.clear();
-        engravings_cache.clear();
-        dig_job_cache.clear();
-        return NULL;
-    }
-    return _cache.emplace(str).first->c_str();
+    return tile_strings->emplace(str).first->c_str();
 }
 
 // Convenience wrapper for std::string.
@@ -341,7 +344,7 @@ static const char * get_tile_dig(const df::coord &pos, const tile_context &) {
     if (td && td->bits.dig != df::tile_dig_designation::No)
         return add_markers(pos, get_tile_dig_designation(pos, td->bits.dig));
     if (dig_job_cache.contains(pos))
-        if (const char * ret = get_tile_dig_job(td, dig_job_cache[pos]))
+        if (const char * ret = get_tile_dig_job(td, dig_job_cache.at(pos)))
             return add_markers(pos, ret);
 
     auto tt = Maps::getTileType(pos);
@@ -377,7 +380,7 @@ static const char * get_tile_dig(const df::coord &pos, const tile_context &) {
 
 static const char * get_tile_smooth_minimal(const df::coord &pos,
                                             const tile_context &) {
-    if (dig_job_cache.contains(pos) && dig_job_cache[pos]->job_type == df::job_type::CarveFortification)
+    if (dig_job_cache.contains(pos) && dig_job_cache.at(pos)->job_type == df::job_type::CarveFortification)
         return "s";
 
     auto tt = Maps::getTileType(pos);
@@ -407,8 +410,8 @@ static const char * get_tile_smooth_with_engravings(const df::coord &pos,
         return smooth_minimal;
 
     if (dig_job_cache.contains(pos) &&
-            (dig_job_cache[pos]->job_type == df::job_type::DetailFloor ||
-             dig_job_cache[pos]->job_type == df::job_type::DetailWall))
+            (dig_job_cache.at(pos)->job_type == df::job_type::DetailFloor ||
+             dig_job_cache.at(pos)->job_type == df::job_type::DetailWall))
         return "s";
 
     if (auto td = Maps::getTileDesignation(pos); td && td->bits.smooth == 2)
@@ -440,8 +443,8 @@ static const char * get_tile_smooth_all(const df::coord &pos,
         return smooth_minimal;
 
     if (dig_job_cache.contains(pos) &&
-            (dig_job_cache[pos]->job_type == df::job_type::SmoothFloor ||
-             dig_job_cache[pos]->job_type == df::job_type::SmoothWall))
+            (dig_job_cache.at(pos)->job_type == df::job_type::SmoothFloor ||
+             dig_job_cache.at(pos)->job_type == df::job_type::SmoothWall))
         return "s";
 
     if (auto td = Maps::getTileDesignation(pos); td && td->bits.smooth == 1)
@@ -490,7 +493,7 @@ static const char * get_tile_carve_minimal(const df::coord &pos,
         return NULL;
 
     if (dig_job_cache.contains(pos)) {
-        df::job *job = dig_job_cache[pos];
+        df::job *job = dig_job_cache.at(pos);
         switch (job->job_type) {
         case df::job_type::CarveTrack:
             switch (tileShape(*tt))
@@ -541,8 +544,8 @@ static const char * get_tile_carve(const df::coord &pos, const tile_context &tc)
         return tile_carve_minimal;
 
     if (dig_job_cache.contains(pos) &&
-            (dig_job_cache[pos]->job_type == df::job_type::DetailFloor ||
-             dig_job_cache[pos]->job_type == df::job_type::DetailWall))
+            (dig_job_cache.at(pos)->job_type == df::job_type::DetailFloor ||
+             dig_job_cache.at(pos)->job_type == df::job_type::DetailWall))
         return "e";
 
     if (auto td = Maps::getTileDesignation(pos); td && td->bits.smooth == 2)
@@ -1341,62 +1344,81 @@ static bool is_meta_phase(color_ostream &out,
     return ret;
 }
 
-static void write_minimal(ofstream &ofile, const blueprint_options &opts,
-                          const bp_volume &mapdata) {
-    if (mapdata.begin() == mapdata.end())
-        return;
-
+// writes one level that has at least one tile. levels without tiles are left
+// out; the z-level keys for them are written along with the next level that
+// has tiles.
+static void write_minimal_level(ostream &ofile, const blueprint_options &opts,
+                                const bp_level &tiles, int16_t z,
+                                int16_t &cur_z) {
     const string z_key = opts.depth > 0 ? "#<" : "#>";
 
-    int16_t zprev = 0;
-    for (auto &area : mapdata) {
-        for ( ; zprev < area.first; ++zprev)
-            ofile << z_key << endl;
-        int16_t yprev = 0;
-        for (auto &row : area.second) {
-            for ( ; yprev < row.first; ++yprev)
-                ofile << endl;
-            size_t xprev = 0;
-            auto &tiles = row.second;
-            size_t rowsize = tiles.size();
-            for (size_t x = 0; x < rowsize; ++x) {
-                if (!tiles[x])
-                    continue;
-                for ( ; xprev < x; ++xprev)
-                    ofile << ",";
-                ofile << tiles[x];
-            }
+    for ( ; cur_z < z; ++cur_z)
+        ofile << z_key << endl;
+    int16_t yprev = 0;
+    for (int16_t y = 0; y < opts.height; ++y) {
+        auto row = tiles.begin() + y * opts.width;
+        if (std::none_of(row, row + opts.width, [](const char *tile){ return tile; }))
+            continue;
+        for ( ; yprev < y; ++yprev)
+            ofile << endl;
+        int16_t xprev = 0;
+        for (int16_t x = 0; x < opts.width; ++x) {
+            if (!row[x])
+                continue;
+            for ( ; xprev < x; ++xprev)
+                ofile << ",";
+            ofile << row[x];
         }
-        ofile << endl;
     }
+    ofile << endl;
 }
 
-static void write_pretty(ofstream &ofile, const blueprint_options &opts,
-                         const bp_volume &mapdata) {
+// writes every level, so tiles is NULL for levels beyond the edge of the map
+static void write_pretty_level(ostream &ofile, const blueprint_options &opts,
+                               const bp_level *tiles, int16_t z) {
     const string z_key = opts.depth > 0 ? "#<" : "#>";
 
-    int16_t absdepth = abs(opts.depth);
-    for (int16_t z = 0; z < absdepth; ++z) {
-        const bp_area *area = NULL;
-        if (mapdata.count(z))
-            area = &mapdata.at(z);
-        for (int16_t y = 0; y < opts.height; ++y) {
-            const bp_row *row = NULL;
-            if (area && area->count(y))
-                row = &area->at(y);
-            for (int16_t x = 0; x < opts.width; ++x) {
-                const char *tile = NULL;
-                if (row)
-                    tile = row->at(x);
-                ofile << (tile ? tile : " ") << ",";
-            }
-            ofile << "#" << endl;
+    if (z > 0)
+        ofile << z_key << endl;
+    for (int16_t y = 0; y < opts.height; ++y) {
+        for (int16_t x = 0; x < opts.width; ++x) {
+            const char *tile = NULL;
+            if (tiles)
+                tile = (*tiles)[y * opts.width + x];
+            ofile << (tile ? tile : " ") << ",";
         }
-        if (z < absdepth - 1)
-            ofile << z_key << endl;
+        ofile << "#" << endl;
     }
 }
 
+// appends the csv rows for level z of the processor's phase to its body
+static bool write_level(color_ostream &out, const blueprint_options &opts,
+                        blueprint_processor &processor, bool pretty,
+                        const bp_level *tiles, int16_t z) {
+    bool has_tiles = tiles && std::any_of(tiles->begin(), tiles->end(),
+                                          [](const char *tile){ return tile; });
+    processor.has_tiles = processor.has_tiles || has_tiles;
+
+    ostringstream rows;
+    if (pretty)
+        write_pretty_level(rows, opts, tiles, z);
+    else if (has_tiles)
+        write_minimal_level(rows, opts, *tiles, z, processor.cur_z);
+
+    string str = rows.str();
+    if (str.empty())
+        return true;
+    if (!processor.body)
+        processor.body = std::tmpfile();
+    if (!processor.body ||
+            fwrite(str.data(), 1, str.size(), processor.body) != str.size()) {
+        out.printerr("could not write temporary file for phase %s\n",
+                     processor.phase.c_str());
+        return false;
+    }
+    return true;
+}
+
 static string get_modeline(color_ostream &out, const blueprint_options &opts,
                            const string &mode, const string &phase) {
     ostringstream modeline;
@@ -1419,7 +1441,7 @@ static bool write_blueprint(color_ostream &out,
                             map<string, ofstream*> &output_files,
                             const blueprint_options &opts,
                             const blueprint_processor &processor,
-                            bool pretty, int32_t ordinal) {
+                            int32_t ordinal) {
     string fname;
     if (!get_filename(fname, out, opts, processor.phase, ordinal))
         return false;
@@ -1429,10 +1451,13 @@ static bool write_blueprint(color_ostream &out,
     ofstream &ofile = *output_files[fname];
     ofile << get_modeline(out, opts, processor.mode, processor.phase) << endl;
 
-    if (pretty)
-        write_pretty(ofile, opts, processor.mapdata);
-    else
-        write_minimal(ofile, opts, processor.mapdata);
+    if (FILE *body = processor.body) {
+        char buf[65536];
+        rewind(body);
+        size_t len;
+        while ((len = fread(buf, 1, sizeof(buf), body)) > 0)
+            ofile.write(buf, len);
+    }
 
     return true;
 }
@@ -1475,14 +1500,62 @@ static void add_processor(vector<blueprint_processor> &processors,
                                                  get_tile, init_ctx));
 }
 
+static void classify_tile(vector<blueprint_processor> &processors,
+                          const blueprint_options &opts, bool pretty,
+                          const df::coord &start, const df::coord &pos) {
+    tile_context ctx;
+    ctx.pretty = pretty;
+    size_t idx = (pos.y - start.y) * opts.width + (pos.x - start.x);
+    for (blueprint_processor &processor : processors) {
+        ctx.processor = &processor;
+        if (processor.init_ctx)
+            processor.init_ctx(pos, ctx);
+        if (const char *tile_str = processor.get_tile(pos, ctx))
+            processor.level[idx] = tile_str;
+    }
+}
+
+// Fills in the level of every processor for map level z, one map block at a
+// time. The tile getters only read game data, and each tile is only written by
+// the thread that classifies its block, so blocks are handed out to one thread
+// per arena.
+static void classify_level(vector<blueprint_processor> &processors,
+                           const blueprint_options &opts, bool pretty,
+                           const df::coord &start, const df::coord &end,
+                           int16_t z, vector<std::set<string>> &arenas) {
+    const int32_t bx1 = start.x >> 4, bx2 = (end.x - 1) >> 4;
+    const int32_t by1 = start.y >> 4, by2 = (end.y - 1) >> 4;
+    const size_t nx = bx2 - bx1 + 1;
+    const size_t count = nx * (by2 - by1 + 1);
+
+    std::atomic<size_t> next_block(0);
+    auto work = [&](std::set<string> *arena) {
+        tile_strings = arena;
+        for (size_t i; (i = next_block++) < count; ) {
+            int32_t bx = (bx1 + i % nx) * 16, by = (by1 + i / nx) * 16;
+            int32_t x2 = std::min<int32_t>(end.x, bx + 16);
+            int32_t y2 = std::min<int32_t>(end.y, by + 16);
+            for (int32_t y = std::max<int32_t>(start.y, by); y < y2; y++) {
+                for (int32_t x = std::max<int32_t>(start.x, bx); x < x2; x++)
+                    classify_tile(processors, opts, pretty, start, df::coord(x, y, z));
+            }
+        }
+        tile_strings = NULL;
+    };
+
+    size_t nthreads = std::min(arenas.size(), count);
+    vector<std::thread> workers;
+    for (size_t t = 1; t < nthreads; ++t)
+        workers.emplace_back(work, &arenas[t]);
+    work(&arenas[0]);
+    for (auto &worker : workers)
+        worker.join();
+}
+
 static bool do_transform(color_ostream &out,
                          const df::coord &start, const df::coord &end,
                          blueprint_options opts, // copy so we can munge it
                          vector<string> &filenames) {
-    // empty map instances to pass to emplace() below
-    static const bp_area EMPTY_AREA;
-    static const bp_row EMPTY_ROW;
-
     init_caches(out, opts.engrave);
 
     vector<blueprint_processor> processors;
@@ -1517,38 +1590,41 @@ static bool do_transform(color_ostream &out,
     if (!create_output_dir(out, opts))
         return false;
 
+    // classify and write out one z-level at a time, so only the tiles and
+    // strings of a single level are ever held in memory. the csv rows of each
+    // phase are spooled to a temporary file until we know which phases have
+    // any tiles and which files they go in.
     const bool pretty = opts.format != "minimal";
     const int32_t z_inc = start.z < end.z ? 1 : -1;
-    for (int32_t z = start.z; z != end.z; z += z_inc) {
-        for (int32_t y = start.y; y < end.y; y++) {
-            for (int32_t x = start.x; x < end.x; x++) {
-                df::coord pos(x, y, z);
-                tile_context ctx;
-                ctx.pretty = pretty;
-                for (blueprint_processor &processor : processors) {
-                    ctx.processor = &processor;
-                    if (processor.init_ctx)
-                        processor.init_ctx(pos, ctx);
-                    const char *tile_str = processor.get_tile(pos, ctx);
-                    if (tile_str) {
-                        // ensure our z-index is in the order we want to write
-                        auto area = processor.mapdata.emplace(abs(z - start.z),
-                                                              EMPTY_AREA);
-                        auto row = area.first->second.emplace(y - start.y,
-                                                              EMPTY_ROW);
-                        auto &tiles = row.first->second;
-                        if (row.second)
-                            tiles.resize(opts.width);
-                        tiles[x - start.x] = tile_str;
-                    }
-                }
-            }
+    vector<std::set<string>> arenas(std::max(1u, std::thread::hardware_concurrency()));
+    bool ok = true;
+    int16_t level = 0;
+    for (int32_t z = start.z; ok && z != end.z; z += z_inc, ++level) {
+        for (blueprint_processor &processor : processors)
+            processor.level.assign(size_t(opts.width) * opts.height, NULL);
+        classify_level(processors, opts, pretty, start, end, z, arenas);
+        for (blueprint_processor &processor : processors) {
+            if (!(ok = write_level(out, opts, processor, pretty, &processor.level, level)))
+                break;
         }
+        for (auto &arena : arenas)
+            arena.clear();
     }
+    // the pretty format has all the requested levels, even off the map
+    for ( ; ok && pretty && level < abs(opts.depth); ++level) {
+        for (blueprint_processor &processor : processors) {
+            if (!(ok = write_level(out, opts, processor, pretty, NULL, level)))
+                break;
+        }
+    }
+    for (blueprint_processor &processor : processors)
+        bp_level().swap(processor.level);
 
     vector<string> meta_phases;
     for (blueprint_processor &processor : processors) {
-        if (processor.mapdata.empty() && !processor.force_create)
+        if (!ok)
+            break;
+        if (!processor.has_tiles && !processor.force_create)
             continue;
         if (is_meta_phase(out, opts, processor.phase))
             meta_phases.push_back(processor.phase);
@@ -1560,7 +1636,9 @@ static bool do_transform(color_ostream &out,
     int32_t ordinal = 0;
     map<string, ofstream*> output_files;
     for (blueprint_processor &processor : processors) {
-        if (processor.mapdata.empty() && !processor.force_create)
+        if (!ok)
+            break;
+        if (!processor.has_tiles && !processor.force_create)
             continue;
         bool meta_phase = is_meta_phase(out, opts, processor.phase);
         if (!in_meta)
@@ -1570,20 +1648,25 @@ static bool do_transform(color_ostream &out,
             ++ordinal;
         }
         in_meta = meta_phase;
-        if (!write_blueprint(out, output_files, opts, processor, pretty,
-                             ordinal))
+        if (!write_blueprint(out, output_files, opts, processor, ordinal))
             break;
     }
-    if (in_meta)
+    if (ok && in_meta)
         write_meta_blueprint(out, output_files, opts, meta_phases, ordinal);
 
+    for (blueprint_processor &processor : processors) {
+        if (processor.body)
+            fclose(processor.body);
+        processor.body = NULL;
+    }
+
     for (auto &it : output_files) {
         filenames.push_back(it.first);
         it.second->close();
         delete(it.second);
     }
 
-    return true;
+    return ok;
 }
 
 // returns whether blueprint generation was successful. populates files with the
@@ -1653,8 +1736,7 @@ static command_result do_blueprint(color_ostream &out,
 
     bool ok = do_transform(out, start, end, options, files);
 
-    // clear caches
-    cache(NULL);
+    clear_caches();
 
     return ok ? CR_OK : CR_FAILURE;
 }
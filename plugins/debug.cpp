@@ -35,6 +35,7 @@ redistribute it freely, subject to the following restrictions:
 #include <set>
 #include <mutex>
 #include <regex>
+#include <cstdlib>
 #include <cwchar>
 
 DFHACK_PLUGIN("debug");
@@ -1047,6 +1048,58 @@ static command_result configureHeader(color_ostream& out,
     return CR_OK;
 }
 
+static command_result configureAsync(color_ostream& out,
+                                     std::vector<std::string>& parameters)
+{
+    DebugManager &dm = DebugManager::getInstance();
+    DebugManager::AsyncConfig config = dm.getAsyncConfig();
+
+    const size_t nparams = parameters.size();
+    if (nparams >= 2 && parameters[1] == "disable") {
+        config.enabled = false;
+        dm.setAsyncConfig(config);
+    } else if (nparams >= 2 && parameters[1] == "enable") {
+        config.enabled = true;
+        config.console = true;
+        config.file.clear();
+        for (size_t idx = 2; nparams > idx; ++idx) {
+            const std::string &param = parameters[idx];
+            if (param == "noconsole") {
+                config.console = false;
+            } else if (param == "file" && nparams > idx + 1) {
+                config.file = parameters[++idx];
+            } else if (param == "maxsize" && nparams > idx + 1) {
+                config.max_file_size = size_t(std::max(0, atoi(parameters[++idx].c_str()))) * 1024 * 1024;
+            } else {
+                ERR(command, out).print("Unknown async option: %s\n", param.c_str());
+                return CR_WRONG_USAGE;
+            }
+        }
+        if (!dm.setAsyncConfig(config))
+            WARN(command, out).print("Cannot open log file %s\n", config.file.c_str());
+        config = dm.getAsyncConfig();
+    } else if (nparams >= 2) {
+        return CR_WRONG_USAGE;
+    }
+
+    out.color(COLOR_GREEN);
+    out << std::setw(welement) << "Async option"
+        << std::setw(wsetting) << "Setting" << '\n';
+    listHeaderSetting(out, COLOR_CYAN, "async", config.enabled);
+    listHeaderSetting(out, COLOR_LIGHTCYAN, "console", config.console);
+    out.color(COLOR_CYAN);
+    out << std::setw(welement) << "file"
+        << std::setw(wsetting) << (config.file.empty() ? "-" : config.file) << '\n';
+    out.color(COLOR_LIGHTCYAN);
+    out << std::setw(welement) << "maxsize (MiB)"
+        << std::setw(wsetting) << config.max_file_size / (1024 * 1024) << '\n';
+    out.color(COLOR_CYAN);
+    out << std::setw(welement) << "dropped"
+        << std::setw(wsetting) << dm.getAsyncDropped() << '\n';
+    out.reset_color();
+    return CR_OK;
+}
+
 using DFHack::debugPlugin::CommandDispatch;
 
 CommandDispatch::dispatch_t CommandDispatch::dispatch {
@@ -1057,6 +1110,7 @@ CommandDispatch::dispatch_t CommandDispatch::dispatch {
     {"enable", {enableFilter}},
     {"disable", {disableFilter}},
     {"header", {configureHeader}},
+    {"async", {configureAsync}},
 };
 
 //! Dispatch command handling to the subcommand or help
@@ -1106,5 +1160,12 @@ DFhackCExport DFHack::command_result plugin_init(DFHack::color_ostream& out,
 DFhackCExport DFHack::command_result plugin_shutdown(DFHack::color_ostream& out)
 {
     INFO(init,out).print("plugin_shutdown\n");
+    // Write out queued messages while the console is still available
+    auto& catMan = DFHack::DebugManager::getInstance();
+    DFHack::DebugManager::AsyncConfig config = catMan.getAsyncConfig();
+    if (config.enabled) {
+        config.enabled = false;
+        catMan.setAsyncConfig(config);
+    }
     return DFHack::CR_OK;
 }
@@ -6,9 +6,14 @@
 #include "DataDefs.h"
 #include "DataIdentity.h"
 
+#include <atomic>
 #include <deque>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <string>
+#include <unordered_map>
 
 using namespace DFHack;
 
@@ -65,17 +70,125 @@ namespace
     };
 }
 
+// Structures that have been seen so far, by address. Entries are split into
+// shards by the 1MB region they start in, so threads checking unrelated parts
+// of memory don't wait on each other. Structures that cross a region boundary
+// are kept apart; adding anything that could overlap one of those locks the
+// whole set.
+class VisitedSet
+{
+public:
+    enum result
+    {
+        ADDED,
+        SEEN,
+        UNKNOWN_POINTER,
+        OVERLAP_BACKWARD,
+        OVERLAP_FORWARD,
+    };
+    typedef std::pair<std::string, CheckedStructure> entry_type;
+
+    // on a conflict, other is set to the entry that conflicts with the item
+    result add(const QueueItem & item, const CheckedStructure & cs, entry_type & other);
+    bool find(const void *ptr, CheckedStructure & cs);
+    void set_identity(const void *ptr, const std::string & path, const type_identity *identity);
+
+private:
+    typedef std::map<const void *, entry_type> map_type;
+    static const size_t REGION_BITS = 20;
+    static const size_t SHARD_COUNT = 64;
+
+    struct Shard
+    {
+        std::mutex mutex;
+        map_type data;
+    };
+    Shard shards[SHARD_COUNT];
+    std::shared_mutex spanning_mutex;
+    map_type spanning;
+
+    Shard & shard_for(const void *ptr)
+    {
+        return shards[(uintptr_t(ptr) >> REGION_BITS) % SHARD_COUNT];
+    }
+    static result add_locked(const QueueItem & item, const CheckedStructure & cs, entry_type & other, map_type *const *maps, size_t num_maps, map_type & target);
+};
+
+// Structures that passed the check without leading anywhere else, with a hash
+// of their contents. Kept between runs while the same world is loaded, so a
+// structure whose bytes haven't changed since doesn't have to be checked again.
+class ValidatedCache
+{
+public:
+    bool contains(const void *ptr, const CheckedStructure & cs);
+    void add(const void *ptr, const CheckedStructure & cs);
+    void clear();
+
+private:
+    static const size_t SHARD_COUNT = 64;
+
+    struct key_type
+    {
+        const type_identity *identity;
+        const void *ptr;
+        bool operator==(const key_type & other) const { return identity == other.identity && ptr == other.ptr; }
+    };
+    struct key_hash
+    {
+        size_t operator()(const key_type & key) const
+        {
+            return std::hash<const void *>()(key.ptr) ^ (std::hash<const void *>()(key.identity) << 1);
+        }
+    };
+    struct value_type
+    {
+        size_t count;
+        uint64_t hash;
+    };
+    struct Shard
+    {
+        std::mutex mutex;
+        std::unordered_map<key_type, value_type, key_hash> data;
+    };
+    Shard shards[SHARD_COUNT];
+
+    Shard & shard_for(const void *ptr)
+    {
+        return shards[(uintptr_t(ptr) >> 6) % SHARD_COUNT];
+    }
+    static uint64_t hash_contents(const void *ptr, size_t size);
+};
+
 class Checker
 {
+    struct WorkQueue
+    {
+        std::mutex mutex;
+        std::deque<QueueItem> items;
+    };
+
     color_ostream & out;
     std::vector<t_memrange> mapped;
-    std::map<const void *, std::pair<std::string, CheckedStructure>> data;
-    std::deque<QueueItem> queue;
+    VisitedSet visited;
+    // one per thread; each thread takes from the front of its own queue, and
+    // steals from the back of the others when it runs out
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::atomic<size_t> pending;
+    std::atomic<bool> stopping;
+
+    // set for each worker thread by run()
+    static thread_local size_t thread_index;
+    static thread_local color_ostream *thread_out;
+    static thread_local size_t thread_errors;
+    static thread_local size_t thread_queued;
 public:
-    size_t checked_count;
-    size_t error_count;
+    std::atomic<size_t> checked_count;
+    std::atomic<size_t> cached_count;
+    std::atomic<size_t> error_count;
     size_t maxerrors;
-    bool maxerrors_reported;
+    std::atomic<bool> maxerrors_reported;
+    size_t threads;
+    ValidatedCache *validated;
     bool enums;
     bool sizes;
     bool unnamed;
@@ -85,9 +198,11 @@ public:
     uint8_t perturb_byte;
 
     Checker(color_ostream & out);
-    bool queue_item(const QueueItem & item, CheckedStructure cs);
+    // if defer is false, the item is only marked as seen, and the caller is
+    // expected to dispatch it right away if this returns true
+    bool queue_item(const QueueItem & item, CheckedStructure cs, bool defer = true);
     void queue_globals();
-    bool process_queue();
+    void run();
 
     bool is_in_global(const QueueItem & item);
     bool is_valid_dereference(const QueueItem & item, const CheckedStructure & cs, size_t size, bool quiet);
@@ -121,7 +236,11 @@ public:
     static const char *const *get_enum_item_attr_or_key(const enum_identity *identity, int64_t value, const char *attr_name);
 
 private:
+    color_ostream & thread_output() { return thread_out ? *thread_out : out; }
     color_ostream & fail(int, const QueueItem &, const CheckedStructure &);
+    void work();
+    bool take_item(QueueItem &);
+    void process_item(const QueueItem &);
     void dispatch_item(const QueueItem &, const CheckedStructure &);
     void dispatch_single_item(const QueueItem &, const CheckedStructure &);
     void dispatch_primitive(const QueueItem &, const CheckedStructure &);
@@ -147,6 +266,7 @@ private:
     void check_possible_pointer(const QueueItem &, const CheckedStructure &);
 
     friend struct CheckedStructure;
+    static std::mutex wrappers_mutex;
     static const type_identity *wrap_in_pointer(const type_identity *);
     static const type_identity *wrap_in_stl_ptr_vector(const type_identity *);
 };
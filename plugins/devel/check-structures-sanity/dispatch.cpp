@@ -1,16 +1,28 @@
 #include "check-structures-sanity.h"
 
+#include <chrono>
 #include <cinttypes>
 #include <queue>
+#include <thread>
 
 #include "df/large_integer.h"
 
+thread_local size_t Checker::thread_index = 0;
+thread_local color_ostream *Checker::thread_out = nullptr;
+thread_local size_t Checker::thread_errors = 0;
+thread_local size_t Checker::thread_queued = 0;
+
 Checker::Checker(color_ostream & out) :
     out(out),
+    pending(0),
+    stopping(false),
     checked_count(0),
+    cached_count(0),
     error_count(0),
     maxerrors(~size_t(0)),
     maxerrors_reported(false),
+    threads(std::max(1u, std::thread::hardware_concurrency())),
+    validated(nullptr),
     enums(false),
     sizes(false),
     unnamed(false),
@@ -19,22 +31,26 @@ Checker::Checker(color_ostream & out) :
     maybepointer(false)
 {
     Core::getInstance().p->getMemRanges(mapped);
+    queues.emplace_back(std::make_unique<WorkQueue>());
 }
 
 color_ostream & Checker::fail(int line, const QueueItem & item, const CheckedStructure & cs)
 {
     error_count++;
+    thread_errors++;
+    auto & out = thread_output();
     out << COLOR_LIGHTRED << "sanity check failed (line " << line << "): ";
     out << COLOR_RESET << (cs.identity ? cs.identity->getFullName() : "?");
     out << " (accessed as " << item.path << "): ";
     out << COLOR_YELLOW;
-    if (maxerrors && maxerrors != ~size_t(0))
-        maxerrors--;
     return out;
 }
 
-bool Checker::queue_item(const QueueItem & item, CheckedStructure cs)
+bool Checker::queue_item(const QueueItem & item, CheckedStructure cs, bool defer)
 {
+    // even if this was already seen, whatever led here is not a leaf
+    thread_queued++;
+
     if (!cs.identity)
     {
         UNEXPECTED;
@@ -58,49 +74,33 @@ bool Checker::queue_item(const QueueItem & item, CheckedStructure cs)
         }
     }
 
-    auto ptr_end = PTR_ADD(item.ptr, cs.full_size());
-
-    auto prev = data.lower_bound(item.ptr);
-    if (prev != data.cbegin() && uintptr_t(prev->first) > uintptr_t(item.ptr))
-    {
-        prev--;
-    }
-    if (prev != data.cend() && uintptr_t(prev->first) <= uintptr_t(item.ptr) && uintptr_t(prev->first) + prev->second.second.full_size() > uintptr_t(item.ptr))
+    VisitedSet::entry_type other;
+    switch (visited.add(item, cs, other))
     {
-        auto offset = uintptr_t(item.ptr) - uintptr_t(prev->first);
-        if (!prev->second.second.has_type_at_offset(cs, offset))
-        {
-            if (offset == 0 && cs.identity == df::identity_traits<void *>::get())
-            {
-                FAIL("unknown pointer is " << prev->second.second.identity->getFullName() << ", previously seen at " << prev->second.first);
-                return false;
-            }
+        case VisitedSet::ADDED:
+            break;
+        case VisitedSet::SEEN:
+            return false;
+        case VisitedSet::UNKNOWN_POINTER:
+            FAIL("unknown pointer is " << other.second.identity->getFullName() << ", previously seen at " << other.first);
+            return false;
+        case VisitedSet::OVERLAP_BACKWARD:
             // TODO
-            FAIL("TODO: handle merging structures: " << item.path << " overlaps " << prev->second.first << " (backward)");
+            FAIL("TODO: handle merging structures: " << item.path << " overlaps " << other.first << " (backward)");
             return false;
-        }
-
-        // we've already checked this structure, or we're currently queued to do so
-        return false;
-    }
-
-    auto overlap_start = data.lower_bound(item.ptr);
-    auto overlap_end = data.lower_bound(ptr_end);
-    for (auto overlap = overlap_start; overlap != overlap_end; overlap++)
-    {
-        auto offset = uintptr_t(overlap->first) - uintptr_t(item.ptr);
-        if (!cs.has_type_at_offset(overlap->second.second, offset))
-        {
+        case VisitedSet::OVERLAP_FORWARD:
             // TODO
-            FAIL("TODO: handle merging structures: " << overlap->second.first << " overlaps " << item.path << " (forward)");
+            FAIL("TODO: handle merging structures: " << other.first << " overlaps " << item.path << " (forward)");
             return false;
-        }
     }
 
-    data.erase(overlap_start, overlap_end);
-
-    data[item.ptr] = std::make_pair(item.path, cs);
-    queue.push_back(item);
+    if (defer)
+    {
+        pending++;
+        auto & queue = *queues.at(thread_index);
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.items.push_back(item);
+    }
     return true;
 }
 
@@ -137,28 +137,134 @@ void Checker::queue_globals()
     }
 }
 
-bool Checker::process_queue()
+void Checker::run()
 {
-    if (queue.empty())
+    // everything queued so far is in the first queue; the threads spread it out
+    size_t num_threads = std::max(size_t(1), threads);
+    while (queues.size() < num_threads)
     {
-        return false;
+        queues.emplace_back(std::make_unique<WorkQueue>());
     }
 
-    auto item = std::move(queue.front());
-    queue.pop_front();
+    std::vector<buffered_color_ostream> buffers(num_threads);
+    std::atomic<size_t> running(num_threads);
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < num_threads; i++)
+    {
+        workers.emplace_back([this, i, &buffers, &running]()
+        {
+            thread_index = i;
+            thread_out = &buffers[i];
+            work();
+            thread_out = nullptr;
+            thread_index = 0;
+            running--;
+        });
+    }
 
-    auto cs = data.find(item.ptr);
-    if (cs == data.end())
+    for (size_t ticks = 0; running; ticks++)
     {
-        // happens if pointer is determined to be part of a larger structure
-        return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        if (!noprogress && ticks % 10 == 0)
+        {
+            out << "checked " << checked_count.load() << " fields\r" << std::flush;
+        }
+    }
+    for (auto & worker : workers)
+    {
+        worker.join();
     }
 
-    dispatch_item(item, cs->second.second);
+    // errors are reported grouped by the thread that found them
+    for (auto & buffer : buffers)
+    {
+        for (auto & span : buffer.spans())
+        {
+            out.color(span.color);
+            out << buffer.text(span);
+        }
+    }
+    out.reset_color();
 
-    return true;
+    queues.resize(1);
+    queues[0]->items.clear();
+    pending = 0;
+}
+
+void Checker::work()
+{
+    QueueItem item("", nullptr);
+    while (!stopping)
+    {
+        if (!take_item(item))
+        {
+            if (!pending)
+            {
+                break;
+            }
+            std::this_thread::yield();
+            continue;
+        }
+
+        process_item(item);
+        pending--;
+    }
 }
 
+bool Checker::take_item(QueueItem & item)
+{
+    {
+        auto & own = *queues.at(thread_index);
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.items.empty())
+        {
+            item = std::move(own.items.front());
+            own.items.pop_front();
+            return true;
+        }
+    }
+
+    for (size_t i = 1; i < queues.size(); i++)
+    {
+        auto & victim = *queues.at((thread_index + i) % queues.size());
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.items.empty())
+        {
+            item = std::move(victim.items.back());
+            victim.items.pop_back();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void Checker::process_item(const QueueItem & item)
+{
+    CheckedStructure cs;
+    if (!visited.find(item.ptr, cs))
+    {
+        // happens if pointer is determined to be part of a larger structure
+        return;
+    }
+
+    if (validated && is_valid_dereference(item, cs, true) && validated->contains(item.ptr, cs))
+    {
+        cached_count++;
+        return;
+    }
+
+    auto errors_before = thread_errors;
+    auto queued_before = thread_queued;
+
+    dispatch_item(item, cs);
+
+    // structures that lead to others can change without their own bytes changing
+    if (validated && thread_errors == errors_before && thread_queued == queued_before)
+    {
+        validated->add(item.ptr, cs);
+    }
+}
 
 void Checker::dispatch_item(const QueueItem & base, const CheckedStructure & cs)
 {
@@ -225,14 +331,13 @@ void Checker::dispatch_single_item(const QueueItem & item, const CheckedStructur
 {
     checked_count++;
 
-    if (!maxerrors)
+    if (error_count >= maxerrors)
     {
-        if (!maxerrors_reported)
+        if (!maxerrors_reported.exchange(true))
         {
-            FAIL("error limit reached. bailing out with " << (queue.size() + 1) << " items remaining in the queue.");
-            maxerrors_reported = true;
+            FAIL("error limit reached. bailing out with " << pending.load() << " items remaining in the queue.");
         }
-        queue.clear();
+        stopping = true;
         return;
     }
 
@@ -348,11 +453,10 @@ void Checker::dispatch_pointer(const QueueItem & item, const CheckedStructure &
     if (cs.count || target->byte_size() <= 256)
     {
         // target is small, or we are inside an array of pointers; handle now
-        if (queue_item(target_item, target_cs))
+        // mark it as seen to make sure we're not stuck in a loop, but don't
+        // queue it, to prevent the queue growing too big
+        if (queue_item(target_item, target_cs, false))
         {
-            // we insert it into the queue to make sure we're not stuck in a loop
-            // get it back out of the queue to prevent the queue growing too big
-            queue.pop_back();
             dispatch_item(target_item, target_cs);
         }
     }
@@ -598,11 +702,7 @@ void Checker::dispatch_class(const QueueItem & item, const CheckedStructure & cs
         return;
     }
 
-    if (data.count(item.ptr) && data.at(item.ptr).first == item.path)
-    {
-        // TODO: handle cases where this may overlap later data
-        data.at(item.ptr).second.identity = identity;
-    }
+    visited.set_identity(item.ptr, item.path, identity);
 
     dispatch_struct(QueueItem(item.path + "<" + identity->getFullName() + ">", item.ptr), CheckedStructure(identity));
 }
@@ -798,9 +898,8 @@ void Checker::check_unknown_pointer(const QueueItem & item)
         if (allocated_size == sizeof(void *) || (allocated_size > sizeof(void *) && is_valid_dereference(ptr_item, 1, true)))
         {
             CheckedStructure ptr_cs(df::identity_traits<void *>::get());
-            if (queue_item(ptr_item, ptr_cs))
+            if (queue_item(ptr_item, ptr_cs, false))
             {
-                queue.pop_back();
                 dispatch_pointer(ptr_item, ptr_cs);
             }
         }
@@ -1036,7 +1135,7 @@ void Checker::check_stl_unordered_map(const QueueItem & item, const container_id
         return;
     }
 
-    out << umap->rehash_policy.max_load_factor << std::endl;
+    thread_output() << umap->rehash_policy.max_load_factor << std::endl;
 
     #define check_ptr_field(field, expect_null) \
         do { \
@@ -7,6 +7,11 @@ DFHACK_PLUGIN("check-structures-sanity");
 
 static command_result command(color_ostream &, std::vector<std::string> &);
 
+// structures that passed in earlier runs; only meaningful while the same world
+// is loaded, and for the same set of checks
+static ValidatedCache validated_cache;
+static std::string validated_options;
+
 DFhackCExport command_result plugin_init(color_ostream &, std::vector<PluginCommand> & commands)
 {
     commands.push_back(PluginCommand(
@@ -14,12 +19,14 @@ DFhackCExport command_result plugin_init(color_ostream &, std::vector<PluginComm
         "performs a sanity check on df-structures",
         command,
         false,
-        "check-structures-sanity [-enums] [-sizes] [-lowmem] [-maxerrors n] [-failfast] [starting_point]\n"
+        "check-structures-sanity [-enums] [-sizes] [-lowmem] [-maxerrors n] [-threads n] [-nocache] [-failfast] [starting_point]\n"
         "\n"
         "-enums: report unexpected or unnamed enum or bitfield values.\n"
         "-sizes: report struct and class sizes that don't match structures. (requires sizecheck)\n"
         "-unnamed: report unnamed enum/bitfield values, not just undefined ones.\n"
         "-maxerrors n: set the maximum number of errors before bailing out.\n"
+        "-threads n: check with n threads. (defaults to the number of cores)\n"
+        "-nocache: recheck structures that passed in an earlier run and haven't changed since.\n"
         "-failfast: crash if any error is encountered. useful only for debugging.\n"
         "-maybepointer: report integers that might actually be pointers.\n"
         "starting_point: a lua expression or a word like 'screen', 'item', or 'building'. (defaults to df.global)\n"
@@ -33,6 +40,19 @@ DFhackCExport command_result plugin_init(color_ostream &, std::vector<PluginComm
     return CR_OK;
 }
 
+DFhackCExport command_result plugin_shutdown(color_ostream &)
+{
+    validated_cache.clear();
+    return CR_OK;
+}
+
+DFhackCExport command_result plugin_onstatechange(color_ostream &, state_change_event event)
+{
+    if (event == SC_WORLD_LOADED || event == SC_WORLD_UNLOADED)
+        validated_cache.clear();
+    return CR_OK;
+}
+
 // returns 0 if MALLOC_PERTURB_ is unset, or if set to 0, because 0 is not useful
 uint8_t check_malloc_perturb()
 {
@@ -84,8 +104,16 @@ static command_result command(color_ostream & out, std::vector<std::string> & pa
         } \
     }
     VAL_PARAM(maxerrors, std::stoul(value));
+    VAL_PARAM(threads, std::stoul(value));
 #undef VAL_PARAM
 
+    auto nocache_idx = std::find(parameters.begin(), parameters.end(), "-nocache");
+    bool nocache = nocache_idx != parameters.end();
+    if (nocache)
+    {
+        parameters.erase(nocache_idx);
+    }
+
 #define BOOL_PARAM(name) \
     auto name ## _idx = std::find(parameters.begin(), parameters.end(), "-" #name); \
     if (name ## _idx != parameters.end()) \
@@ -101,6 +129,17 @@ static command_result command(color_ostream & out, std::vector<std::string> & pa
     BOOL_PARAM(maybepointer);
 #undef BOOL_PARAM
 
+    if (!nocache)
+    {
+        auto options = stl_sprintf("%d%d%d%d", checker.enums, checker.sizes, checker.unnamed, checker.maybepointer);
+        if (options != validated_options)
+        {
+            validated_cache.clear();
+            validated_options = options;
+        }
+        checker.validated = &validated_cache;
+    }
+
     if (parameters.size() > 1)
     {
         return CR_WRONG_USAGE;
@@ -141,15 +180,14 @@ static command_result command(color_ostream & out, std::vector<std::string> & pa
         checker.queue_item(item, CheckedStructure(identity));
     }
 
-    while (checker.process_queue())
+    checker.run();
+
+    out << "checked " << checker.checked_count.load() << " fields";
+    if (checker.cached_count)
     {
-        if (!checker.noprogress)
-        {
-            out << "checked " << checker.checked_count << " fields\r" << std::flush;
-        }
+        out << " (skipped " << checker.cached_count.load() << " unchanged structures)";
     }
-
-    out << "checked " << checker.checked_count << " fields" << std::endl;
+    out << std::endl;
 
     return checker.error_count ? CR_FAILURE : CR_OK;
 }
@@ -154,8 +154,11 @@ bool CheckedStructure::has_type_at_offset(const CheckedStructure & type, size_t
     return false;
 }
 
+std::mutex Checker::wrappers_mutex;
+
 const type_identity *Checker::wrap_in_stl_ptr_vector(const type_identity *base)
 {
+    std::lock_guard<std::mutex> lock(wrappers_mutex);
     static std::map<const type_identity *, std::unique_ptr<const df::stl_ptr_vector_identity>> wrappers;
     auto it = wrappers.find(base);
     if (it != wrappers.end())
@@ -167,6 +170,7 @@ const type_identity *Checker::wrap_in_stl_ptr_vector(const type_identity *base)
 
 const type_identity *Checker::wrap_in_pointer(const type_identity *base)
 {
+    std::lock_guard<std::mutex> lock(wrappers_mutex);
     static std::map<const type_identity *, std::unique_ptr<const df::pointer_identity>> wrappers;
     auto it = wrappers.find(base);
     if (it != wrappers.end())
@@ -0,0 +1,202 @@
+#include "check-structures-sanity.h"
+
+#include <cstring>
+
+VisitedSet::result VisitedSet::add(const QueueItem & item, const CheckedStructure & cs, entry_type & other)
+{
+    auto size = cs.full_size();
+    auto ptr_end = PTR_ADD(item.ptr, size);
+    bool crosses_region = size && (uintptr_t(item.ptr) >> REGION_BITS) != ((uintptr_t(ptr_end) - 1) >> REGION_BITS);
+
+    if (!crosses_region)
+    {
+        // common case: only one shard needs to be locked, as long as none of
+        // the structures that cross regions start inside this one
+        std::shared_lock<std::shared_mutex> spanning_lock(spanning_mutex);
+        if (spanning.lower_bound(item.ptr) == spanning.lower_bound(ptr_end))
+        {
+            auto & shard = shard_for(item.ptr);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            map_type *maps[] = { &shard.data, &spanning };
+            return add_locked(item, cs, other, maps, 2, shard.data);
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> spanning_lock(spanning_mutex);
+    std::unique_lock<std::mutex> locks[SHARD_COUNT];
+    map_type *maps[SHARD_COUNT + 1];
+    for (size_t i = 0; i < SHARD_COUNT; i++)
+    {
+        locks[i] = std::unique_lock<std::mutex>(shards[i].mutex);
+        maps[i] = &shards[i].data;
+    }
+    maps[SHARD_COUNT] = &spanning;
+    return add_locked(item, cs, other, maps, SHARD_COUNT + 1, crosses_region ? spanning : shard_for(item.ptr).data);
+}
+
+VisitedSet::result VisitedSet::add_locked(const QueueItem & item, const CheckedStructure & cs, entry_type & other, map_type *const *maps, size_t num_maps, map_type & target)
+{
+    auto ptr_end = PTR_ADD(item.ptr, cs.full_size());
+
+    // the closest structure starting at or before this one may contain it
+    map_type::iterator prev;
+    bool have_prev = false;
+    for (size_t i = 0; i < num_maps; i++)
+    {
+        auto it = maps[i]->upper_bound(item.ptr);
+        if (it == maps[i]->begin())
+        {
+            continue;
+        }
+        it--;
+        if (!have_prev || uintptr_t(it->first) > uintptr_t(prev->first))
+        {
+            prev = it;
+            have_prev = true;
+        }
+    }
+    if (have_prev && uintptr_t(prev->first) + prev->second.second.full_size() > uintptr_t(item.ptr))
+    {
+        auto offset = uintptr_t(item.ptr) - uintptr_t(prev->first);
+        if (!prev->second.second.has_type_at_offset(cs, offset))
+        {
+            other = prev->second;
+            if (offset == 0 && cs.identity == df::identity_traits<void *>::get())
+            {
+                return UNKNOWN_POINTER;
+            }
+            return OVERLAP_BACKWARD;
+        }
+
+        // we've already checked this structure, or we're currently queued to do so
+        return SEEN;
+    }
+
+    for (size_t i = 0; i < num_maps; i++)
+    {
+        auto overlap_end = maps[i]->lower_bound(ptr_end);
+        for (auto overlap = maps[i]->lower_bound(item.ptr); overlap != overlap_end; overlap++)
+        {
+            auto offset = uintptr_t(overlap->first) - uintptr_t(item.ptr);
+            if (!cs.has_type_at_offset(overlap->second.second, offset))
+            {
+                other = overlap->second;
+                return OVERLAP_FORWARD;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < num_maps; i++)
+    {
+        // an empty range still counts as a write for some implementations,
+        // and the spanning map may only be locked for reading
+        auto overlap_start = maps[i]->lower_bound(item.ptr);
+        auto overlap_end = maps[i]->lower_bound(ptr_end);
+        if (overlap_start != overlap_end)
+        {
+            maps[i]->erase(overlap_start, overlap_end);
+        }
+    }
+
+    target[item.ptr] = std::make_pair(item.path, cs);
+    return ADDED;
+}
+
+bool VisitedSet::find(const void *ptr, CheckedStructure & cs)
+{
+    std::shared_lock<std::shared_mutex> spanning_lock(spanning_mutex);
+    auto it = spanning.find(ptr);
+    if (it != spanning.end())
+    {
+        cs = it->second.second;
+        return true;
+    }
+
+    auto & shard = shard_for(ptr);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    it = shard.data.find(ptr);
+    if (it == shard.data.end())
+    {
+        return false;
+    }
+    cs = it->second.second;
+    return true;
+}
+
+void VisitedSet::set_identity(const void *ptr, const std::string & path, const type_identity *identity)
+{
+    // TODO: handle cases where this may overlap later data
+    {
+        std::shared_lock<std::shared_mutex> spanning_lock(spanning_mutex);
+        auto & shard = shard_for(ptr);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.data.find(ptr);
+        if (it != shard.data.end())
+        {
+            if (it->second.first == path)
+            {
+                it->second.second.identity = identity;
+            }
+            return;
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> spanning_lock(spanning_mutex);
+    auto it = spanning.find(ptr);
+    if (it != spanning.end() && it->second.first == path)
+    {
+        it->second.second.identity = identity;
+    }
+}
+
+uint64_t ValidatedCache::hash_contents(const void *ptr, size_t size)
+{
+    // FNV-1a, a word at a time
+    uint64_t hash = 14695981039346656037ULL;
+    auto bytes = reinterpret_cast<const uint8_t *>(ptr);
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+    {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        hash = (hash ^ word) * 1099511628211ULL;
+    }
+    for (; i < size; i++)
+    {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+bool ValidatedCache::contains(const void *ptr, const CheckedStructure & cs)
+{
+    value_type value;
+    {
+        auto & shard = shard_for(ptr);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.data.find(key_type{ cs.identity, ptr });
+        if (it == shard.data.end())
+        {
+            return false;
+        }
+        value = it->second;
+    }
+    return value.count == cs.count && value.hash == hash_contents(ptr, cs.full_size());
+}
+
+void ValidatedCache::add(const void *ptr, const CheckedStructure & cs)
+{
+    auto hash = hash_contents(ptr, cs.full_size());
+    auto & shard = shard_for(ptr);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.data[key_type{ cs.identity, ptr }] = value_type{ cs.count, hash };
+}
+
+void ValidatedCache::clear()
+{
+    for (auto & shard : shards)
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.data.clear();
+    }
+}
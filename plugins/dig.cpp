@@ -17,6 +17,7 @@
 #include "df/map_block.h"
 #include "df/world.h"
 
+#include <algorithm>
 #include <vector>
 #include <cstdio>
 #include <cstdlib>
@@ -138,14 +139,11 @@ DFhackCExport command_result plugin_load_site_data(color_ostream &out) {
         damp_config = World::AddPersistentSiteData(DAMP_CONFIG_KEY);
     }
 
-    for (auto & block : world->map.map_blocks) {
-        auto warm_mask = World::getPersistentTilemask(warm_config, block);
-        auto damp_mask = World::getPersistentTilemask(damp_config, block);
-        if (warm_mask || damp_mask) {
-            do_enable(true);
-            break;
-        }
-    }
+    std::vector<df::map_block *> blocks;
+    World::getPersistentTilemaskBlocks(&blocks, warm_config);
+    World::getPersistentTilemaskBlocks(&blocks, damp_config);
+    if (!blocks.empty())
+        do_enable(true);
 
     return CR_OK;
 }
@@ -177,9 +175,16 @@ static void do_cycle(color_ostream &out) {
     std::unordered_map<df::coord, df::job *> dig_jobs;
     fill_dig_jobs(dig_jobs);
 
+    // only the blocks that have a mask need to be looked at
+    std::vector<df::map_block *> blocks;
+    World::getPersistentTilemaskBlocks(&blocks, warm_config);
+    World::getPersistentTilemaskBlocks(&blocks, damp_config);
+    std::sort(blocks.begin(), blocks.end());
+    blocks.erase(std::unique(blocks.begin(), blocks.end()), blocks.end());
+
     bool has_assignment = false;
     uint32_t scrubbed = 0;
-    for (auto & block : world->map.map_blocks) {
+    for (auto block : blocks) {
         auto warm_mask = World::getPersistentTilemask(warm_config, block);
         auto damp_mask = World::getPersistentTilemask(damp_config, block);
         if (!warm_mask && !damp_mask)
@@ -37,6 +37,7 @@ using namespace DFHack;
 using namespace df::enums;
 
 DFHACK_PLUGIN("eventful");
+DFHACK_PLUGIN_IS_ENABLED(is_enabled);
 REQUIRE_GLOBAL(gps);
 REQUIRE_GLOBAL(world);
 REQUIRE_GLOBAL(plotinfo);
@@ -110,6 +111,15 @@ DEFINE_LUA_EVENT_NH_1(onReport, int32_t);
 DEFINE_LUA_EVENT_NH_3(onUnitAttack, int32_t, int32_t, int32_t);
 DEFINE_LUA_EVENT_NH_0(onUnload);
 DEFINE_LUA_EVENT_NH_6(onInteraction, std::string, std::string, int32_t, int32_t, int32_t, int32_t);
+//batched event manager events, delivered once per update with all events of the pass
+DEFINE_LUA_EVENT_NH_1(onBuildingCreatedDestroyedBatch, const std::vector<int32_t>&);
+DEFINE_LUA_EVENT_NH_1(onUnitNewActiveBatch, const std::vector<int32_t>&);
+DEFINE_LUA_EVENT_NH_1(onUnitDeathBatch, const std::vector<int32_t>&);
+DEFINE_LUA_EVENT_NH_1(onItemCreatedBatch, const std::vector<int32_t>&);
+DEFINE_LUA_EVENT_NH_1(onSyndromeBatch, const std::vector<int32_t>&);
+DEFINE_LUA_EVENT_NH_1(onInvasionBatch, const std::vector<int32_t>&);
+DEFINE_LUA_EVENT_NH_1(onReportBatch, const std::vector<int32_t>&);
+DEFINE_LUA_EVENT_NH_1(onUnitAttackBatch, const std::vector<int32_t>&);
 
 DFHACK_PLUGIN_LUA_EVENTS {
     DFHACK_LUA_EVENT(onWorkshopFillSidebarMenu),
@@ -137,6 +147,15 @@ DFHACK_PLUGIN_LUA_EVENTS {
     DFHACK_LUA_EVENT(onUnitAttack),
     DFHACK_LUA_EVENT(onUnload),
     DFHACK_LUA_EVENT(onInteraction),
+    /*  batched event manager events */
+    DFHACK_LUA_EVENT(onBuildingCreatedDestroyedBatch),
+    DFHACK_LUA_EVENT(onUnitNewActiveBatch),
+    DFHACK_LUA_EVENT(onUnitDeathBatch),
+    DFHACK_LUA_EVENT(onItemCreatedBatch),
+    DFHACK_LUA_EVENT(onSyndromeBatch),
+    DFHACK_LUA_EVENT(onInvasionBatch),
+    DFHACK_LUA_EVENT(onReportBatch),
+    DFHACK_LUA_EVENT(onUnitAttackBatch),
     DFHACK_LUA_END
 };
 
@@ -297,8 +316,139 @@ static void enableEvent(int evType,int freq)
     EventManager::registerListener(typeToEnable,EventManager::EventHandler(plugin_self,fun_ptr,freq));
     enabledEventManagerEvents[typeToEnable] = freq;
 }
+/*
+ * Batched delivery: events are collected into flat id arrays while
+ * EventManager runs its pass, and each array is handed to Lua in a single
+ * call from plugin_onupdate, which Core runs right after the pass.
+ */
+
+typedef void (*batch_notifier_t) (color_ostream&, const std::vector<int32_t>&);
+
+struct BatchedEvent {
+    handler_t collect = nullptr;
+    batch_notifier_t deliver = nullptr;
+};
+
+static std::array<std::vector<int32_t>, EventManager::EventType::EVENT_MAX> pendingBatches;
+std::vector<int> enabledBatchedEvents(EventManager::EventType::EVENT_MAX,-1);
+
+template<EventType t>
+static void ev_batch_id(color_ostream& out, void* ptr)
+{
+    pendingBatches[t].push_back((int32_t)(intptr_t)ptr);
+}
+static void ev_batch_syndrome(color_ostream& out, void* ptr)
+{
+    EventManager::SyndromeData* data=reinterpret_cast<EventManager::SyndromeData*>(ptr);
+    auto &batch = pendingBatches[SYNDROME];
+    batch.push_back(data->unitId);
+    batch.push_back(data->syndromeIndex);
+}
+static void ev_batch_unitAttack(color_ostream& out, void* ptr)
+{
+    EventManager::UnitAttackData* data = (EventManager::UnitAttackData*)ptr;
+    auto &batch = pendingBatches[UNIT_ATTACK];
+    batch.push_back(data->attacker);
+    batch.push_back(data->defender);
+    batch.push_back(data->wound);
+}
+
+// events that pass pointers which are only valid during the callback can't be batched
+BatchedEvent getBatchedEvent(EventType t) {
+    switch (t) {
+        case BUILDING:
+            return {ev_batch_id<BUILDING>, onBuildingCreatedDestroyedBatch};
+        case UNIT_NEW_ACTIVE:
+            return {ev_batch_id<UNIT_NEW_ACTIVE>, onUnitNewActiveBatch};
+        case UNIT_DEATH:
+            return {ev_batch_id<UNIT_DEATH>, onUnitDeathBatch};
+        case ITEM_CREATED:
+            return {ev_batch_id<ITEM_CREATED>, onItemCreatedBatch};
+        case SYNDROME:
+            return {ev_batch_syndrome, onSyndromeBatch};
+        case INVASION:
+            return {ev_batch_id<INVASION>, onInvasionBatch};
+        case REPORT:
+            return {ev_batch_id<REPORT>, onReportBatch};
+        case UNIT_ATTACK:
+            return {ev_batch_unitAttack, onUnitAttackBatch};
+        case TICK:
+        case JOB_INITIATED:
+        case JOB_STARTED:
+        case JOB_COMPLETED:
+        case CONSTRUCTION:
+        case INVENTORY_CHANGE:
+        case UNLOAD:
+        case INTERACTION:
+        case EVENT_MAX:
+            return {};
+    }
+    return {};
+}
+
+std::array<BatchedEvent,EventManager::EventType::EVENT_MAX> compileBatchedEventArray() {
+    std::array<BatchedEvent, EventManager::EventType::EVENT_MAX> batched{};
+    auto t = (EventManager::EventType::EventType) 0;
+    while (t < EventManager::EventType::EVENT_MAX) {
+        batched[t] = getBatchedEvent(t);
+        t = (EventManager::EventType::EventType) int(t + 1);
+    }
+    return batched;
+}
+static std::array<BatchedEvent,EventManager::EventType::EVENT_MAX> batchedEvents;
+
+static void enableBatchedEvent(int evType,int freq)
+{
+    if (freq < 0)
+        return;
+    CHECK_INVALID_ARGUMENT(evType >= 0 && evType < EventManager::EventType::EVENT_MAX &&
+                           batchedEvents[evType].collect);
+    EventManager::EventHandler::callback_t fun_ptr = batchedEvents[evType].collect;
+    EventManager::EventType::EventType typeToEnable=static_cast<EventManager::EventType::EventType>(evType);
+
+    int oldFreq = enabledBatchedEvents[typeToEnable];
+    if (oldFreq != -1) {
+        if (freq >= oldFreq)
+            return;
+        EventManager::unregister(typeToEnable,EventManager::EventHandler(plugin_self,fun_ptr,oldFreq));
+    }
+    EventManager::registerListener(typeToEnable,EventManager::EventHandler(plugin_self,fun_ptr,freq));
+    enabledBatchedEvents[typeToEnable] = freq;
+    is_enabled = true;
+}
+
+// unregisters every batched listener; Lua has to enable them again
+static void disableBatchedEvents()
+{
+    for (int t = 0; t < EventManager::EventType::EVENT_MAX; ++t) {
+        if (enabledBatchedEvents[t] == -1)
+            continue;
+        EventManager::unregister((EventManager::EventType::EventType)t,
+            EventManager::EventHandler(plugin_self,batchedEvents[t].collect,enabledBatchedEvents[t]));
+        enabledBatchedEvents[t] = -1;
+    }
+    for (auto &pending : pendingBatches)
+        pending.clear();
+    is_enabled = false;
+}
+
+static void deliverBatches(color_ostream &out)
+{
+    static std::vector<int32_t> batch;
+    for (size_t t = 0; t < pendingBatches.size(); ++t) {
+        if (pendingBatches[t].empty())
+            continue;
+        // swap out first so that handlers which trigger new events can't
+        // modify the array being delivered
+        batch.swap(pendingBatches[t]);
+        batchedEvents[t].deliver(out, batch);
+        batch.clear();
+    }
+}
+
 DFHACK_PLUGIN_LUA_FUNCTIONS{
     DFHACK_LUA_FUNCTION(enableEvent),
+    DFHACK_LUA_FUNCTION(enableBatchedEvent),
     DFHACK_LUA_END
 };
 struct workshop_hook : df::building_workshopst{
@@ -508,7 +658,7 @@ DFhackCExport command_result plugin_onstatechange(color_ostream &out, state_chan
         break;
     case SC_WORLD_UNLOADED:
         world_specific_hooks(out,false);
-
+        disableBatchedEvents();
         break;
     default:
         break;
@@ -520,12 +670,28 @@ DFhackCExport command_result plugin_onstatechange(color_ostream &out, state_chan
 DFhackCExport command_result plugin_init ( color_ostream &out, std::vector <PluginCommand> &commands)
 {
     eventHandlers = compileEventHandlerArray();
+    batchedEvents = compileBatchedEventArray();
     if (Core::getInstance().isWorldLoaded())
         plugin_onstatechange(out, SC_WORLD_LOADED);
     enable_hooks(true);
     return CR_OK;
 }
 
+DFhackCExport command_result plugin_enable(color_ostream &out, bool enable)
+{
+    if (!enable)
+        disableBatchedEvents();
+    else
+        is_enabled = true;
+    return CR_OK;
+}
+
+DFhackCExport command_result plugin_onupdate ( color_ostream &out )
+{
+    deliverBatches(out);
+    return CR_OK;
+}
+
 DFhackCExport command_result plugin_shutdown ( color_ostream &out )
 {
     disable_all_hooks(out);
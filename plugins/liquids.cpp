@@ -39,15 +39,12 @@
 #include <iostream>
 #include <map>
 #include <memory>
-#include <set>
 #include <sstream>
-#include <stack>
 #include <vector>
 
 using std::vector;
 using std::string;
 using std::endl;
-using std::set;
 
 #include "Brushes.h"
 
@@ -446,101 +443,66 @@ command_result df_liquids_execute(color_ostream &out, OperationMode &cur_mode, d
     }
 
     MapCache mcache;
-    coord_vec all_tiles = brush->points(mcache,cursor);
 
     // Force the game to recompute its walkability cache
     world->reindex_pathfinding = true;
 
-    switch (cur_mode.paint)
-    {
-    case P_OBSIDIAN:
+    brush->forBlocks(mcache, cursor, [&](const df::coord &origin, const brush_rows &rows) {
+        Block *block = mcache.BlockAtTile(origin);
+        if (!block)
+            return;
+        switch (cur_mode.paint)
         {
-            coord_vec::iterator iter = all_tiles.begin();
-            while (iter != all_tiles.end())
-            {
-                mcache.setTiletypeAt(*iter, tiletype::LavaWall);
-                mcache.setTemp1At(*iter,10015);
-                mcache.setTemp2At(*iter,10015);
-                df::tile_designation des = mcache.designationAt(*iter);
+        case P_OBSIDIAN:
+            forBrushTiles(rows, [&](const df::coord2d &pos) {
+                block->setTiletypeAt(pos, tiletype::LavaWall);
+                block->setTemp1At(pos,10015);
+                block->setTemp2At(pos,10015);
+                df::tile_designation des = block->DesignationAt(pos);
                 des.bits.flow_size = 0;
                 des.bits.flow_forbid = false;
-                mcache.setDesignationAt(*iter, des);
-                iter ++;
-            }
+                block->setDesignationAt(pos, des);
+            });
             break;
-        }
-    case P_OBSIDIAN_FLOOR:
-        {
-            coord_vec::iterator iter = all_tiles.begin();
-            while (iter != all_tiles.end())
-            {
-                mcache.setTiletypeAt(*iter, findRandomVariant(tiletype::LavaFloor1));
-                iter ++;
-            }
+        case P_OBSIDIAN_FLOOR:
+            forBrushTiles(rows, [&](const df::coord2d &pos) {
+                block->setTiletypeAt(pos, findRandomVariant(tiletype::LavaFloor1));
+            });
             break;
-        }
-    case P_RIVER_SOURCE:
-        {
-            coord_vec::iterator iter = all_tiles.begin();
-            while (iter != all_tiles.end())
-            {
-                mcache.setTiletypeAt(*iter, tiletype::RiverSource);
+        case P_RIVER_SOURCE:
+            forBrushTiles(rows, [&](const df::coord2d &pos) {
+                block->setTiletypeAt(pos, tiletype::RiverSource);
 
-                df::tile_designation a = mcache.designationAt(*iter);
+                df::tile_designation a = block->DesignationAt(pos);
                 a.bits.liquid_type = tile_liquid::Water;
                 a.bits.liquid_static = false;
                 a.bits.flow_size = 7;
-                mcache.setTemp1At(*iter,10015);
-                mcache.setTemp2At(*iter,10015);
-                mcache.setDesignationAt(*iter,a);
-
-                Block * b = mcache.BlockAt((*iter)/16);
-                b->enableBlockUpdates(true);
-
-                iter++;
-            }
+                block->setTemp1At(pos,10015);
+                block->setTemp2At(pos,10015);
+                block->setDesignationAt(pos,a);
+            });
+            block->enableBlockUpdates(true);
             break;
-        }
-    case P_WCLEAN:
-        {
-            coord_vec::iterator iter = all_tiles.begin();
-            while (iter != all_tiles.end())
-            {
-                DFHack::DFCoord current = *iter;
-                df::tile_designation des = mcache.designationAt(current);
+        case P_WCLEAN:
+            forBrushTiles(rows, [&](const df::coord2d &pos) {
+                df::tile_designation des = block->DesignationAt(pos);
                 des.bits.water_salt = false;
                 des.bits.water_stagnant = false;
-                mcache.setDesignationAt(current,des);
-                iter++;
-            }
+                block->setDesignationAt(pos,des);
+            });
             break;
-        }
-    case P_MAGMA:
-    case P_WATER:
-    case P_FLOW_BITS:
+        case P_MAGMA:
+        case P_WATER:
+        case P_FLOW_BITS:
         {
-            set <Block *> seen_blocks;
-            coord_vec::iterator iter = all_tiles.begin();
-            while (iter != all_tiles.end())
-            {
-                DFHack::DFCoord current = *iter; // current tile coord
-                DFHack::DFCoord curblock = current /16; // current block coord
-                // check if the block is actually there
-                auto block = mcache.BlockAt(curblock);
-                if(!block)
-                {
-                    iter ++;
-                    continue;
-                }
-                auto raw_block = block->getRaw();
-                df::tile_designation des = mcache.designationAt(current);
-                df::tiletype tt = mcache.tiletypeAt(current);
+            auto raw_block = block->getRaw();
+            bool touched = false;
+            forBrushTiles(rows, [&](const df::coord2d &pos) {
+                df::tile_designation des = block->DesignationAt(pos);
+                df::tiletype tt = block->tiletypeAt(pos);
                 // don't put liquids into places where they don't belong...
                 if(!DFHack::FlowPassable(tt))
-                {
-                    iter++;
-                    continue;
-                }
+                    return;
                 if(cur_mode.paint != P_FLOW_BITS)
                 {
                     unsigned old_amount = des.bits.flow_size;
@@ -577,57 +539,54 @@ command_result df_liquids_execute(color_ostream &out, OperationMode &cur_mode, d
                     {
                         if (new_liquid == tile_liquid::Water)
                         {
-                            mcache.setTemp1At(current,10015);
-                            mcache.setTemp2At(current,10015);
+                            block->setTemp1At(pos,10015);
+                            block->setTemp2At(pos,10015);
                         }
                         else
                         {
-                            mcache.setTemp1At(current,12000);
-                            mcache.setTemp2At(current,12000);
+                            block->setTemp1At(pos,12000);
+                            block->setTemp2At(pos,12000);
                         }
                     }
                     // mark the tile passable or impassable like the game does
                     des.bits.flow_forbid = (new_liquid == tile_liquid::Magma || new_amount > 3);
-                    mcache.setDesignationAt(current,des);
+                    block->setDesignationAt(pos,des);
                     // request flow engine updates
                     block->enableBlockUpdates(new_amount != old_amount, new_liquid != old_liquid);
                 }
                 if (cur_mode.permaflow != PF_KEEP && raw_block)
                 {
-                    auto &flow = raw_block->liquid_flow[current.x&15][current.y&15];
+                    auto &flow = raw_block->liquid_flow[pos.x][pos.y];
                     flow.bits.perm_flow_dir = permaflow_id[cur_mode.permaflow];
                     flow.bits.temp_flow_timer = 0;
                 }
-                seen_blocks.insert(block);
-                iter++;
-            }
-            set <Block *>::iterator biter = seen_blocks.begin();
-            while (biter != seen_blocks.end())
+                touched = true;
+            });
+            if (!touched)
+                break;
+            switch (cur_mode.flowmode)
             {
-                switch (cur_mode.flowmode)
+            case M_INC:
+                block->enableBlockUpdates(true);
+                break;
+            case M_DEC:
+                if (raw_block)
                 {
-                case M_INC:
-                    (*biter)->enableBlockUpdates(true);
-                    break;
-                case M_DEC:
-                    if (auto block = (*biter)->getRaw())
-                    {
-                        block->flags.bits.update_liquid = false;
-                        block->flags.bits.update_liquid_twice = false;
-                    }
-                    break;
-                case M_KEEP:
-                    {
-                        auto bflags = (*biter)->BlockFlags();
-                        out << "flow bit 1 = " << bflags.bits.update_liquid << endl;
-                        out << "flow bit 2 = " << bflags.bits.update_liquid_twice << endl;
-                    }
+                    raw_block->flags.bits.update_liquid = false;
+                    raw_block->flags.bits.update_liquid_twice = false;
+                }
+                break;
+            case M_KEEP:
+                {
+                    auto bflags = block->BlockFlags();
+                    out << "flow bit 1 = " << bflags.bits.update_liquid << endl;
+                    out << "flow bit 2 = " << bflags.bits.update_liquid_twice << endl;
                 }
-                biter ++;
             }
             break;
         }
-    }
+        }
+    });
 
     if(!mcache.WriteAll())
     {
@@ -61,6 +61,12 @@ end
 function client:send( data )
     _funcs.lua_client_send(self.server_id,self.client_id,data)
 end
+function client:pending()
+    return _funcs.lua_client_pending(self.server_id,self.client_id)
+end
+function client:flush()
+    return _funcs.lua_client_flush(self.server_id,self.client_id)
+end
 
 
 local server=defclass(server,socket)
@@ -82,5 +88,17 @@ function tcp:connect( address,port )
     local id=_funcs.lua_socket_connect(address,port)
     return client{client_id=id}
 end
+function tcp:poll( sockets,sec,msec )
+    local server_ids,client_ids={},{}
+    for i,sock in ipairs(sockets) do
+        server_ids[i]=sock.server_id
+        client_ids[i]=sock.client_id
+    end
+    local ready={}
+    for _,idx in ipairs(_funcs.lua_socket_poll(server_ids,client_ids,sec or 0,msec or 0)) do
+        table.insert(ready,sockets[idx])
+    end
+    return ready
+end
 --TODO garbage collect stuff
 return _ENV
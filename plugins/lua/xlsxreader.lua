@@ -21,6 +21,33 @@ function XlsxioSheetReader:get_row(max_tokens)
     return get_row(self.sheet_handle, max_tokens)
 end
 
+-- reads the non-empty cells of the rest of the sheet, or of the given range.
+-- see get_cells in the API docs for the format of the returned table.
+function XlsxioSheetReader:get_cells(first_row, first_col, last_row, last_col)
+    return get_cells(self.sheet_handle, first_row, first_col, last_row, last_col)
+end
+
+XlsxioReadJob = defclass(XlsxioReadJob, nil)
+XlsxioReadJob.ATTRS{
+    -- id returned by start_read. required.
+    job_id = DEFAULT_NIL,
+}
+
+-- returns nil while the sheet is still being read, then the cells
+function XlsxioReadJob:get_result()
+    if not self.result then
+        self.result = get_read_result(self.job_id)
+    end
+    return self.result
+end
+
+-- starts reading the cells of a sheet on a separate thread and returns an
+-- XlsxioReadJob. if sheet_name is empty or nil, reads the first sheet
+function read_sheet_async(filepath, sheet_name, first_row, first_col, last_row, last_col)
+    local job_id = start_read(filepath, sheet_name or '', first_row, first_col, last_row, last_col)
+    return XlsxioReadJob{job_id=job_id}
+end
+
 XlsxioReader = defclass(XlsxioReader, nil)
 XlsxioReader.ATTRS{
     -- full or relative path to the target .xlsx file. required.
@@ -4,12 +4,19 @@
 #include "PluginManager.h"
 #include "DataDefs.h"
 
+#include <algorithm>
+#include <chrono>
 #include <vector>
 #include <string>
 #include <map>
 #include <memory>
 #include <PassiveSocket.h>
 #include <ActiveSocket.h>
+#ifdef _WIN32
+#define poll WSAPoll
+#else
+#include <poll.h>
+#endif
 #include "MiscUtils.h"
 #include "LuaTools.h"
 #include "DataFuncs.h"
@@ -17,34 +24,65 @@
 
 using namespace DFHack;
 using namespace df::enums;
+
+//size of a single read from the socket
+static const int RECEIVE_CHUNK=16384;
+//largest single write; the rest stays queued
+static const size_t SEND_CHUNK=65536;
+//longest time closing a socket waits for queued data to go out
+static const int CLOSE_FLUSH_MS=5000;
+
+struct client
+{
+    CActiveSocket *socket;
+    //data read from the socket but not yet returned by receive
+    std::string received;
+    //data given to send but not yet accepted by the socket, from unsent_pos on
+    std::string unsent;
+    size_t unsent_pos;
+    //error from sending queued data in the background, reported by the next send
+    CSimpleSocket::CSocketError send_error;
+
+    client(CActiveSocket *socket=NULL):socket(socket),unsent_pos(0),send_error(CSimpleSocket::SocketSuccess){}
+    size_t pending() const { return unsent.size()-unsent_pos; }
+    void close();
+};
+static void flush_before_close(client &c);
+typedef std::map<int,client> clients_map;
 struct server
 {
     CPassiveSocket *socket;
-    std::map<int,CActiveSocket*> clients;
+    clients_map clients;
     int last_client_id;
     void close();
 };
 std::map<int,server> servers;
-typedef std::map<int,CActiveSocket*> clients_map;
 clients_map clients; //free clients, i.e. non-server spawned clients
 DFHACK_PLUGIN("luasocket");
+//enabled while there is queued data to send, so plugin_onupdate can push it out
+DFHACK_PLUGIN_IS_ENABLED(is_enabled);
 
 
+void client::close()
+{
+    flush_before_close(*this);
+    socket->Close();
+    delete socket;
+    socket=NULL;
+}
 void server::close()
 {
     for(auto it=clients.begin();it!=clients.end();it++)
     {
-        CActiveSocket* sock=it->second;
-        sock->Close();
-        delete sock;
+        it->second.close();
     }
     clients.clear();
     socket->Close();
     delete socket;
 }
-std::pair<CActiveSocket*,clients_map*> get_client(int server_id,int client_id)
+std::pair<client*,clients_map*> get_client(int server_id,int client_id)
 {
-    std::map<int,CActiveSocket*>* target=&clients;
+    clients_map* target=&clients;
     if(server_id>0)
     {
         if(servers.count(server_id)==0)
@@ -59,8 +97,7 @@ std::pair<CActiveSocket*,clients_map*> get_client(int server_id,int client_id)
     {
         throw std::runtime_error("Client does with this id not exist");
     }
-    CActiveSocket *sock=(*target)[client_id];
-    return std::make_pair(sock,target);
+    return std::make_pair(&(*target)[client_id],target);
 }
 void handle_error(CSimpleSocket::CSocketError err,bool skip_timeout=true)
 {
@@ -109,7 +146,7 @@ static int lua_server_accept(int id,bool fail_on_timeout)
     else
     {
         cur_server.last_client_id++;
-        cur_server.clients[cur_server.last_client_id]=sock;
+        cur_server.clients[cur_server.last_client_id]=client(sock);
         return cur_server.last_client_id;
     }
 }
@@ -117,8 +154,9 @@ static void lua_client_close(int server_id,int client_id)
 {
     auto info=get_client(server_id,client_id);
 
-    CActiveSocket *sock=info.first;
-    std::map<int,CActiveSocket*>* target=info.second;
+    flush_before_close(*info.first);
+    CActiveSocket *sock=info.first->socket;
+    clients_map* target=info.second;
 
     target->erase(client_id);
     CSimpleSocket::CSocketError err=CSimpleSocket::SocketSuccess;
@@ -146,56 +184,199 @@ static void lua_server_close(int server_id)
         throw;
     }
 }
+//hands as much queued data to the socket as it takes without blocking
+static void pump_send(client &c)
+{
+    CActiveSocket *sock=c.socket;
+    bool was_blocking=!sock->IsNonblocking();
+    if(was_blocking)
+        sock->SetNonblocking();
+    while(c.pending()>0)
+    {
+        size_t count=std::min(c.pending(),SEND_CHUNK);
+        int32_t sent=sock->Send((const uint8_t*)c.unsent.data()+c.unsent_pos,count);
+        if(sent<=0)
+        {
+            CSimpleSocket::CSocketError err=sock->GetSocketError();
+            if(err!=CSimpleSocket::SocketEwouldblock && err!=CSimpleSocket::SocketTimedout && err!=CSimpleSocket::SocketSuccess)
+            {
+                //the connection is broken; nothing queued is going to get through
+                c.send_error=err;
+                c.unsent.clear();
+                c.unsent_pos=0;
+            }
+            break;
+        }
+        c.unsent_pos+=sent;
+    }
+    if(was_blocking)
+        sock->SetBlocking();
+
+    if(c.pending()==0)
+    {
+        c.unsent.clear();
+        c.unsent_pos=0;
+    }
+    else if(c.unsent_pos>c.unsent.size()/2)
+    {
+        c.unsent.erase(0,c.unsent_pos);
+        c.unsent_pos=0;
+    }
+    if(c.pending()>0)
+        is_enabled=true;
+}
+//waits up to timeout_ms (forever if negative) for the socket to be ready for
+//the given poll events. returns the events that are ready, or 0 on timeout
+static short wait_socket(CSimpleSocket *sock,short events,int timeout_ms)
+{
+    pollfd pfd;
+    pfd.fd=sock->GetSocketDescriptor();
+    pfd.events=events;
+    pfd.revents=0;
+    if(poll(&pfd,1,timeout_ms)<=0)
+        return 0;
+    return pfd.revents;
+}
+static int receive_timeout_ms(CSimpleSocket *sock)
+{
+    int32_t sec=sock->GetReceiveTimeoutSec(),usec=sock->GetReceiveTimeoutUSec();
+    if(sec==0 && usec==0)
+        return -1;
+    return sec*1000+usec/1000;
+}
+//keeps queued data moving while a blocking read waits for its answer, so a
+//request that is still partly queued can't hold up its own response
+static void send_while_waiting(client &c)
+{
+    if(c.pending()==0)
+        return;
+    if(c.socket->IsNonblocking())
+    {
+        pump_send(c);
+        return;
+    }
+    int timeout_ms=receive_timeout_ms(c.socket);
+    while(c.pending()>0)
+    {
+        short ready=wait_socket(c.socket,POLLIN|POLLOUT,timeout_ms);
+        //on a timeout or anything to read, the read itself reports what happened
+        if(ready==0 || (ready & ~POLLOUT))
+            return;
+        pump_send(c);
+    }
+}
+//sends the queue out before the socket goes away, waiting a bounded time
+static void flush_before_close(client &c)
+{
+    if(!c.socket)
+        return;
+    auto deadline=std::chrono::steady_clock::now()+std::chrono::milliseconds(CLOSE_FLUSH_MS);
+    pump_send(c);
+    while(c.pending()>0)
+    {
+        auto left=std::chrono::duration_cast<std::chrono::milliseconds>(deadline-std::chrono::steady_clock::now()).count();
+        if(left<=0 || !(wait_socket(c.socket,POLLOUT,int(left)) & POLLOUT))
+            break;
+        pump_send(c);
+    }
+}
+//sends everything queued, waiting for the socket like a blocking send. a
+//timeout leaves the rest queued for the background; other errors drop it
+static void send_all(client &c)
+{
+    CActiveSocket *sock=c.socket;
+    while(c.pending()>0)
+    {
+        size_t count=std::min(c.pending(),SEND_CHUNK);
+        int32_t sent=sock->Send((const uint8_t*)c.unsent.data()+c.unsent_pos,count);
+        if(sent<=0)
+        {
+            CSimpleSocket::CSocketError err=sock->GetSocketError();
+            c.send_error=(err==CSimpleSocket::SocketSuccess)?CSimpleSocket::SocketEunknown:err;
+            if(err==CSimpleSocket::SocketTimedout || err==CSimpleSocket::SocketEwouldblock)
+            {
+                is_enabled=true;
+            }
+            else
+            {
+                c.unsent.clear();
+                c.unsent_pos=0;
+            }
+            return;
+        }
+        c.unsent_pos+=sent;
+    }
+    c.unsent.clear();
+    c.unsent_pos=0;
+}
+//reads whatever the socket has (or waits for it, if blocking) into the receive buffer.
+//returns the number of bytes read, 0 if the connection was closed, or <0 on error
+static int fill_buffer(client &c,int bytes=RECEIVE_CHUNK)
+{
+    send_while_waiting(c);
+    int received=c.socket->Receive(std::max(bytes,RECEIVE_CHUNK));
+    if(received>0)
+        c.received.append((char*)c.socket->GetData(),received);
+    return received;
+}
+static std::string take_received(client &c,size_t count,size_t skip=0)
+{
+    std::string ret=c.received.substr(0,count);
+    c.received.erase(0,count+skip);
+    return ret;
+}
 static std::string lua_client_receive(int server_id,int client_id,int bytes,std::string pattern,bool fail_on_timeout)
 {
     auto info=get_client(server_id,client_id);
-    CActiveSocket *sock=info.first;
+    client &c=*info.first;
+    CActiveSocket *sock=c.socket;
+    //buffered data is kept on errors and timeouts, so it is returned by a later call
     if(bytes>0)
     {
-        if(sock->Receive(bytes)<=0)
+        while(c.received.size()<size_t(bytes))
         {
-            throw std::runtime_error(sock->DescribeError());
+            if(fill_buffer(c,bytes-int(c.received.size()))<=0)
+            {
+                throw std::runtime_error(sock->DescribeError());
+            }
         }
-        return std::string((char*)sock->GetData(),bytes);
+        return take_received(c,bytes);
     }
     else
     {
-        std::string ret;
         if(pattern=="*a") //??
         {
             while(true)
             {
-                int received=sock->Receive(1);
+                int received=fill_buffer(c);
                 if(received<0)
                 {
                     handle_error(sock->GetSocketError(),!fail_on_timeout);
-                    return "";//maybe return partial string?
+                    return "";//what was read so far stays buffered
                 }
                 else if(received==0)
                 {
                     break;
                 }
-                ret+=(char)*sock->GetData();
-
             }
-            return ret;
+            return take_received(c,c.received.size());
         }
         else if (pattern=="" || pattern=="*l")
         {
+            size_t searched=0;
             while(true)
             {
+                size_t eol=c.received.find('\n',searched);
+                if(eol!=std::string::npos)
+                    return take_received(c,eol,1);
+                searched=c.received.size();
 
-                if(sock->Receive(1)<=0)
+                if(fill_buffer(c)<=0)
                 {
                     handle_error(sock->GetSocketError(),!fail_on_timeout);
-                    return "";//maybe return partial string?
+                    return "";//the partial line stays buffered
                 }
-                char rec=(char)*sock->GetData();
-                if(rec=='\n')
-                    break;
-                ret+=rec;
             }
-            return ret;
         }
         else
         {
@@ -203,30 +384,42 @@ static std::string lua_client_receive(int server_id,int client_id,int bytes,std:
         }
     }
 }
+static void check_send_error(client &c)
+{
+    CSimpleSocket::CSocketError err=c.send_error;
+    c.send_error=CSimpleSocket::SocketSuccess;
+    handle_error(err,false);
+}
 static void lua_client_send(int server_id,int client_id,std::string data)
 {
+    auto info=get_client(server_id,client_id);
+    client &c=*info.first;
+    check_send_error(c);
     if(data.size()==0)
         return;
-    std::map<int,CActiveSocket*>* target=&clients;
-    if(server_id>0)
-    {
-        if(servers.count(server_id)==0)
-        {
-            throw std::runtime_error("Server with this id does not exist");
-        }
-        server &cur_server=servers[server_id];
-        target=&cur_server.clients;
-    }
-
-    if(target->count(client_id)==0)
-    {
-        throw std::runtime_error("Client does with this id not exist");
-    }
-    CActiveSocket *sock=(*target)[client_id];
-    if(size_t(sock->Send((const uint8_t*)data.c_str(),data.size()))!=data.size())
-    {
-        throw std::runtime_error(sock->DescribeError());
-    }
+    //queued behind anything that hasn't gone out yet, so the order is kept
+    c.unsent.append(data);
+    //blocking sockets keep blocking send semantics; only non-blocking ones
+    //leave data queued for the background
+    if(c.socket->IsNonblocking())
+        pump_send(c);
+    else
+        send_all(c);
+    check_send_error(c);
+}
+static size_t lua_client_flush(int server_id,int client_id)
+{
+    auto info=get_client(server_id,client_id);
+    client &c=*info.first;
+    check_send_error(c);
+    pump_send(c);
+    check_send_error(c);
+    return c.pending();
+}
+static size_t lua_client_pending(int server_id,int client_id)
+{
+    auto info=get_client(server_id,client_id);
+    return info.first->pending();
 }
 static int lua_socket_connect(std::string ip,int port)
 {
@@ -246,12 +439,12 @@ static int lua_socket_connect(std::string ip,int port)
     }
     sock->SetNonblocking();
     last_client_id++;
-    clients[last_client_id]=sock;
+    clients[last_client_id]=client(sock);
     return last_client_id;
 }
 CSimpleSocket* get_socket(int server_id, int client_id)
 {
-    std::map<int, CActiveSocket*>* target = &clients;
+    clients_map* target = &clients;
     if (server_id>0)
     {
         if (servers.count(server_id) == 0)
@@ -270,8 +463,7 @@ CSimpleSocket* get_socket(int server_id, int client_id)
     {
         throw std::runtime_error("Client does with this id not exist");
     }
-    CActiveSocket *sock = (*target)[client_id];
-    return sock;
+    return (*target)[client_id].socket;
 }
 static void lua_socket_set_timeout(int server_id,int client_id,int32_t sec,int32_t msec)
 {
@@ -287,6 +479,16 @@ static void lua_socket_set_timeout(int server_id,int client_id,int32_t sec,int32
 static bool lua_socket_select(int server_id, int client_id, int32_t sec, int32_t msec)
 {
     CSimpleSocket *sock = get_socket(server_id, client_id);
+    if (client_id != -1)
+    {
+        client &c = *get_client(server_id, client_id).first;
+        // receive() reads ahead, so whole lines may already be waiting here
+        // while the socket itself has nothing more
+        if (c.received.find('\n') != std::string::npos)
+            return true;
+        if (c.pending() > 0)
+            pump_send(c);
+    }
     return sock->Select(sec, msec);
 }
 static void lua_socket_set_blocking(int server_id, int client_id, bool value)
@@ -312,6 +514,88 @@ static bool lua_socket_is_blocking(int server_id, int client_id)
     CSimpleSocket *sock = get_socket(server_id, client_id);
     return !sock->IsNonblocking();
 }
+// poll(server_ids, client_ids, sec, msec)
+// waits until at least one of the given sockets is ready and returns the
+// (1-based) indices of the ready ones. a client is ready when a full line is
+// already buffered, or the socket has data or was closed. a server is ready
+// when a connection is waiting to be accepted.
+static int lua_socket_poll(lua_State *L)
+{
+    luaL_checktype(L, 1, LUA_TTABLE);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    int32_t sec = luaL_optinteger(L, 3, 0);
+    int32_t msec = luaL_optinteger(L, 4, 0);
+    size_t count = lua_rawlen(L, 1);
+
+    std::vector<CSimpleSocket*> socks(count);
+    std::vector<bool> ready(count, false);
+    bool any_buffered = false;
+    try
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            lua_rawgeti(L, 1, i + 1);
+            lua_rawgeti(L, 2, i + 1);
+            int server_id = luaL_checkint(L, -2);
+            int client_id = luaL_checkint(L, -1);
+            lua_pop(L, 2);
+
+            socks[i] = get_socket(server_id, client_id);
+            if (client_id != -1)
+            {
+                client &c = *get_client(server_id, client_id).first;
+                if (c.received.find('\n') != std::string::npos)
+                    ready[i] = any_buffered = true;
+                // a script waiting here for a response to what it sent
+                // needs the request to go out first
+                if (c.pending() > 0)
+                    pump_send(c);
+            }
+        }
+    }
+    catch (std::exception &e)
+    {
+        return luaL_error(L, "%s", e.what());
+    }
+
+    std::vector<pollfd> pfds;
+    std::vector<size_t> pfd_index;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (ready[i] || !socks[i]->IsSocketValid())
+            continue;
+        pollfd pfd;
+        pfd.fd = socks[i]->GetSocketDescriptor();
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        pfds.push_back(pfd);
+        pfd_index.push_back(i);
+    }
+
+    if (!pfds.empty())
+    {
+        // don't wait if something is ready already
+        int timeout_ms = any_buffered ? 0 : sec * 1000 + msec;
+        if (poll(pfds.data(), pfds.size(), timeout_ms) < 0)
+            return luaL_error(L, "poll failed");
+        for (size_t j = 0; j < pfds.size(); j++)
+        {
+            if (pfds[j].revents)
+                ready[pfd_index[j]] = true;
+        }
+    }
+
+    lua_newtable(L);
+    int n = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (!ready[i])
+            continue;
+        lua_pushinteger(L, i + 1);
+        lua_rawseti(L, -2, ++n);
+    }
+    return 1;
+}
 DFHACK_PLUGIN_LUA_FUNCTIONS {
     DFHACK_LUA_FUNCTION(lua_socket_bind), //spawn a server
     DFHACK_LUA_FUNCTION(lua_socket_connect),//spawn a client (i.e. connection)
@@ -323,21 +607,43 @@ DFHACK_PLUGIN_LUA_FUNCTIONS {
     DFHACK_LUA_FUNCTION(lua_server_close),
     DFHACK_LUA_FUNCTION(lua_client_close),
     DFHACK_LUA_FUNCTION(lua_client_send),
+    DFHACK_LUA_FUNCTION(lua_client_flush),
+    DFHACK_LUA_FUNCTION(lua_client_pending),
     DFHACK_LUA_FUNCTION(lua_client_receive),
     DFHACK_LUA_END
 };
+DFHACK_PLUGIN_LUA_COMMANDS {
+    DFHACK_LUA_COMMAND(lua_socket_poll),
+    DFHACK_LUA_END
+};
 DFhackCExport command_result plugin_init ( color_ostream &out, std::vector <PluginCommand> &commands)
 {
 
     return CR_OK;
 }
+DFhackCExport command_result plugin_onupdate ( color_ostream &out )
+{
+    is_enabled=false;
+    for(auto it=clients.begin();it!=clients.end();it++)
+    {
+        if(it->second.pending()>0)
+            pump_send(it->second);
+    }
+    for(auto it=servers.begin();it!=servers.end();it++)
+    {
+        for(auto c=it->second.clients.begin();c!=it->second.clients.end();c++)
+        {
+            if(c->second.pending()>0)
+                pump_send(c->second);
+        }
+    }
+    return CR_OK;
+}
 DFhackCExport command_result plugin_shutdown ( color_ostream &out )
 {
     for(auto it=clients.begin();it!=clients.end();it++)
     {
-        CActiveSocket* sock=it->second;
-        sock->Close();
-        delete sock;
+        it->second.close();
     }
     clients.clear();
     for(auto it=servers.begin();it!=servers.end();it++)
@@ -10,15 +10,20 @@
 
 #include "df/building_tradedepotst.h"
 #include "df/init.h"
+#include "df/map_block.h"
 #include "df/plotinfost.h"
 #include "df/world.h"
 
+#include <algorithm>
+
 using namespace DFHack;
-using std::stack;
+using Maps::BlockGrid;
+using Maps::TileBitmap;
 using std::unordered_set;
 
 DFHACK_PLUGIN("pathable");
 
+REQUIRE_GLOBAL(building_next_id);
 REQUIRE_GLOBAL(init);
 REQUIRE_GLOBAL(plotinfo);
 REQUIRE_GLOBAL(window_x);
@@ -191,25 +196,161 @@ static bool getDepotAccessibleByAnimals(color_ostream &out) {
     return get_entry_tiles(NULL, depot_pathability_groups);
 }
 
+// Tiles waiting to be expanded, bucketed by block so that the flood works
+// through one block at a time instead of jumping around the map
+class Frontier {
+    struct Bucket {
+        size_t block_idx;
+        df::coord origin;
+        std::vector<uint8_t> tiles; // (y << 4) | x within the block
+    };
+
+    const BlockGrid * grid = NULL;
+    std::vector<int32_t> bucket_of_block;
+    std::vector<Bucket> buckets;
+    std::vector<int32_t> active; // buckets with tiles in them
+
+public:
+    void reset(const BlockGrid & new_grid) {
+        grid = &new_grid;
+        bucket_of_block.assign(grid->size(), -1);
+        buckets.clear();
+        active.clear();
+    }
+
+    void push(const df::coord & pos) {
+        if (!grid->contains(pos))
+            return;
+        size_t idx = grid->index(pos);
+        int32_t & b = bucket_of_block[idx];
+        if (b < 0) {
+            b = buckets.size();
+            buckets.push_back({idx, df::coord(pos.x & ~15, pos.y & ~15, pos.z), {}});
+        }
+        auto & bucket = buckets[b];
+        if (bucket.tiles.empty())
+            active.push_back(b);
+        bucket.tiles.push_back(((pos.y & 15) << 4) | (pos.x & 15));
+    }
+
+    bool pop(df::coord & pos) {
+        while (!active.empty()) {
+            auto & bucket = buckets[active.back()];
+            if (bucket.tiles.empty()) {
+                active.pop_back();
+                continue;
+            }
+            uint8_t tile = bucket.tiles.back();
+            bucket.tiles.pop_back();
+            pos = bucket.origin + df::coord(tile & 15, tile >> 4, 0);
+            return true;
+        }
+        return false;
+    }
+};
+
+/*
+ * The result of the last wagon flood, plus what it was computed from. The
+ * flood is only redone if the depots, the entry tiles, or the buildings have
+ * changed, or if the contents of any map block that the flood read from
+ * (tile types and walkability groups) are different now. The blocks are only
+ * compared once per game tick; within a tick, the other keys are enough.
+ */
+struct WagonCache {
+    bool valid = false;
+    bool found = false;
+    // false if the flood stopped at the first entry tile it reached, so
+    // wagon_path doesn't hold every reachable tile
+    bool full = false;
+    int32_t checked_tick = -1;
+    BlockGrid grid;
+    TileBitmap wagon_path;
+
+    std::vector<df::coord> depots;
+    std::vector<df::coord> entries;
+    int32_t building_next_id = -1;
+    size_t num_buildings = 0;
+    std::vector<std::pair<size_t, uint64_t>> block_hashes;
+};
+
+static WagonCache wagon_cache;
+static unordered_set<df::coord> entry_tiles;
+
+static uint64_t hash_block(const df::map_block * block) {
+    if (!block)
+        return 0;
+    // FNV-1a over the two arrays the flood looks at
+    uint64_t hash = 14695981039346656037ULL;
+    auto mix = [&](const void * data, size_t size) {
+        auto bytes = (const uint8_t *)data;
+        for (size_t i = 0; i < size; ++i)
+            hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    };
+    mix(block->walkable, sizeof(block->walkable));
+    mix(block->tiletype, sizeof(block->tiletype));
+    return hash;
+}
+
+static bool is_cache_current(const BlockGrid & grid, const std::vector<df::coord> & depots,
+    const std::vector<df::coord> & entries)
+{
+    auto & cache = wagon_cache;
+    if (!cache.valid || !(cache.grid == grid) || cache.depots != depots || cache.entries != entries)
+        return false;
+    if (cache.building_next_id != *building_next_id || cache.num_buildings != world->buildings.all.size())
+        return false;
+    if (cache.checked_tick == world->frame_counter)
+        return true;
+    for (auto & [idx, hash] : cache.block_hashes) {
+        if (hash_block(grid.block(idx)) != hash)
+            return false;
+    }
+    cache.checked_tick = world->frame_counter;
+    return true;
+}
+
 struct FloodCtx {
     uint16_t wgroup;
-    unordered_set<df::coord> & wagon_path;
-    unordered_set<df::coord> seen; // contains tiles that should not be added to search_edge
-    stack<df::coord> search_edge;  // contains tiles that can be successfully moved into
+    TileBitmap & wagon_path;
+    TileBitmap seen;         // contains tiles that should not be added to search_edge
+    Frontier search_edge;    // contains tiles that can be successfully moved into
     const unordered_set<df::coord> & entry_tiles;
+    std::vector<bool> & read_blocks; // blocks the flood looked at
 
-    FloodCtx(uint16_t wgroup, unordered_set<df::coord> & wagon_path, const unordered_set<df::coord> & entry_tiles)
-        : wgroup(wgroup), wagon_path(wagon_path), entry_tiles(entry_tiles) {}
+    FloodCtx(const BlockGrid & grid, uint16_t wgroup, TileBitmap & wagon_path,
+            const unordered_set<df::coord> & entry_tiles, std::vector<bool> & read_blocks)
+        : wgroup(wgroup), wagon_path(wagon_path), entry_tiles(entry_tiles), read_blocks(read_blocks)
+    {
+        seen.reset(grid);
+        search_edge.reset(grid);
+    }
 };
 
-static bool is_wagon_traversible(FloodCtx & ctx, const df::coord & pos, const df::coord & prev_pos) {
+static df::map_block * read_block(FloodCtx & ctx, const BlockGrid & grid, const df::coord & pos) {
+    if (!grid.contains(pos))
+        return NULL;
+    ctx.read_blocks[grid.index(pos)] = true;
+    return Maps::getTileBlock(pos);
+}
+
+static uint16_t get_walkable_group(FloodCtx & ctx, const BlockGrid & grid, const df::coord & pos) {
+    auto block = read_block(ctx, grid, pos);
+    return block ? index_tile(block->walkable, pos) : 0;
+}
+
+static df::tiletype * get_tile_type(FloodCtx & ctx, const BlockGrid & grid, const df::coord & pos) {
+    auto block = read_block(ctx, grid, pos);
+    return block ? &index_tile(block->tiletype, pos) : NULL;
+}
+
+static bool is_wagon_traversible(FloodCtx & ctx, const BlockGrid & grid, const df::coord & pos, const df::coord & prev_pos) {
     if (auto bld = Buildings::findAtTile(pos)) {
         auto btype = bld->getType();
         if (btype == df::building_type::Trap || btype == df::building_type::Door)
             return false;
     }
 
-    auto tt = Maps::getTileType(pos);
+    auto tt = get_tile_type(ctx, grid, pos);
     if (!tt)
         return false;
 
@@ -217,21 +358,21 @@ static bool is_wagon_traversible(FloodCtx & ctx, const df::coord & pos, const df
     if (shape == df::tiletype_shape::STAIR_UP || shape == df::tiletype_shape::STAIR_UPDOWN)
         return false;
 
-    if (ctx.wgroup == Maps::getWalkableGroup(pos))
+    if (ctx.wgroup == get_walkable_group(ctx, grid, pos))
         return true;
 
     if (shape == df::tiletype_shape::RAMP_TOP ) {
         df::coord pos_below = pos + df::coord(0, 0, -1);
-        if (Maps::getWalkableGroup(pos_below)) {
-            ctx.search_edge.emplace(pos_below);
+        if (get_walkable_group(ctx, grid, pos_below)) {
+            ctx.search_edge.push(pos_below);
             return true;
         }
     } else if (shape == df::tiletype_shape::WALL) {
-        auto prev_tt = Maps::getTileType(prev_pos);
+        auto prev_tt = get_tile_type(ctx, grid, prev_pos);
         if (prev_tt && tileShape(*prev_tt) == df::tiletype_shape::RAMP) {
             df::coord pos_above = pos + df::coord(0, 0, 1);
-            if (Maps::getWalkableGroup(pos_above)) {
-                ctx.search_edge.emplace(pos_above);
+            if (get_walkable_group(ctx, grid, pos_above)) {
+                ctx.search_edge.push(pos_above);
                 return true;
             }
         }
@@ -240,29 +381,27 @@ static bool is_wagon_traversible(FloodCtx & ctx, const df::coord & pos, const df
     return false;
 }
 
-static void check_wagon_tile(FloodCtx & ctx, const df::coord & pos) {
-    if (ctx.seen.contains(pos))
+static void check_wagon_tile(FloodCtx & ctx, const BlockGrid & grid, const df::coord & pos) {
+    if (!ctx.seen.set(pos))
         return;
 
-    ctx.seen.emplace(pos);
-
     if (ctx.entry_tiles.contains(pos)) {
-        ctx.wagon_path.emplace(pos);
-        ctx.search_edge.emplace(pos);
+        ctx.wagon_path.set(pos);
+        ctx.search_edge.push(pos);
         return;
     }
 
-    if (is_wagon_traversible(ctx, pos+df::coord(-1, -1, 0), pos) &&
-        is_wagon_traversible(ctx, pos+df::coord( 0, -1, 0), pos) &&
-        is_wagon_traversible(ctx, pos+df::coord( 1, -1, 0), pos) &&
-        is_wagon_traversible(ctx, pos+df::coord(-1,  0, 0), pos) &&
-        is_wagon_traversible(ctx, pos+df::coord( 1,  0, 0), pos) &&
-        is_wagon_traversible(ctx, pos+df::coord(-1,  1, 0), pos) &&
-        is_wagon_traversible(ctx, pos+df::coord( 0,  1, 0), pos) &&
-        is_wagon_traversible(ctx, pos+df::coord( 1,  1, 0), pos))
+    if (is_wagon_traversible(ctx, grid, pos+df::coord(-1, -1, 0), pos) &&
+        is_wagon_traversible(ctx, grid, pos+df::coord( 0, -1, 0), pos) &&
+        is_wagon_traversible(ctx, grid, pos+df::coord( 1, -1, 0), pos) &&
+        is_wagon_traversible(ctx, grid, pos+df::coord(-1,  0, 0), pos) &&
+        is_wagon_traversible(ctx, grid, pos+df::coord( 1,  0, 0), pos) &&
+        is_wagon_traversible(ctx, grid, pos+df::coord(-1,  1, 0), pos) &&
+        is_wagon_traversible(ctx, grid, pos+df::coord( 0,  1, 0), pos) &&
+        is_wagon_traversible(ctx, grid, pos+df::coord( 1,  1, 0), pos))
     {
-        ctx.wagon_path.emplace(pos);
-        ctx.search_edge.emplace(pos);
+        ctx.wagon_path.set(pos);
+        ctx.search_edge.push(pos);
     }
 }
 
@@ -272,73 +411,114 @@ static void check_wagon_tile(FloodCtx & ctx, const df::coord & pos) {
 // - if three adjacent tiles are in the same pathability group, then they are traversible by a wagon
 // - a wagon needs a single ramp to move elevations as long as the adjacent tiles are walkable
 // TODO: cannot traverse doors, up stairs, or up/down stairs
-static bool wagon_flood(color_ostream &out, unordered_set<df::coord> * wagon_path, const df::coord & depot_pos,
-    const unordered_set<df::coord> & entry_tiles)
+static bool wagon_flood(color_ostream &out, const BlockGrid & grid, TileBitmap & wagon_path,
+    std::vector<bool> & read_blocks, const df::coord & depot_pos, const unordered_set<df::coord> & entry_tiles,
+    bool stop_at_entry)
 {
-    unordered_set<df::coord> temp_wagon_path;
-    FloodCtx ctx(Maps::getWalkableGroup(depot_pos), wagon_path ? *wagon_path : temp_wagon_path, entry_tiles);
+    FloodCtx ctx(grid, 0, wagon_path, entry_tiles, read_blocks);
+    ctx.wgroup = get_walkable_group(ctx, grid, depot_pos);
 
     if (!ctx.wgroup)
         return false;
 
     bool found = false;
-    ctx.wagon_path.emplace(depot_pos);
-    ctx.seen.emplace(depot_pos);
-    ctx.search_edge.emplace(depot_pos);
-    while (!ctx.search_edge.empty()) {
-        df::coord pos = ctx.search_edge.top();
-        ctx.search_edge.pop();
-
+    ctx.wagon_path.set(depot_pos);
+    ctx.seen.set(depot_pos);
+    ctx.search_edge.push(depot_pos);
+    df::coord pos;
+    while (ctx.search_edge.pop(pos)) {
         TRACE(log,out).print("checking tile: (%d, %d, %d); pathability group: %d\n", pos.x, pos.y, pos.z,
             Maps::getWalkableGroup(pos));
 
         if (entry_tiles.contains(pos)) {
             found = true;
-            if (!wagon_path)
+            if (stop_at_entry)
                 break;
             continue;
         }
 
-        check_wagon_tile(ctx, pos+df::coord( 0, -1, 0));
-        check_wagon_tile(ctx, pos+df::coord( 0,  1, 0));
-        check_wagon_tile(ctx, pos+df::coord(-1,  0, 0));
-        check_wagon_tile(ctx, pos+df::coord( 1,  0, 0));
+        check_wagon_tile(ctx, grid, pos+df::coord( 0, -1, 0));
+        check_wagon_tile(ctx, grid, pos+df::coord( 0,  1, 0));
+        check_wagon_tile(ctx, grid, pos+df::coord(-1,  0, 0));
+        check_wagon_tile(ctx, grid, pos+df::coord( 1,  0, 0));
     }
 
     return found;
 }
 
-static unordered_set<df::coord> wagon_path;
-static unordered_set<df::coord> entry_tiles;
+// with need_path unset, stops at the first depot that can reach an entry tile
+static void flood_all_depots(color_ostream &out, const BlockGrid & grid, const std::vector<df::coord> & depots,
+    const std::vector<df::coord> & entries, bool need_path)
+{
+    auto & cache = wagon_cache;
+    cache.valid = true;
+    cache.found = false;
+    cache.grid = grid;
+    cache.wagon_path.reset(grid);
+    cache.depots = depots;
+    cache.entries = entries;
+    cache.building_next_id = *building_next_id;
+    cache.num_buildings = world->buildings.all.size();
+    cache.checked_tick = world->frame_counter;
+
+    std::vector<bool> read_blocks(grid.size());
+    for (auto & depot_pos : depots) {
+        if (wagon_flood(out, grid, cache.wagon_path, read_blocks, depot_pos, entry_tiles, !need_path)) {
+            cache.found = true;
+            if (!need_path)
+                break;
+        }
+    }
+    // a flood that found nothing has seen everything anyway
+    cache.full = need_path || !cache.found;
 
-static bool getDepotAccessibleByWagons(color_ostream &out, bool cache_scan_for_painting) {
-    if (cache_scan_for_painting) {
-        entry_tiles.clear();
-        wagon_path.clear();
+    cache.block_hashes.clear();
+    for (size_t idx = 0; idx < read_blocks.size(); ++idx) {
+        if (read_blocks[idx])
+            cache.block_hashes.emplace_back(idx, hash_block(grid.block(idx)));
     }
+    DEBUG(log,out).print("wagon flood read %zu blocks\n", cache.block_hashes.size());
+}
+
+// brings wagon_cache up to date and returns whether a wagon can reach the map
+// edge from a depot. need_path is set when the reachable tiles will be painted.
+static bool update_wagon_cache(color_ostream &out, bool need_path) {
     unordered_set<df::coord> depot_coords;
-    if (!get_depot_coords(out, &depot_coords))
-        return false;
     unordered_set<uint16_t> depot_pathability_groups;
-    if (!get_pathability_groups(out, &depot_pathability_groups, depot_coords))
-        return false;
-    if (!get_entry_tiles(&entry_tiles, depot_pathability_groups))
+    entry_tiles.clear();
+    if (!get_depot_coords(out, &depot_coords) ||
+        !get_pathability_groups(out, &depot_pathability_groups, depot_coords) ||
+        !get_entry_tiles(&entry_tiles, depot_pathability_groups))
+    {
+        wagon_cache.valid = false;
+        wagon_cache.wagon_path.reset(BlockGrid());
         return false;
-    bool found_edge = false;
-    for (auto depot_pos : depot_coords) {
-        if (wagon_flood(out, cache_scan_for_painting ? &wagon_path : NULL, depot_pos, entry_tiles)) {
-            found_edge = true;
-            if (!cache_scan_for_painting)
-                break;
-        }
     }
-    return found_edge;
+
+    std::vector<df::coord> depots(depot_coords.begin(), depot_coords.end());
+    std::sort(depots.begin(), depots.end());
+    std::vector<df::coord> entries(entry_tiles.begin(), entry_tiles.end());
+    std::sort(entries.begin(), entries.end());
+
+    BlockGrid grid;
+    grid.reset();
+    if (!is_cache_current(grid, depots, entries) || (need_path && !wagon_cache.full))
+        flood_all_depots(out, grid, depots, entries, need_path);
+    else
+        DEBUG(log,out).print("reusing cached wagon flood\n");
+
+    return wagon_cache.found;
+}
+
+static bool getDepotAccessibleByWagons(color_ostream &out) {
+    return update_wagon_cache(out, false);
 }
 
-static void paintScreenDepotAccess() {
+static void paintScreenDepotAccess(color_ostream &out) {
+    update_wagon_cache(out, true);
     PaintCtx ctx;
     paint_screen(ctx, entry_tiles, false, [&](const df::coord & pos){
-        return wagon_path.contains(pos);
+        return wagon_cache.wagon_path.get(pos);
     });
 }
 
@@ -2,6 +2,7 @@
 
 #include "Core.h"
 #include "Console.h"
+#include "Debug.h"
 #include "Export.h"
 #include "LuaTools.h"
 #include "PluginManager.h"
@@ -11,6 +12,7 @@
 #include "modules/Gui.h"
 #include "modules/MapCache.h"
 
+#include "df/block_square_event_mineralst.h"
 #include "df/inorganic_raw.h"
 #include "df/world.h"
 #include "df/world_data.h"
@@ -33,6 +35,8 @@
 #include <map>
 #include <algorithm>
 #include <functional>
+#include <cstring>
+#include <thread>
 #include <vector>
 
 using std::string;
@@ -44,6 +48,10 @@ using df::coord2d;
 DFHACK_PLUGIN("prospector");
 REQUIRE_GLOBAL(world);
 
+namespace DFHack {
+    DBG_DECLARE(prospector, log, DebugCategory::LINFO);
+}
+
 struct prospect_options {
     // whether to display help
     bool help = false;
@@ -119,6 +127,14 @@ struct matdata
         }
         return count;
     }
+    void merge(const matdata &other)
+    {
+        if (other.lower_z != invalid_z)
+            add(other.lower_z, 0);
+        if (other.upper_z != invalid_z)
+            add(other.upper_z, 0);
+        count += other.count;
+    }
     float count;
     int lower_z;
     int upper_z;
@@ -144,8 +160,6 @@ struct shallower
 typedef std::map<int16_t, matdata> MatMap;
 typedef std::vector< std::pair<int16_t, matdata> > MatSorter;
 
-typedef std::vector<df::plant *> PlantList;
-
 #define TO_PTR_VEC(obj_vec, ptr_vec) \
     ptr_vec.clear(); \
     for (size_t i = 0; i < obj_vec.size(); i++) \
@@ -267,8 +281,19 @@ DFhackCExport command_result plugin_init ( color_ostream &out, std::vector <Plug
     return CR_OK;
 }
 
+static void clear_tally_cache();
+
 DFhackCExport command_result plugin_shutdown ( color_ostream &out )
 {
+    clear_tally_cache();
+    return CR_OK;
+}
+
+DFhackCExport command_result plugin_onstatechange(color_ostream &out, state_change_event event)
+{
+    // the cached block tallies refer to the map and raws of the current world
+    if (event == SC_MAP_UNLOADED || event == SC_WORLD_UNLOADED)
+        clear_tally_cache();
     return CR_OK;
 }
 
@@ -621,192 +646,393 @@ static command_result embark_prospector(color_ostream &out,
     return CR_OK;
 }
 
-static command_result map_prospector(color_ostream &con,
-                                     const prospect_options &options) {
-    if (!Maps::IsValid())
-    {
-        con.printerr("Map is not available!\n");
-        return CR_FAILURE;
-    }
-
-    uint32_t x_max = 0, y_max = 0, z_max = 0;
-    Maps::getSize(x_max, y_max, z_max);
-    MapExtras::MapCache map;
+/*
+ * What one map block contributes to the map report. A block covers a single
+ * z-level, so plain tile counts are enough; elevation ranges are rebuilt when
+ * the tallies are added up. Tallies are kept between runs along with a hash of
+ * the block data they were taken from, so a repeated prospect only has to look
+ * at the blocks that have changed.
+ */
+struct BlockTally
+{
+    typedef std::vector<std::pair<int16_t, uint16_t>> counts_type; // index, tiles
 
-    DFHack::Materials *mats = Core::getInstance().getMaterials();
+    bool valid = false;
+    bool hidden = false; // whether hidden tiles were counted
+    uint64_t version = 0;
 
-    DFHack::t_feature blockFeatureGlobal;
-    DFHack::t_feature blockFeatureLocal;
+    bool hasDemonTemple = false;
+    bool hasLair = false;
+    uint16_t water = 0;
+    uint16_t magma = 0;
+    uint16_t aquifer = 0;
+    uint16_t tube = 0;
+    counts_type base;
+    counts_type layer;
+    counts_type vein;
+
+    static void count(counts_type &counts, int16_t index)
+    {
+        for (auto &entry : counts)
+        {
+            if (entry.first == index)
+            {
+                entry.second++;
+                return;
+            }
+        }
+        counts.emplace_back(index, 1);
+    }
+};
 
+// The sums of a range of block tallies.
+struct ProspectTotals
+{
     bool hasDemonTemple = false;
     bool hasLair = false;
     MatMap baseMats;
     MatMap layerMats;
     MatMap veinMats;
-    MatMap plantMats;
-    MatMap treeMats;
 
     matdata liquidWater;
     matdata liquidMagma;
     matdata aquiferTiles;
     matdata tubeTiles;
 
-    for(uint32_t z = 0; z < z_max; z++)
+    void add(const BlockTally &tally, int global_z)
     {
-        // the '- 100' is because DF v50 and later have a 100 offset in reported elevation
-        int global_z = world->map.region_z + z - 100;
+        hasDemonTemple = hasDemonTemple || tally.hasDemonTemple;
+        hasLair = hasLair || tally.hasLair;
+        if (tally.water)
+            liquidWater.add(global_z, tally.water);
+        if (tally.magma)
+            liquidMagma.add(global_z, tally.magma);
+        if (tally.aquifer)
+            aquiferTiles.add(global_z, tally.aquifer);
+        if (tally.tube)
+            tubeTiles.add(global_z, tally.tube);
+        for (auto &entry : tally.base)
+            baseMats[entry.first].add(global_z, entry.second);
+        for (auto &entry : tally.layer)
+            layerMats[entry.first].add(global_z, entry.second);
+        for (auto &entry : tally.vein)
+            veinMats[entry.first].add(global_z, entry.second);
+    }
 
-        for(uint32_t b_y = 0; b_y < y_max; b_y++)
+    void merge(const ProspectTotals &other)
+    {
+        hasDemonTemple = hasDemonTemple || other.hasDemonTemple;
+        hasLair = hasLair || other.hasLair;
+        liquidWater.merge(other.liquidWater);
+        liquidMagma.merge(other.liquidMagma);
+        aquiferTiles.merge(other.aquiferTiles);
+        tubeTiles.merge(other.tubeTiles);
+        for (auto &kv : other.baseMats)
+            baseMats[kv.first].merge(kv.second);
+        for (auto &kv : other.layerMats)
+            layerMats[kv.first].merge(kv.second);
+        for (auto &kv : other.veinMats)
+            veinMats[kv.first].merge(kv.second);
+    }
+};
+
+static Maps::BlockGrid tally_grid;
+static std::vector<BlockTally> tally_cache;
+
+static void clear_tally_cache()
+{
+    tally_grid = Maps::BlockGrid();
+    tally_cache.clear();
+    tally_cache.shrink_to_fit();
+}
+
+// hashes everything in the block that tallyBlock reads
+static uint64_t hash_block(df::map_block *block)
+{
+    // FNV-1a, a word at a time
+    uint64_t hash = 14695981039346656037ULL;
+    auto mix = [&](const void *data, size_t size) {
+        auto bytes = (const uint8_t *)data;
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8)
         {
-            for(uint32_t b_x = 0; b_x < x_max; b_x++)
+            uint64_t word;
+            memcpy(&word, bytes + i, 8);
+            hash = (hash ^ word) * 1099511628211ULL;
+        }
+        for (; i < size; ++i)
+            hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    };
+    mix(block->tiletype, sizeof(block->tiletype));
+    mix(block->designation, sizeof(block->designation));
+    mix(block->occupancy, sizeof(block->occupancy));
+    mix(&block->global_feature, sizeof(block->global_feature));
+    mix(&block->local_feature, sizeof(block->local_feature));
+    for (auto ev : block->block_events)
+    {
+        if (ev->getType() != block_square_event_type::mineral)
+            continue;
+        auto vein = (df::block_square_event_mineralst *)ev;
+        mix(&vein->inorganic_mat, sizeof(vein->inorganic_mat));
+        mix(&vein->tile_bitmask, sizeof(vein->tile_bitmask));
+    }
+    return hash;
+}
+
+static void tallyBlock(BlockTally &tally, MapExtras::Block *b, const prospect_options &options)
+{
+    tally = BlockTally();
+
+    DFHack::t_feature blockFeatureGlobal;
+    DFHack::t_feature blockFeatureLocal;
+
+    // Find features
+    b->GetGlobalFeature(&blockFeatureGlobal);
+    b->GetLocalFeature(&blockFeatureLocal);
+
+    // Iterate over all the tiles in the block
+    for(uint32_t y = 0; y < 16; y++)
+    {
+        for(uint32_t x = 0; x < 16; x++)
+        {
+            df::coord2d coord(x, y);
+            df::tile_designation des = b->DesignationAt(coord);
+            df::tile_occupancy occ = b->OccupancyAt(coord);
+
+            // Skip hidden tiles
+            if (!options.hidden && des.bits.hidden)
+            {
+                continue;
+            }
+
+            // Check for aquifer
+            if (des.bits.water_table)
             {
-                // Get the map block
-                df::coord2d blockCoord(b_x, b_y);
-                MapExtras::Block *b = map.BlockAt(DFHack::DFCoord(b_x, b_y, z));
-                if (!b || !b->is_valid())
+                tally.aquifer++;
+            }
+
+            // Check for lairs
+            if (occ.bits.monster_lair)
+            {
+                tally.hasLair = true;
+            }
+
+            // Check for liquid
+            if (des.bits.flow_size)
+            {
+                if (des.bits.liquid_type == tile_liquid::Magma)
+                    tally.magma++;
+                else
+                    tally.water++;
+            }
+
+            df::tiletype type = b->tiletypeAt(coord);
+            df::tiletype_shape tileshape = tileShape(type);
+            df::tiletype_material tilemat = tileMaterial(type);
+
+            // We only care about these types
+            switch (tileshape)
+            {
+            case tiletype_shape::WALL:
+            case tiletype_shape::FORTIFICATION:
+                break;
+            case tiletype_shape::EMPTY:
+                /* A heuristic: tubes inside adamantine have EMPTY:AIR tiles which
+                   still have feature_local set. Also check the unrevealed status,
+                   so as to exclude any holes mined by the player. */
+                if (tilemat == tiletype_material::AIR &&
+                    des.bits.feature_local && des.bits.hidden &&
+                    blockFeatureLocal.type == feature_type::deep_special_tube)
                 {
-                    continue;
+                    tally.tube++;
                 }
+            default:
+                continue;
+            }
 
-                // Find features
-                b->GetGlobalFeature(&blockFeatureGlobal);
-                b->GetLocalFeature(&blockFeatureLocal);
+            // Count the material type
+            BlockTally::count(tally.base, tilemat);
 
-                // Iterate over all the tiles in the block
-                for(uint32_t y = 0; y < 16; y++)
+            // Find the type of the tile
+            switch (tilemat)
+            {
+            case tiletype_material::SOIL:
+            case tiletype_material::STONE:
+                BlockTally::count(tally.layer, b->layerMaterialAt(coord));
+                break;
+            case tiletype_material::MINERAL:
+                BlockTally::count(tally.vein, b->veinMaterialAt(coord));
+                break;
+            case tiletype_material::FEATURE:
+                if (blockFeatureLocal.type != -1 && des.bits.feature_local)
                 {
-                    for(uint32_t x = 0; x < 16; x++)
+                    if (blockFeatureLocal.type == feature_type::deep_special_tube
+                            && blockFeatureLocal.main_material == 0) // stone
                     {
-                        df::coord2d coord(x, y);
-                        df::tile_designation des = b->DesignationAt(coord);
-                        df::tile_occupancy occ = b->OccupancyAt(coord);
-
-                        // Skip hidden tiles
-                        if (!options.hidden && des.bits.hidden)
-                        {
-                            continue;
-                        }
-
-                        // Check for aquifer
-                        if (des.bits.water_table)
-                        {
-                            aquiferTiles.add(global_z);
-                        }
-
-                        // Check for lairs
-                        if (occ.bits.monster_lair)
-                        {
-                            hasLair = true;
-                        }
-
-                        // Check for liquid
-                        if (des.bits.flow_size)
-                        {
-                            if (des.bits.liquid_type == tile_liquid::Magma)
-                                liquidMagma.add(global_z);
-                            else
-                                liquidWater.add(global_z);
-                        }
-
-                        df::tiletype type = b->tiletypeAt(coord);
-                        df::tiletype_shape tileshape = tileShape(type);
-                        df::tiletype_material tilemat = tileMaterial(type);
-
-                        // We only care about these types
-                        switch (tileshape)
-                        {
-                        case tiletype_shape::WALL:
-                        case tiletype_shape::FORTIFICATION:
-                            break;
-                        case tiletype_shape::EMPTY:
-                            /* A heuristic: tubes inside adamantine have EMPTY:AIR tiles which
-                               still have feature_local set. Also check the unrevealed status,
-                               so as to exclude any holes mined by the player. */
-                            if (tilemat == tiletype_material::AIR &&
-                                des.bits.feature_local && des.bits.hidden &&
-                                blockFeatureLocal.type == feature_type::deep_special_tube)
-                            {
-                                tubeTiles.add(global_z);
-                            }
-                        default:
-                            continue;
-                        }
-
-                        // Count the material type
-                        baseMats[tilemat].add(global_z);
-
-                        // Find the type of the tile
-                        switch (tilemat)
-                        {
-                        case tiletype_material::SOIL:
-                        case tiletype_material::STONE:
-                            layerMats[b->layerMaterialAt(coord)].add(global_z);
-                            break;
-                        case tiletype_material::MINERAL:
-                            veinMats[b->veinMaterialAt(coord)].add(global_z);
-                            break;
-                        case tiletype_material::FEATURE:
-                            if (blockFeatureLocal.type != -1 && des.bits.feature_local)
-                            {
-                                if (blockFeatureLocal.type == feature_type::deep_special_tube
-                                        && blockFeatureLocal.main_material == 0) // stone
-                                {
-                                    veinMats[blockFeatureLocal.sub_material].add(global_z);
-                                }
-                                else if (blockFeatureLocal.type == feature_type::deep_surface_portal)
-                                {
-                                    hasDemonTemple = true;
-                                }
-                            }
-
-                            if (blockFeatureGlobal.type != -1 && des.bits.feature_global
-                                    && blockFeatureGlobal.type == feature_type::underworld_from_layer
-                                    && blockFeatureGlobal.main_material == 0) // stone
-                            {
-                                layerMats[blockFeatureGlobal.sub_material].add(global_z);
-                            }
-                            break;
-                        case tiletype_material::LAVA_STONE:
-                            // TODO ?
-                            break;
-                        default:
-                            break;
-                        }
+                        BlockTally::count(tally.vein, blockFeatureLocal.sub_material);
+                    }
+                    else if (blockFeatureLocal.type == feature_type::deep_surface_portal)
+                    {
+                        tally.hasDemonTemple = true;
                     }
                 }
 
-                // Check plants this way, as the other way wasn't getting them all
-                // and we can check visibility more easily here
-                if (options.shrubs)
+                if (blockFeatureGlobal.type != -1 && des.bits.feature_global
+                        && blockFeatureGlobal.type == feature_type::underworld_from_layer
+                        && blockFeatureGlobal.main_material == 0) // stone
                 {
-                    auto block = Maps::getBlockColumn(b_x,b_y);
-                    vector<df::plant *> *plants = block ? &block->plants : NULL;
-                    if(plants)
-                    {
-                        for (PlantList::const_iterator it = plants->begin(); it != plants->end(); it++)
-                        {
-                            const df::plant & plant = *(*it);
-                            if (uint32_t(plant.pos.z) != z)
-                                continue;
-                            df::coord2d loc(plant.pos.x, plant.pos.y);
-                            loc = loc % 16;
-                            if (options.hidden || !b->DesignationAt(loc).bits.hidden)
-                            {
-                                if (ENUM_ATTR(plant_type, is_shrub, plant.type))
-                                    plantMats[plant.material].add(global_z);
-                                else
-                                    treeMats[plant.material].add(global_z);
-                            }
-                        }
-                    }
+                    BlockTally::count(tally.layer, blockFeatureGlobal.sub_material);
                 }
-                // Block end
-            } // block x
+                break;
+            case tiletype_material::LAVA_STONE:
+                // TODO ?
+                break;
+            default:
+                break;
+            }
+        }
+    }
+}
+
+/*
+ * Brings the tallies of blocks [begin, end) up to date and adds them to
+ * totals. Each call uses its own MapCache and only writes the cache entries
+ * in its range, so calls for disjoint ranges can run on separate threads while
+ * the game is suspended; all they do to game data is read it.
+ */
+static void scan_blocks(size_t begin, size_t end, const prospect_options &options,
+                        ProspectTotals &totals, size_t &rescanned)
+{
+    MapExtras::MapCache map;
+    const size_t blocks_per_level = size_t(tally_grid.x_blocks) * tally_grid.y_blocks;
+
+    for (size_t idx = begin; idx < end; ++idx)
+    {
+        df::map_block *block = tally_grid.block(idx);
+        if (!block)
+            continue;
+
+        auto &tally = tally_cache[idx];
+        uint64_t version = hash_block(block);
+        if (!tally.valid || tally.version != version || tally.hidden != options.hidden)
+        {
+            MapExtras::Block *b = map.BlockAt(block->map_pos / 16);
+            if (!b || !b->is_valid())
+                continue;
+            tallyBlock(tally, b, options);
+            tally.valid = true;
+            tally.version = version;
+            tally.hidden = options.hidden;
+            ++rescanned;
 
             // Clean uneeded memory
             map.trash();
-        } // block y
-    } // z
+        }
+
+        // the '- 100' is because DF v50 and later have a 100 offset in reported elevation
+        int global_z = world->map.region_z + int(idx / blocks_per_level) - 100;
+        totals.add(tally, global_z);
+    }
+}
+
+// splits the blocks of the map into one contiguous range per thread
+static void scan_map(color_ostream &con, const prospect_options &options, ProspectTotals &totals)
+{
+    const size_t MIN_SLICE = 256;
+
+    Maps::BlockGrid grid;
+    grid.reset();
+    if (!(grid == tally_grid))
+    {
+        clear_tally_cache();
+        tally_grid = grid;
+    }
+    tally_cache.resize(grid.size());
+
+    size_t count = grid.size();
+    size_t nthreads = std::max(1u, std::thread::hardware_concurrency());
+    nthreads = std::max<size_t>(1, std::min(nthreads, (count + MIN_SLICE - 1) / MIN_SLICE));
+    size_t step = (count + nthreads - 1) / nthreads;
+
+    std::vector<ProspectTotals> partials(nthreads);
+    std::vector<size_t> rescanned(nthreads, 0);
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < nthreads; ++i)
+    {
+        size_t begin = std::min(count, i * step);
+        workers.emplace_back(scan_blocks, begin, std::min(count, begin + step),
+                             std::cref(options), std::ref(partials[i]), std::ref(rescanned[i]));
+    }
+    scan_blocks(0, std::min(count, step), options, totals, rescanned[0]);
+    for (auto &t : workers)
+        t.join();
+
+    size_t total_rescanned = rescanned[0];
+    for (size_t i = 1; i < nthreads; ++i)
+    {
+        totals.merge(partials[i]);
+        total_rescanned += rescanned[i];
+    }
+    DEBUG(log,con).print("rescanned %zu of %zu blocks on %zu threads\n",
+                         total_rescanned, count, nthreads);
+}
+
+static command_result map_prospector(color_ostream &con,
+                                     const prospect_options &options) {
+    if (!Maps::IsValid())
+    {
+        con.printerr("Map is not available!\n");
+        return CR_FAILURE;
+    }
+
+    DFHack::Materials *mats = Core::getInstance().getMaterials();
+
+    ProspectTotals totals;
+    scan_map(con, options, totals);
+
+    auto &baseMats = totals.baseMats;
+    auto &layerMats = totals.layerMats;
+    auto &veinMats = totals.veinMats;
+    auto &liquidWater = totals.liquidWater;
+    auto &liquidMagma = totals.liquidMagma;
+    auto &aquiferTiles = totals.aquiferTiles;
+    auto &tubeTiles = totals.tubeTiles;
+    bool hasDemonTemple = totals.hasDemonTemple;
+    bool hasLair = totals.hasLair;
+
+    MatMap plantMats;
+    MatMap treeMats;
+
+    // Check plants this way, as the other way wasn't getting them all
+    // and we can check visibility more easily here
+    if (options.shrubs)
+    {
+        uint32_t x_max = 0, y_max = 0, z_max = 0;
+        Maps::getSize(x_max, y_max, z_max);
+        for(uint32_t b_y = 0; b_y < y_max; b_y++)
+        {
+            for(uint32_t b_x = 0; b_x < x_max; b_x++)
+            {
+                auto column = Maps::getBlockColumn(b_x,b_y);
+                if (!column)
+                    continue;
+                for (auto plant : column->plants)
+                {
+                    df::map_block *block = Maps::getTileBlock(plant->pos);
+                    if (!block)
+                        continue;
+                    if (!options.hidden && block->designation[plant->pos.x & 15][plant->pos.y & 15].bits.hidden)
+                        continue;
+                    // the '- 100' is because DF v50 and later have a 100 offset in reported elevation
+                    int global_z = world->map.region_z + plant->pos.z - 100;
+                    if (ENUM_ATTR(plant_type, is_shrub, plant->type))
+                        plantMats[plant->material].add(global_z);
+                    else
+                        treeMats[plant->material].add(global_z);
+                }
+            }
+        }
+    }
 
     MatMap::const_iterator it;
 
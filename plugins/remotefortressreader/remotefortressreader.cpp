@@ -743,7 +743,7 @@ std::map<int, uint16_t> itemHashes;
 bool isItemChanged(int i)
 {
     uint16_t hash = 0;
-    auto item = df::item::find(i);
+    auto item = Items::findItemByID(i);
     if (item)
     {
         hash = fletcher16((uint8_t*)item, sizeof(df::item));
@@ -1324,7 +1324,7 @@ void CopyItems(df::map_block * DfBlock, RemoteFortressReader::MapBlock * NetBloc
     {
         int id = DfBlock->items[i];
 
-        auto item = df::item::find(id);
+        auto item = Items::findItemByID(id);
         if (item)
             CopyItem(NetBlock->add_items(), item);
     }
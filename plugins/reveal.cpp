@@ -352,108 +352,114 @@ command_result revtoggle(color_ostream &out, vector<string> & params) {
         return reveal(out, params);
 }
 
+namespace {
+    // How a hidden tile passes the flood on, going by its shape and material
+    enum class RevealKind {
+        WALL,  // revealed when reached from the side or from above; stops the flood
+        FLOOR, // spreads sideways and up, but is left hidden when reached from below
+        OPEN,  // spreads in every direction
+    };
+}
+
+static RevealKind get_reveal_kind(df::tiletype tt) {
+    auto mat = tileMaterial(tt);
+    // Special case for trees - always reveal them as if they were floor tiles
+    if (mat == tiletype_material::PLANT || mat == tiletype_material::MUSHROOM)
+        return RevealKind::FLOOR;
+
+    switch (tileShape(tt)) {
+    // Walls
+    case tiletype_shape::WALL:
+        // we don't want constructions or ice to restrict vision (to avoid bug #1871)
+        if (mat == tiletype_material::CONSTRUCTION || mat == tiletype_material::FROZEN_LIQUID)
+            return RevealKind::FLOOR;
+        return RevealKind::WALL;
+    // Open space
+    case tiletype_shape::NONE:
+    case tiletype_shape::EMPTY:
+    case tiletype_shape::RAMP_TOP:
+    case tiletype_shape::STAIR_UPDOWN:
+    case tiletype_shape::STAIR_DOWN:
+    case tiletype_shape::BROOK_TOP:
+        return RevealKind::OPEN;
+    // Floors
+    case tiletype_shape::FORTIFICATION:
+    case tiletype_shape::STAIR_UP:
+    case tiletype_shape::RAMP:
+    case tiletype_shape::FLOOR:
+    case tiletype_shape::BRANCH:
+    case tiletype_shape::TRUNK_BRANCH:
+    case tiletype_shape::TWIG:
+    case tiletype_shape::SAPLING:
+    case tiletype_shape::SHRUB:
+    case tiletype_shape::BOULDER:
+    case tiletype_shape::PEBBLES:
+    case tiletype_shape::BROOK_BED:
+    case tiletype_shape::ENDLESS_PIT:
+        return RevealKind::FLOOR;
+    default:
+        return RevealKind::WALL;
+    }
+}
+
+// returns false if the tile is not hidden (or not on the map)
+static bool get_hidden_kind(const df::coord &pos, RevealKind &kind) {
+    df::tile_designation *des = Maps::getTileDesignation(pos);
+    df::tiletype *tt = Maps::getTileType(pos);
+    if (!des || !tt || !des->bits.hidden)
+        return false;
+    kind = get_reveal_kind(*tt);
+    return true;
+}
+
 // Unhides map tiles according to visibility, starting from the given
 // coordinates. This algorithm only processes adjacent hidden tiles, so it must
 // start on a hidden tile and it will not reveal hidden sections separated by
 // already-unhidden tiles.
+//
+// The hidden floor and open tiles are flooded first. Then they are revealed
+// along with the hidden walls next to them, and the walls under open tiles.
 static void unhideFlood_internal(const df::coord &xy) {
-    typedef std::pair <df::coord, bool> PosAndBelow;
-    std::stack<PosAndBelow> flood;
-    flood.emplace(xy, false);
-
-    while (!flood.empty()) {
-        PosAndBelow tile = flood.top();
-        df::coord & current = tile.first;
-        bool & from_below = tile.second;
-        flood.pop();
-
-        if(!Maps::isValidTilePos(current))
-            continue;
-        df::tile_designation *des = Maps::getTileDesignation(current);
-        if(!des || !des->bits.hidden)
-            continue;
-
-        // we don't want constructions or ice to restrict vision (to avoid bug #1871)
-        df::tiletype *tt = Maps::getTileType(current);
-        if (!tt)
-            continue;
-
-        bool below = false;
-        bool above = false;
-        bool sides = false;
-        bool unhide = true;
-        // By tile shape, determine behavior and action
-        switch (tileShape(*tt)) {
-        // Walls
-        case tiletype_shape::WALL:
-            if (from_below)
-                unhide = false;
-            else if (tileMaterial(*tt) == tiletype_material::CONSTRUCTION ||
-                tileMaterial(*tt) == tiletype_material::FROZEN_LIQUID)
-            {
-                // treat as a floor
-                above = sides = true;
+    auto spreads = [](const df::coord &pos) {
+        RevealKind kind;
+        return get_hidden_kind(pos, kind) && kind != RevealKind::WALL;
+    };
+    Maps::FloodOptions opts;
+    opts.diagonal = true;
+    opts.up = [](const df::coord &, const df::coord &to) {
+        RevealKind kind;
+        return get_hidden_kind(to, kind) && kind == RevealKind::OPEN;
+    };
+    opts.down = [](const df::coord &from, const df::coord &) {
+        RevealKind kind;
+        return get_hidden_kind(from, kind) && kind == RevealKind::OPEN;
+    };
+
+    Maps::BlockGrid grid;
+    grid.reset();
+    Maps::TileBitmap flooded;
+    Maps::floodFill(flooded, grid, xy, spreads, opts);
+
+    auto unhide_wall = [&](const df::coord &pos) {
+        RevealKind kind;
+        if (!flooded.get(pos) && get_hidden_kind(pos, kind) && kind == RevealKind::WALL)
+            Maps::getTileDesignation(pos)->bits.hidden = false;
+    };
+    // a wall is still revealed if the flood starts on it
+    unhide_wall(xy);
+
+    flooded.forSpan([&](const df::coord &start, int16_t length) {
+        for (int16_t i = 0; i < length; ++i) {
+            df::coord pos(start.x + i, start.y, start.z);
+            for (int16_t dy = -1; dy <= 1; ++dy) {
+                for (int16_t dx = -1; dx <= 1; ++dx)
+                    unhide_wall(df::coord(pos.x + dx, pos.y + dy, pos.z));
             }
-            break;
-        // Open space
-        case tiletype_shape::NONE:
-        case tiletype_shape::EMPTY:
-        case tiletype_shape::RAMP_TOP:
-        case tiletype_shape::STAIR_UPDOWN:
-        case tiletype_shape::STAIR_DOWN:
-        case tiletype_shape::BROOK_TOP:
-            above = below = sides = true;
-            break;
-        // Floors
-        case tiletype_shape::FORTIFICATION:
-        case tiletype_shape::STAIR_UP:
-        case tiletype_shape::RAMP:
-        case tiletype_shape::FLOOR:
-        case tiletype_shape::BRANCH:
-        case tiletype_shape::TRUNK_BRANCH:
-        case tiletype_shape::TWIG:
-        case tiletype_shape::SAPLING:
-        case tiletype_shape::SHRUB:
-        case tiletype_shape::BOULDER:
-        case tiletype_shape::PEBBLES:
-        case tiletype_shape::BROOK_BED:
-        case tiletype_shape::ENDLESS_PIT:
-            if (from_below)
-                unhide = false;
-            else
-                above = sides = true;
-            break;
+            if (get_reveal_kind(*Maps::getTileType(pos)) == RevealKind::OPEN)
+                unhide_wall(df::coord(pos.x, pos.y, pos.z - 1));
+            Maps::getTileDesignation(pos)->bits.hidden = false;
         }
-
-        // Special case for trees - always reveal them as if they were floor tiles
-        if (tileMaterial(*tt) == tiletype_material::PLANT ||
-            tileMaterial(*tt) == tiletype_material::MUSHROOM)
-        {
-            if (from_below)
-                unhide = false;
-            else
-                above = sides = true;
-        }
-
-        if (unhide) {
-            des->bits.hidden = false;
-        }
-        if (sides) {
-            // Scan adjacent tiles clockwise, starting toward east
-            flood.emplace(df::coord(current.x + 1, current.y    , current.z), false);
-            flood.emplace(df::coord(current.x + 1, current.y + 1, current.z), false);
-            flood.emplace(df::coord(current.x    , current.y + 1, current.z), false);
-            flood.emplace(df::coord(current.x - 1, current.y + 1, current.z), false);
-            flood.emplace(df::coord(current.x - 1, current.y    , current.z), false);
-            flood.emplace(df::coord(current.x - 1, current.y - 1, current.z), false);
-            flood.emplace(df::coord(current.x    , current.y - 1, current.z), false);
-            flood.emplace(df::coord(current.x + 1, current.y - 1, current.z), false);
-        }
-        if (above)
-            flood.emplace(df::coord(current.x, current.y, current.z + 1), true);
-        if (below)
-            flood.emplace(df::coord(current.x, current.y, current.z - 1), false);
-    }
+    });
 
     update_minimap();
 }
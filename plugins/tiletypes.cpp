@@ -22,7 +22,6 @@
 #include <cstdlib>
 #include <iostream>
 #include <map>
-#include <queue>
 #include <set>
 #include <sstream>
 #include <vector>
@@ -298,9 +297,17 @@ struct TileType
     }
 };
 
-struct PaintResult {
-    int paintCount = 0;
-    std::function<void(MapExtras::MapCache&)> postWrite = [](MapExtras::MapCache& map) {};
+// What a paint job has done so far. Only the painted tiles of each block are
+// kept, for the fixups that have to run after the map cache is written back.
+struct PaintJob {
+    struct PaintedBlock {
+        df::coord origin;
+        brush_rows rows;
+    };
+
+    size_t tiles = 0;    // tiles covered by the brush
+    size_t failures = 0; // tiles that matched the filter but could not be painted
+    std::vector<PaintedBlock> painted;
 };
 
 std::ostream &operator<<(std::ostream &stream, const TileType &paint)
@@ -962,164 +969,78 @@ static bool autocorrectTile(MapExtras::Block* botBlock, MapExtras::Block* topBlo
     return paintTileProcessing(topBlock, blockPos, tiletype);
 }
 
-static bool autocorrectArea(MapExtras::MapCache& map, const df::coord& pos1, const df::coord& pos2, const TileType& botType) {
-    df::coord minPos = df::coord(std::min(pos1.x, pos2.x), std::min(pos1.y, pos2.y), std::min(pos1.z, pos2.z));
-    df::coord maxPos = df::coord(std::max(pos1.x, pos2.x), std::max(pos1.y, pos2.y), std::max(pos1.z, pos2.z));
-
-    bool updated = false;
-    // Loop through the affected blocks
-    for (int16_t blockX = (minPos.x >> 4) << 4; blockX <= maxPos.x; blockX += 16) {
-        for (int16_t blockY = (minPos.y >> 4) << 4; blockY <= maxPos.y; blockY += 16) {
-            std::queue<MapExtras::Block*> blockQueue = std::queue<MapExtras::Block*>();
-            blockQueue.push(map.BlockAtTile(df::coord(blockX, blockY, minPos.z - 1)));
-            blockQueue.push(map.BlockAtTile(df::coord(blockX, blockY, minPos.z)));
-            for (int16_t z = minPos.z; z <= maxPos.z; z++) {
-                blockQueue.push(map.BlockAtTile(df::coord(blockX, blockY, minPos.z + 1)));
-                MapExtras::Block* belowBlock = blockQueue.front();
-                blockQueue.pop();
-
-                int16_t startX = std::max(minPos.x - blockX, 0);
-                int16_t startY = std::max(minPos.y - blockY, 0);
-                int16_t endX = std::min(maxPos.x - blockX, 15);
-                int16_t endY = std::min(maxPos.y - blockY, 15);
-                // Loop through all tiles in the block
-                for (int16_t xOffset = startX; xOffset <= endX; xOffset++) {
-                    for (int16_t yOffset = startY; yOffset <= endY; yOffset++) {
-                        updated |= autocorrectTile(blockQueue.front(), blockQueue.back(), df::coord2d(xOffset, yOffset), botType);
-                        updated |= autocorrectTile(belowBlock, blockQueue.front(), df::coord2d(xOffset, yOffset), botType);
-                    }
-                }
-                blockQueue.front()->enableBlockUpdates(true, true);
-            }
-        }
-    }
-    return updated;
-}
-
-static PaintResult paintArea(MapExtras::MapCache& map, const df::coord& pos1, const df::coord& pos2,
-    const TileType& target, const TileType& match = TileType()) {
-    df::coord minPos = df::coord(std::min(pos1.x, pos2.x), std::min(pos1.y, pos2.y), std::min(pos1.z, pos2.z));
-    df::coord maxPos = df::coord(std::max(pos1.x, pos2.x), std::max(pos1.y, pos2.y), std::max(pos1.z, pos2.z));
-
-    int totalAffectedCount = 0;
-    int totalFilteredCount = 0;
-    coord_vec skipList = coord_vec();
-
-    // Loop through the affected blocks
-    for (int16_t z = minPos.z; z <= maxPos.z; z++) {
-        for (int16_t blockX = (minPos.x >> 4) << 4; blockX <= maxPos.x; blockX += 16) {
-            for (int16_t blockY = (minPos.y >> 4) << 4; blockY <= maxPos.y; blockY += 16) {
-                MapExtras::Block* block = map.BlockAtTile(df::coord(blockX, blockY, z));
-                if (!block)
-                    continue;
-
-                int16_t startX = std::max(minPos.x - blockX, 0);
-                int16_t startY = std::max(minPos.y - blockY, 0);
-                int16_t endX = std::min(maxPos.x - blockX, 15);
-                int16_t endY = std::min(maxPos.y - blockY, 15);
-                // Loop through the affected tiles in the block
-                for (int16_t xOffset = startX; xOffset <= endX; xOffset++) {
-                    for (int16_t yOffset = startY; yOffset <= endY; yOffset++) {
-                        df::coord2d blockOffset = df::coord2d(xOffset, yOffset);
-
-                        df::tiletype source = block->tiletypeAt(blockOffset);
-                        df::tile_designation des = block->DesignationAt(blockOffset);
-                        df::tile_occupancy occ = block->OccupancyAt(blockOffset);
-
-                        // Stone painting operates on the base layer
-                        if (target.stone_material >= 0)
-                            source = block->baseTiletypeAt(blockOffset);
-
-                        t_matpair basemat = block->baseMaterialAt(blockOffset);
-
-                        if (!match.matches(source, des, occ, basemat)) {
-                            totalFilteredCount++;
-                            skipList.push_back(df::coord(blockX + xOffset, blockY + yOffset, z));
-                            continue;
-                        }
-
-                        if (paintTileProcessing(block, blockOffset, target)) {
-                            totalAffectedCount++;
-                        }
-                        else {
-                            skipList.push_back(df::coord(blockX + xOffset, blockY + yOffset, z));
-                            continue;
-                        }
-                    }
-                }
-            }
-        }
-    }
+// Paints the given tiles of one block, skipping the ones that don't match
+static void paintBlock(MapExtras::MapCache &map, PaintJob &job, const df::coord &origin,
+    const brush_rows &rows, const TileType &target, const TileType &match = TileType())
+{
+    MapExtras::Block *block = map.BlockAtTile(origin);
+    if (!block)
+        return;
 
-    return PaintResult{
-        .paintCount = totalAffectedCount + totalFilteredCount,
-        .postWrite = [totalAffectedCount, skipList, target, pos1, pos2](MapExtras::MapCache& map) {
-            if (totalAffectedCount > 0) {
-                auto filter = [skipList](df::coord pos, df::map_block* block) -> bool {
-                    // Returns true if 'pos' is in 'skipList'
-                    return skipList.end() == std::find_if(skipList.begin(), skipList.end(), [pos](df::coord p) { return p.x == pos.x && p.y == pos.y && p.z == pos.z; });
-                };
+    PaintJob::PaintedBlock done{origin, {}};
+    forBrushTiles(rows, [&](const df::coord2d &pos) {
+        ++job.tiles;
+        df::tiletype source = block->tiletypeAt(pos);
+        df::tile_designation des = block->DesignationAt(pos);
+        df::tile_occupancy occ = block->OccupancyAt(pos);
 
-                if (target.autocorrect > 0 && autocorrectArea(map, pos1, pos2, target))
-                    map.WriteAll();
+        // Stone painting operates on the base layer
+        if (target.stone_material >= 0)
+            source = block->baseTiletypeAt(pos);
 
-                if (target.aquifer == 0)
-                    Maps::removeAreaAquifer(pos1, pos2, filter);
-                else if (target.aquifer > 0)
-                    Maps::setAreaAquifer(pos1, pos2, target.aquifer == 2, filter);
+        t_matpair basemat = block->baseMaterialAt(pos);
 
-                // force the game to recompute its walkability cache on the next tick
-                world->reindex_pathfinding = true;
-            }
-        }
-    };
-}
+        if (!match.matches(source, des, occ, basemat))
+            return;
 
-static PaintResult paintTile(MapExtras::MapCache &map, const df::coord &pos,
-                      const TileType &target, const TileType &match = TileType()) {
-    MapExtras::Block *blk = map.BlockAtTile(pos);
-    if (!blk)
-        return PaintResult();
+        if (paintTileProcessing(block, pos, target))
+            done.rows[pos.y] |= 1 << pos.x;
+        else
+            ++job.failures;
+    });
 
-    df::tiletype source = map.tiletypeAt(pos);
-    df::tile_designation des = map.designationAt(pos);
-    df::tile_occupancy occ = map.occupancyAt(pos);
+    if (std::any_of(done.rows.begin(), done.rows.end(), [](uint16_t row) { return row != 0; }))
+        job.painted.push_back(done);
+}
 
-    // Stone painting operates on the base layer
-    if (target.stone_material >= 0)
-        source = blk->baseTiletypeAt(pos);
-
-    t_matpair basemat = blk->baseMaterialAt(pos);
-
-    if (!match.matches(source, des, occ, basemat))
-        return PaintResult();
-
-    if (paintTileProcessing(blk, df::coord2d(pos.x&15, pos.y&15), target)) {
-        return PaintResult{
-            .paintCount = 1,
-            .postWrite = [target, pos](MapExtras::MapCache& map) {
-                if (target.autocorrect > 0) {
-                    MapExtras::Block* block = map.BlockAtTile(pos);
-                    MapExtras::Block* topBlock = map.BlockAtTile(df::coord(pos.x, pos.y, pos.z + 1));
-                    MapExtras::Block* belowBlock = map.BlockAtTile(df::coord(pos.x, pos.y, pos.z - 1));
-                    bool updated = autocorrectTile(block, topBlock, df::coord2d(pos.x & 15, pos.y & 15), target);
-                    updated |= autocorrectTile(belowBlock, block, df::coord2d(pos.x & 15, pos.y & 15), target);
-                    block->enableBlockUpdates(true, true);
-                    if (updated)
-                        map.WriteAll();
-                }
-
-                if (target.aquifer == 0)
-                    Maps::removeTileAquifer(pos);
-                else if (target.aquifer > 0)
-                    Maps::setTileAquifer(pos, target.aquifer == 2);
-
-                // force the game to recompute its walkability cache on the next tick
-                world->reindex_pathfinding = true;
-            }
-        };
+// Fixups for the painted tiles that must run after the map cache is written
+static void finishPaintJob(MapExtras::MapCache &map, const PaintJob &job, const TileType &target) {
+    if (job.painted.empty())
+        return;
+
+    if (target.autocorrect > 0) {
+        bool updated = false;
+        for (auto &done : job.painted) {
+            const df::coord &origin = done.origin;
+            MapExtras::Block *block = map.BlockAtTile(origin);
+            MapExtras::Block *topBlock = map.BlockAtTile(df::coord(origin.x, origin.y, origin.z + 1));
+            MapExtras::Block *belowBlock = map.BlockAtTile(df::coord(origin.x, origin.y, origin.z - 1));
+            forBrushTiles(done.rows, [&](const df::coord2d &pos) {
+                updated |= autocorrectTile(block, topBlock, pos, target);
+                updated |= autocorrectTile(belowBlock, block, pos, target);
+            });
+            if (block)
+                block->enableBlockUpdates(true, true);
+        }
+        if (updated)
+            map.WriteAll();
+    }
+
+    if (target.aquifer >= 0) {
+        for (auto &done : job.painted) {
+            df::coord corner(done.origin.x + 15, done.origin.y + 15, done.origin.z);
+            auto painted = [&](df::coord pos, df::map_block *) -> bool {
+                return (done.rows[pos.y & 15] >> (pos.x & 15)) & 1;
+            };
+            if (target.aquifer == 0)
+                Maps::removeAreaAquifer(done.origin, corner, painted);
+            else
+                Maps::setAreaAquifer(done.origin, corner, target.aquifer == 2, painted);
+        }
     }
-    return PaintResult();
+
+    // force the game to recompute its walkability cache on the next tick
+    world->reindex_pathfinding = true;
 }
 
 command_result executePaintJob(color_ostream &out,
@@ -1161,52 +1082,23 @@ command_result executePaintJob(color_ostream &out,
         out.print("Cursor coords: (%d, %d, %d)\n",
                   cursor.x, cursor.y, cursor.z);
 
-    MapExtras::MapCache map;
-    coord_vec all_tiles = brush->points(map, cursor);
     if (!opts.quiet)
         out.print("working...\n");
 
-    int failures = 0;
-    std::vector<PaintResult> paintResults = std::vector<PaintResult>();
-
-    if (all_tiles.size() > 0) {
-        if (dynamic_cast<RectangleBrush*>(brush) != nullptr || dynamic_cast<BlockBrush*>(brush) != nullptr || dynamic_cast<ColumnBrush*>(brush) != nullptr) {
-            df::coord minPos = all_tiles[0];
-            df::coord maxPos = all_tiles[0];
-            for (df::coord& tile : all_tiles) {
-                minPos.x = std::min(minPos.x, tile.x);
-                minPos.y = std::min(minPos.y, tile.y);
-                minPos.z = std::min(minPos.z, tile.z);
-                maxPos.x = std::max(maxPos.x, tile.x);
-                maxPos.y = std::max(maxPos.y, tile.y);
-                maxPos.z = std::max(maxPos.z, tile.z);
-            }
-            PaintResult result = paintArea(map, minPos, maxPos, paint, filter);
-            paintResults.push_back(result);
-            failures = all_tiles.size() - result.paintCount;
-        }
-        else {
-            for (coord_vec::iterator iter = all_tiles.begin(); iter != all_tiles.end(); ++iter)
-            {
-                PaintResult result = paintTile(map, *iter, paint, filter);
-                if (result.paintCount == 0)
-                    ++failures;
-                else
-                    paintResults.push_back(result);
-            }
-        }
-    }
+    MapExtras::MapCache map;
+    PaintJob job;
+    brush->forBlocks(map, cursor, [&](const df::coord &origin, const brush_rows &rows) {
+        paintBlock(map, job, origin, rows, paint, filter);
+    });
 
-    if (failures > 0)
-        out.printerr("Could not update %d tiles of %zu.\n", failures, all_tiles.size());
+    if (job.failures > 0)
+        out.printerr("Could not update %zu tiles of %zu.\n", job.failures, job.tiles);
     else if (!opts.quiet)
-        out.print("Processed %zu tiles.\n", all_tiles.size());
+        out.print("Processed %zu tiles.\n", job.tiles);
 
     if (map.WriteAll())
     {
-        for (PaintResult& result : paintResults) {
-            result.postWrite(map);
-        }
+        finishPaintJob(map, job, paint);
         if (!opts.quiet)
             out.print("OK\n");
         return CR_OK;
@@ -1464,9 +1356,12 @@ static bool setTile(color_ostream& out, df::coord pos, TileType target) {
     }
 
     MapExtras::MapCache map;
-    PaintResult result = paintTile(map, pos, target);
-    if (result.paintCount > 0 && map.WriteAll()) {
-        result.postWrite(map);
+    PaintJob job;
+    brush_rows rows{};
+    rows[pos.y & 15] = 1 << (pos.x & 15);
+    paintBlock(map, job, df::coord(pos.x & ~15, pos.y & ~15, pos.z), rows, target);
+    if (!job.painted.empty() && map.WriteAll()) {
+        finishPaintJob(map, job, target);
         return true;
     }
     return false;
@@ -10,6 +10,16 @@
 #include "PluginManager.h"
 #include "PluginStatics.h"
 
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <deque>
+#include <future>
+#include <map>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+
 using namespace DFHack;
 
 DFHACK_PLUGIN("xlsxreader");
@@ -128,6 +138,193 @@ int get_row(lua_State *L) {
     return 1;
 }
 
+// the part of a sheet to read; rows and columns are 1-based and inclusive
+struct cell_range {
+    int32_t first_row = 1;
+    int32_t first_col = 1;
+    int32_t last_row = INT32_MAX;
+    int32_t last_col = INT32_MAX;
+};
+
+// the non-empty cells of a range, stored by column: cell i is at rows[i],
+// cols[i], and has the value strings[values[i] - 1]. each distinct value is
+// stored once.
+struct sheet_cells {
+    std::deque<std::string> strings;
+    std::vector<int32_t> rows;
+    std::vector<int32_t> cols;
+    std::vector<int32_t> values;
+    int32_t num_rows = 0;
+    int32_t num_cols = 0;
+    std::string error;
+};
+
+namespace {
+    struct string_hash {
+        using is_transparent = void;
+        size_t operator()(std::string_view str) const {
+            return std::hash<std::string_view>()(str);
+        }
+    };
+}
+
+// reads the rest of the sheet, or until the end of the range
+static void read_cells(xlsxioreadersheet sheet, const cell_range &range,
+                       sheet_cells &cells) {
+    // views point into cells.strings, which never moves its elements
+    std::unordered_map<std::string_view, int32_t, string_hash, std::equal_to<>> interned;
+
+    int32_t row = 0;
+    while (row < range.last_row && xlsxioread_sheet_next_row(sheet)) {
+        ++row;
+        int32_t col = 0;
+        while (char *value = xlsxioread_sheet_next_cell(sheet)) {
+            // read all cells in the row, even if we don't need to; otherwise
+            // xlsxio will return a spurious empty row on next call
+            ++col;
+            if (*value && row >= range.first_row && col >= range.first_col
+                    && col <= range.last_col) {
+                auto it = interned.find(std::string_view(value));
+                if (it == interned.end()) {
+                    cells.strings.emplace_back(value);
+                    it = interned.emplace(cells.strings.back(),
+                                          int32_t(cells.strings.size())).first;
+                }
+                cells.rows.push_back(row);
+                cells.cols.push_back(col);
+                cells.values.push_back(it->second);
+                cells.num_rows = row;
+                cells.num_cols = std::max(cells.num_cols, col);
+            }
+            free(value);
+        }
+    }
+}
+
+static void push_int_array(lua_State *L, const std::vector<int32_t> &vals) {
+    lua_createtable(L, vals.size(), 0);
+    for (size_t i = 0; i < vals.size(); ++i) {
+        lua_pushinteger(L, vals[i]);
+        lua_rawseti(L, -2, i + 1);
+    }
+}
+
+static void push_sheet_cells(lua_State *L, const sheet_cells &cells) {
+    lua_createtable(L, 0, 6);
+    lua_createtable(L, cells.strings.size(), 0);
+    int i = 0;
+    for (auto &str : cells.strings) {
+        lua_pushlstring(L, str.data(), str.size());
+        lua_rawseti(L, -2, ++i);
+    }
+    lua_setfield(L, -2, "strings");
+    push_int_array(L, cells.rows);
+    lua_setfield(L, -2, "rows");
+    push_int_array(L, cells.cols);
+    lua_setfield(L, -2, "cols");
+    push_int_array(L, cells.values);
+    lua_setfield(L, -2, "values");
+    lua_pushinteger(L, cells.num_rows);
+    lua_setfield(L, -2, "num_rows");
+    lua_pushinteger(L, cells.num_cols);
+    lua_setfield(L, -2, "num_cols");
+}
+
+// reads the optional first_row, first_col, last_row, last_col params
+static cell_range get_cell_range(lua_State *L, int idx) {
+    cell_range range;
+    range.first_row = luaL_optinteger(L, idx, range.first_row);
+    range.first_col = luaL_optinteger(L, idx + 1, range.first_col);
+    range.last_row = luaL_optinteger(L, idx + 2, range.last_row);
+    range.last_col = luaL_optinteger(L, idx + 3, range.last_col);
+    return range;
+}
+
+// takes the sheet handle and an optional range and returns the non-empty cells
+// in the rest of the sheet. row numbers count from the next unread row.
+int get_cells(lua_State *L) {
+    auto sheet_handle = (xlsx_sheet_handle *)get_xlsxreader_handle(L);
+    CHECK_NULL_POINTER(sheet_handle->handle);
+    sheet_cells cells;
+    read_cells(sheet_handle->handle, get_cell_range(L, 2), cells);
+    push_sheet_cells(L, cells);
+    return 1;
+}
+
+// sheets being read in the background, by job id
+static std::map<int, std::future<std::unique_ptr<sheet_cells>>> read_jobs;
+static int last_read_job = 0;
+// finished jobs whose results were never fetched are dropped, oldest first,
+// to keep at most this many jobs around
+static const size_t MAX_READ_JOBS = 16;
+
+static std::unique_ptr<sheet_cells> read_file_cells(std::string filename,
+        std::string sheet_name, cell_range range) {
+    auto cells = std::make_unique<sheet_cells>();
+    xlsxioreader file = xlsxioread_open(filename.c_str());
+    if (!file) {
+        cells->error = "failed to open \"" + filename + "\"";
+        return cells;
+    }
+    xlsxioreadersheet sheet = xlsxioread_sheet_open(file, sheet_name.c_str(),
+                                                    XLSXIOREAD_SKIP_NONE);
+    if (sheet) {
+        read_cells(sheet, range, *cells);
+        xlsxioread_sheet_close(sheet);
+    } else {
+        cells->error = "failed to open sheet \"" + sheet_name + "\" in \""
+                       + filename + "\"";
+    }
+    xlsxioread_close(file);
+    return cells;
+}
+
+// takes a filename, a sheet name, and an optional range, and starts reading
+// the cells on a separate thread. returns a job id for get_read_result.
+int start_read(lua_State *L) {
+    std::string filename = luaL_checkstring(L, 1);
+    std::string sheet_name = luaL_optstring(L, 2, "");
+    cell_range range = get_cell_range(L, 3);
+    // destroying a future that is still running would block until it is done,
+    // so only finished jobs can be dropped
+    for (auto it = read_jobs.begin();
+            it != read_jobs.end() && read_jobs.size() >= MAX_READ_JOBS;) {
+        if (it->second.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+            it = read_jobs.erase(it);
+        else
+            ++it;
+    }
+    if (read_jobs.size() >= MAX_READ_JOBS)
+        luaL_error(L, "too many xlsxreader reads in progress");
+    int id = ++last_read_job;
+    read_jobs[id] = std::async(std::launch::async, read_file_cells,
+                               filename, sheet_name, range);
+    lua_pushinteger(L, id);
+    return 1;
+}
+
+// takes a job id and returns nil if the job is still running, or the cells in
+// the same form as get_cells if it is done.
+int get_read_result(lua_State *L) {
+    int id = luaL_checkinteger(L, 1);
+    auto it = read_jobs.find(id);
+    if (it == read_jobs.end())
+        luaL_error(L, "invalid xlsxreader job id: %d", id);
+    if (it->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        lua_pushnil(L);
+        return 1;
+    }
+    auto cells = it->second.get();
+    read_jobs.erase(it);
+    if (!cells->error.empty()) {
+        lua_pushstring(L, cells->error.c_str());
+        cells.reset();
+        return lua_error(L);
+    }
+    push_sheet_cells(L, *cells);
+    return 1;
+}
+
 DFHACK_PLUGIN_LUA_FUNCTIONS {
     DFHACK_LUA_FUNCTION(open_xlsx_file),
     DFHACK_LUA_FUNCTION(close_xlsx_file),
@@ -139,6 +336,9 @@ DFHACK_PLUGIN_LUA_FUNCTIONS {
 DFHACK_PLUGIN_LUA_COMMANDS{
     DFHACK_LUA_COMMAND(list_sheets),
     DFHACK_LUA_COMMAND(get_row),
+    DFHACK_LUA_COMMAND(get_cells),
+    DFHACK_LUA_COMMAND(start_read),
+    DFHACK_LUA_COMMAND(get_read_result),
     DFHACK_LUA_END
 };
 
@@ -148,5 +348,7 @@ DFhackCExport command_result plugin_init(color_ostream &,
 }
 
 DFhackCExport command_result plugin_shutdown(color_ostream &) {
+    // waits for any reads that are still running
+    read_jobs.clear();
     return CR_OK;
 }